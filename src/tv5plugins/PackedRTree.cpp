@@ -0,0 +1,274 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*!
+  \file terralib/qt/plugins/thirdParty/PackedRTree.cpp
+
+  \brief This file defines a static R-tree bulk loaded with the Sort-Tile-Recursive algorithm.
+*/
+
+#include "PackedRTree.h"
+
+//STL Includes
+#include <algorithm>
+#include <cmath>
+
+// Boost
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+//ranges smaller than this are sorted by a single thread
+#define MIN_PARALLEL_SORT 16384
+
+namespace
+{
+  typedef te::qt::plugins::tv5plugins::PackedRTree::Node PackedNode;
+
+  struct CenterXLess
+  {
+    bool operator()(const PackedNode& a, const PackedNode& b) const
+    {
+      return (a.m_llx + a.m_urx) < (b.m_llx + b.m_urx);
+    }
+  };
+
+  struct CenterYLess
+  {
+    bool operator()(const PackedNode& a, const PackedNode& b) const
+    {
+      return (a.m_lly + a.m_ury) < (b.m_lly + b.m_ury);
+    }
+  };
+
+  template<class Compare> void SortRange(std::vector<PackedNode>* nodes, std::size_t begin, std::size_t end, Compare comp)
+  {
+    std::sort(nodes->begin() + begin, nodes->begin() + end, comp);
+  }
+
+  template<class Compare> void MergeRange(std::vector<PackedNode>* nodes, std::size_t begin, std::size_t middle, std::size_t end, Compare comp)
+  {
+    std::inplace_merge(nodes->begin() + begin, nodes->begin() + middle, nodes->begin() + end, comp);
+  }
+
+  template<class Compare> void ParallelSort(std::vector<PackedNode>& nodes, Compare comp, std::size_t nThreads)
+  {
+    if(nThreads < 2 || nodes.size() < MIN_PARALLEL_SORT)
+    {
+      std::sort(nodes.begin(), nodes.end(), comp);
+      return;
+    }
+
+    //sort one chunk by thread
+    std::vector<std::size_t> bounds;
+
+    for(std::size_t t = 0; t <= nThreads; ++t)
+      bounds.push_back((nodes.size() * t) / nThreads);
+
+    {
+      boost::thread_group threads;
+
+      for(std::size_t t = 0; t < nThreads; ++t)
+        threads.create_thread(boost::bind(&SortRange<Compare>, &nodes, bounds[t], bounds[t + 1], comp));
+
+      threads.join_all();
+    }
+
+    //merge neighbor chunks until a single chunk is left
+    while(bounds.size() > 2)
+    {
+      std::vector<std::size_t> merged;
+
+      boost::thread_group threads;
+
+      std::size_t t = 0;
+
+      for(; t + 2 < bounds.size(); t += 2)
+      {
+        threads.create_thread(boost::bind(&MergeRange<Compare>, &nodes, bounds[t], bounds[t + 1], bounds[t + 2], comp));
+
+        merged.push_back(bounds[t]);
+      }
+
+      threads.join_all();
+
+      //odd chunk left as it is
+      if(t < bounds.size() - 1)
+        merged.push_back(bounds[t]);
+
+      merged.push_back(bounds.back());
+
+      bounds.swap(merged);
+    }
+  }
+
+  void SortSlices(std::vector<PackedNode>* nodes, std::size_t sliceSize, std::size_t first, std::size_t step)
+  {
+    for(std::size_t begin = first * sliceSize; begin < nodes->size(); begin += step * sliceSize)
+    {
+      std::size_t end = std::min(begin + sliceSize, nodes->size());
+
+      std::sort(nodes->begin() + begin, nodes->begin() + end, CenterYLess());
+    }
+  }
+
+  //sorts the nodes of a level in vertical slices, each group of nodeCapacity nodes becomes a parent node
+  void SortTile(std::vector<PackedNode>& nodes, std::size_t nodeCapacity, std::size_t nThreads)
+  {
+    std::size_t nParents = (nodes.size() + nodeCapacity - 1) / nodeCapacity;
+
+    std::size_t nSlices = (std::size_t)std::ceil(std::sqrt((double)nParents));
+
+    std::size_t sliceSize = nSlices * nodeCapacity;
+
+    ParallelSort(nodes, CenterXLess(), nThreads);
+
+    if(nThreads < 2 || nodes.size() < MIN_PARALLEL_SORT)
+    {
+      SortSlices(&nodes, sliceSize, 0, 1);
+      return;
+    }
+
+    boost::thread_group threads;
+
+    for(std::size_t t = 0; t < nThreads; ++t)
+      threads.create_thread(boost::bind(&SortSlices, &nodes, sliceSize, t, nThreads));
+
+    threads.join_all();
+  }
+}
+
+te::qt::plugins::tv5plugins::PackedRTree::PackedRTree(std::size_t nodeCapacity) :
+  m_nodeCapacity(nodeCapacity > 1 ? nodeCapacity : 2)
+{
+}
+
+te::qt::plugins::tv5plugins::PackedRTree::~PackedRTree()
+{
+}
+
+void te::qt::plugins::tv5plugins::PackedRTree::insert(const te::gm::Envelope& box, int id)
+{
+  Node n;
+  n.m_llx = box.m_llx;
+  n.m_lly = box.m_lly;
+  n.m_urx = box.m_urx;
+  n.m_ury = box.m_ury;
+  n.m_child = (std::size_t)id;
+  n.m_count = 0;
+
+  m_entries.push_back(n);
+}
+
+void te::qt::plugins::tv5plugins::PackedRTree::build(std::size_t nThreads)
+{
+  if(nThreads == 0)
+    nThreads = std::max(1u, boost::thread::hardware_concurrency());
+
+  //entries inserted after a previous build are packed together with the old ones
+  if(!m_levels.empty())
+  {
+    m_entries.insert(m_entries.end(), m_levels[0].begin(), m_levels[0].end());
+    m_levels.clear();
+  }
+
+  if(m_entries.empty())
+    return;
+
+  m_levels.push_back(std::vector<Node>());
+  m_levels.back().swap(m_entries);
+
+  //pack each level into the level above until a single root is left
+  while(m_levels.back().size() > 1)
+  {
+    std::vector<Node>& level = m_levels.back();
+
+    SortTile(level, m_nodeCapacity, nThreads);
+
+    std::vector<Node> parents;
+    parents.reserve((level.size() + m_nodeCapacity - 1) / m_nodeCapacity);
+
+    for(std::size_t begin = 0; begin < level.size(); begin += m_nodeCapacity)
+    {
+      std::size_t end = std::min(begin + m_nodeCapacity, level.size());
+
+      Node p = level[begin];
+      p.m_child = begin;
+      p.m_count = end - begin;
+
+      for(std::size_t t = begin + 1; t < end; ++t)
+      {
+        p.m_llx = std::min(p.m_llx, level[t].m_llx);
+        p.m_lly = std::min(p.m_lly, level[t].m_lly);
+        p.m_urx = std::max(p.m_urx, level[t].m_urx);
+        p.m_ury = std::max(p.m_ury, level[t].m_ury);
+      }
+
+      parents.push_back(p);
+    }
+
+    m_levels.push_back(std::vector<Node>());
+    m_levels.back().swap(parents);
+  }
+}
+
+std::size_t te::qt::plugins::tv5plugins::PackedRTree::search(const te::gm::Envelope& box, std::vector<int>& report) const
+{
+  if(m_levels.empty())
+    return 0;
+
+  std::size_t nFound = 0;
+
+  //pending nodes as (level, position) pairs
+  std::vector<std::pair<std::size_t, std::size_t> > stack;
+  stack.push_back(std::make_pair(m_levels.size() - 1, (std::size_t)0));
+
+  while(!stack.empty())
+  {
+    std::size_t level = stack.back().first;
+    const Node& n = m_levels[level][stack.back().second];
+
+    stack.pop_back();
+
+    if(n.m_llx > box.m_urx || n.m_urx < box.m_llx || n.m_lly > box.m_ury || n.m_ury < box.m_lly)
+      continue;
+
+    if(level == 0)
+    {
+      report.push_back((int)n.m_child);
+      ++nFound;
+      continue;
+    }
+
+    for(std::size_t t = 0; t < n.m_count; ++t)
+      stack.push_back(std::make_pair(level - 1, n.m_child + t));
+  }
+
+  return nFound;
+}
+
+void te::qt::plugins::tv5plugins::PackedRTree::clear()
+{
+  m_entries.clear();
+  m_levels.clear();
+}
+
+std::size_t te::qt::plugins::tv5plugins::PackedRTree::size() const
+{
+  return m_entries.size() + (m_levels.empty() ? 0 : m_levels[0].size());
+}
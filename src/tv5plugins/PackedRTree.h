@@ -0,0 +1,105 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*!
+  \file terralib/qt/plugins/thirdParty/PackedRTree.h
+
+  \brief This file defines a static R-tree bulk loaded with the Sort-Tile-Recursive algorithm.
+*/
+
+#ifndef __TE_QT_PLUGINS_THIRDPARTY_INTERNAL_PACKEDRTREE_H
+#define __TE_QT_PLUGINS_THIRDPARTY_INTERNAL_PACKEDRTREE_H
+
+// TerraLib
+#include <terralib/geometry/Envelope.h>
+#include "Config.h"
+
+//STL Includes
+#include <vector>
+
+namespace te
+{
+  namespace qt
+  {
+    namespace plugins
+    {
+      namespace tv5plugins
+      {
+        /*!
+          \class PackedRTree
+
+          \brief R-tree built in a single step from all the entries (Sort-Tile-Recursive packing).
+
+          Entries are collected with insert and the tree is packed by build, every node
+          is full except the last one of each level. The sorts used by the packing are
+          split between threads. Searching is read only, so concurrent searches are allowed.
+        */
+        class PackedRTree
+        {
+          public:
+
+            struct Node
+            {
+              double m_llx;
+              double m_lly;
+              double m_urx;
+              double m_ury;
+              std::size_t m_child;    //!< Position of the first child in the level below (entry id for the leaves).
+              std::size_t m_count;    //!< Number of children (0 for the leaves).
+            };
+
+            /*!
+              \brief Constructor.
+
+              \param nodeCapacity Maximum number of children of each node.
+            */
+            PackedRTree(std::size_t nodeCapacity = 16);
+
+            ~PackedRTree();
+
+            /*! \brief Adds an entry, it is only found by search after build is called. */
+            void insert(const te::gm::Envelope& box, int id);
+
+            /*!
+              \brief Packs the inserted entries.
+
+              \param nThreads Number of threads used to sort the entries, 0 uses the number of hardware threads.
+            */
+            void build(std::size_t nThreads = 0);
+
+            /*! \brief Appends to report the id of each entry that intersects the box and returns the number of entries found. */
+            std::size_t search(const te::gm::Envelope& box, std::vector<int>& report) const;
+
+            void clear();
+
+            std::size_t size() const;
+
+          protected:
+
+            std::size_t m_nodeCapacity;
+            std::vector<Node> m_entries;                //!< Entries inserted and not packed yet.
+            std::vector<std::vector<Node> > m_levels;   //!< Tree levels, the leaves first and the root last.
+        };
+
+      } // end namespace thirdParty
+    }   // end namespace plugins
+  }     // end namespace qt
+}       // end namespace te
+
+#endif //__TE_QT_PLUGINS_THIRDPARTY_INTERNAL_PACKEDRTREE_H
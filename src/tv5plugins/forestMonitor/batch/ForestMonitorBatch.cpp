@@ -0,0 +1,301 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*! \file terralib/qt/plugins/thirdParty/forestMonitor/batch/ForestMonitorBatch.cpp
+
+    \brief Command line application that creates the tracks of a farm without the TerraView interface.
+
+    Usage:
+      forest_monitor_batch --centroids <file> --parcels <file> --angles <file> --output <file> --distance <value>
+                           [--angle-tol <value>] [--distance-tol <value>] [--threads <n>] [--index grid|rtree]
+                           [--chunk-size <n>] [--incremental yes|no] [--plugins <dir>]
+      forest_monitor_batch --benchmark yes --centroids <file> --distance <value> [--distance-tol <value>] [--plugins <dir>]
+
+    Each input is read with the OGR driver, the data set name is the file name without extension.
+    The benchmark only indexes the centroids with each point index and prints the build and query times.
+*/
+
+//TerraLib Includes
+#include <terralib/common/progress/ConsoleProgressViewer.h>
+#include <terralib/common/progress/ProgressManager.h>
+#include <terralib/common/PlatformUtils.h>
+#include <terralib/common/TerraLib.h>
+#include <terralib/dataaccess/datasource/DataSource.h>
+#include <terralib/dataaccess/datasource/DataSourceFactory.h>
+#include <terralib/dataaccess/utils/Utils.h>
+#include <terralib/geometry/Geometry.h>
+#include <terralib/plugin/PluginInfo.h>
+#include <terralib/plugin/PluginManager.h>
+#include <terralib/plugin/Utils.h>
+#include "../core/CentroidStore.h"
+#include "../core/ForestMonitorService.h"
+#include "../core/PointIndex.h"
+
+//STL Includes
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+
+// Boost
+#include <boost/filesystem.hpp>
+
+//default values used by the forest monitor dialog
+#define DEFAULT_ANGLE_TOL "20"
+#define DEFAULT_DISTANCE_TOL "0.5"
+#define DEFAULT_CHUNK_SIZE "10000"
+
+void PrintUsage()
+{
+  std::cout << "Usage: forest_monitor_batch --centroids <file> --parcels <file> --angles <file> --output <file> --distance <value>" << std::endl;
+  std::cout << "                            [--angle-tol <value>] [--distance-tol <value>] [--threads <n>] [--index grid|rtree]" << std::endl;
+  std::cout << "                            [--chunk-size <n>] [--incremental yes|no] [--plugins <dir>]" << std::endl;
+  std::cout << "       forest_monitor_batch --benchmark yes --centroids <file> --distance <value> [--distance-tol <value>] [--plugins <dir>]" << std::endl;
+  std::cout << std::endl;
+  std::cout << "  --centroids     Tree centroids (points)." << std::endl;
+  std::cout << "  --parcels       Parcels (polygons)." << std::endl;
+  std::cout << "  --angles        Lines with the planting direction of each parcel." << std::endl;
+  std::cout << "  --output        Track lines file to be created." << std::endl;
+  std::cout << "  --distance      Distance between centroids of a track." << std::endl;
+  std::cout << "  --angle-tol     Angle tolerance in degrees (default " << DEFAULT_ANGLE_TOL << ")." << std::endl;
+  std::cout << "  --distance-tol  Distance tolerance (default " << DEFAULT_DISTANCE_TOL << ")." << std::endl;
+  std::cout << "  --threads       Number of threads, 0 uses all hardware threads (default 0)." << std::endl;
+  std::cout << "  --index         Centroid spatial index (default grid)." << std::endl;
+  std::cout << "  --chunk-size    Number of tracks saved by each transaction (default " << DEFAULT_CHUNK_SIZE << ")." << std::endl;
+  std::cout << "  --incremental   Create again only the tracks of the parcels changed since the last execution (default no)." << std::endl;
+  std::cout << "  --plugins       Directory with the TerraLib plugin files." << std::endl;
+  std::cout << "  --benchmark     Only time the centroid indexes, no tracks are created (default no)." << std::endl;
+}
+
+bool ParseArguments(int argc, char** argv, std::map<std::string, std::string>& args)
+{
+  for(int i = 1; i < argc; i += 2)
+  {
+    std::string name = argv[i];
+
+    if(name.size() < 3 || name.compare(0, 2, "--") != 0 || i + 1 >= argc)
+      return false;
+
+    args[name.substr(2)] = argv[i + 1];
+  }
+
+  //the benchmark only reads the centroids
+  if(args.count("benchmark") && args["benchmark"] == "yes")
+    return args.count("centroids") && args.count("distance");
+
+  return args.count("centroids") && args.count("parcels") && args.count("angles") && args.count("output") && args.count("distance");
+}
+
+void LoadModules(const std::string& pluginsDir)
+{
+  std::string dir = pluginsDir.empty() ? te::common::FindInTerraLibPath("share/terralib/plugins") : pluginsDir;
+
+  te::plugin::PluginInfo* info = te::plugin::GetInstalledPlugin(dir + "/te.da.ogr.teplg");
+
+  te::plugin::PluginManager::getInstance().add(info);
+
+  te::plugin::PluginManager::getInstance().loadAll();
+}
+
+te::da::DataSourcePtr OpenDataSource(const std::string& fileName)
+{
+  std::map<std::string, std::string> connInfo;
+  connInfo["URI"] = fileName;
+
+  std::auto_ptr<te::da::DataSource> dataSource = te::da::DataSourceFactory::make("OGR");
+  dataSource->setConnectionInfo(connInfo);
+  dataSource->open();
+
+  return te::da::DataSourcePtr(dataSource.release());
+}
+
+std::string GetDataSetName(const std::string& fileName)
+{
+  return boost::filesystem::path(fileName).stem().string();
+}
+
+void RunBenchmark(te::da::DataSourcePtr ds, const std::string& dataSetName, double distance, double distanceTol)
+{
+  std::auto_ptr<te::da::DataSet> dataSet = ds->getDataSet(dataSetName);
+
+  std::size_t geomIdx = te::da::GetFirstPropertyPos(dataSet.get(), te::dt::GEOMETRY_TYPE);
+
+  te::qt::plugins::tv5plugins::CentroidStore centroids;
+  centroids.reserve(dataSet->size());
+
+  int id = 0;
+
+  while(dataSet->moveNext())
+  {
+    std::auto_ptr<te::gm::Geometry> g = dataSet->getGeometry(geomIdx);
+
+    std::size_t idx;
+
+    centroids.add(id++, g.get(), idx);
+  }
+
+  //the same query box and cell size used by the track detection
+  double queryDist = distance + distanceTol;
+
+  te::qt::plugins::tv5plugins::PointIndexType types[] = { te::qt::plugins::tv5plugins::GRID_POINT_INDEX, te::qt::plugins::tv5plugins::RTREE_POINT_INDEX };
+  const char* names[] = { "grid", "rtree" };
+
+  std::cout << std::endl << "Point index benchmark, " << centroids.size() << " centroids (s):" << std::endl;
+  std::cout << "  " << std::left << std::setw(8) << "Index" << std::right << std::setw(12) << "Build" << std::setw(12) << "Query" << std::setw(14) << "Results" << std::endl;
+
+  for(std::size_t t = 0; t < 2; ++t)
+  {
+    te::qt::plugins::tv5plugins::PointIndexBenchmark result = te::qt::plugins::tv5plugins::BenchmarkPointIndex(types[t], centroids, distance, queryDist);
+
+    std::cout << "  " << std::left << std::setw(8) << names[t] << std::right << std::fixed << std::setprecision(3)
+              << std::setw(12) << result.m_buildTime << std::setw(12) << result.m_searchTime << std::setw(14) << result.m_nResults << std::endl;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  std::map<std::string, std::string> args;
+
+  if(!ParseArguments(argc, argv, args))
+  {
+    PrintUsage();
+    return EXIT_FAILURE;
+  }
+
+  double distance = atof(args["distance"].c_str());
+  double angleTol = atof(args.count("angle-tol") ? args["angle-tol"].c_str() : DEFAULT_ANGLE_TOL);
+  double distanceTol = atof(args.count("distance-tol") ? args["distance-tol"].c_str() : DEFAULT_DISTANCE_TOL);
+  int nThreads = args.count("threads") ? atoi(args["threads"].c_str()) : 0;
+  int chunkSize = atoi(args.count("chunk-size") ? args["chunk-size"].c_str() : DEFAULT_CHUNK_SIZE);
+
+  bool benchmark = args.count("benchmark") && args["benchmark"] == "yes";
+
+  if(args.count("benchmark") && !benchmark && args["benchmark"] != "no")
+  {
+    PrintUsage();
+    return EXIT_FAILURE;
+  }
+
+  bool incremental = false;
+
+  if(args.count("incremental"))
+  {
+    if(args["incremental"] == "yes")
+      incremental = true;
+    else if(args["incremental"] != "no")
+    {
+      PrintUsage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  te::qt::plugins::tv5plugins::PointIndexType indexType = te::qt::plugins::tv5plugins::GRID_POINT_INDEX;
+
+  if(args.count("index"))
+  {
+    if(args["index"] == "rtree")
+      indexType = te::qt::plugins::tv5plugins::RTREE_POINT_INDEX;
+    else if(args["index"] != "grid")
+    {
+      PrintUsage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  if(distance <= 0. || nThreads < 0 || chunkSize <= 0)
+  {
+    std::cerr << "Invalid distance, number of threads or chunk size." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  TerraLib::getInstance().initialize();
+
+  te::common::ConsoleProgressViewer viewer;
+  int viewerId = te::common::ProgressManager::getInstance().addViewer(&viewer);
+
+  int status = EXIT_SUCCESS;
+
+  try
+  {
+    LoadModules(args["plugins"]);
+
+    te::da::DataSourcePtr centroidDs = OpenDataSource(args["centroids"]);
+
+    if(benchmark)
+    {
+      RunBenchmark(centroidDs, GetDataSetName(args["centroids"]), distance, distanceTol);
+    }
+    else
+    {
+      te::da::DataSourcePtr parcelDs = OpenDataSource(args["parcels"]);
+      te::da::DataSourcePtr angleDs = OpenDataSource(args["angles"]);
+      te::da::DataSourcePtr outputDs = OpenDataSource(args["output"]);
+
+      te::qt::plugins::tv5plugins::ForestMonitorService fms;
+
+      fms.setInputParameters(centroidDs, GetDataSetName(args["centroids"]),
+                             parcelDs, GetDataSetName(args["parcels"]),
+                             angleDs, GetDataSetName(args["angles"]),
+                             angleTol, distance, distanceTol);
+
+      fms.setOutputParameters(outputDs, GetDataSetName(args["output"]));
+
+      fms.setNumberOfThreads((std::size_t)nThreads);
+
+      fms.setPointIndexType(indexType);
+
+      fms.setChunkSize((std::size_t)chunkSize);
+
+      fms.setIncremental(incremental);
+
+      fms.runService();
+
+      //timing summary
+      const std::vector<std::pair<std::string, double> >& times = fms.getStageTimes();
+
+      double total = 0.;
+
+      std::cout << std::endl << "Stage times (s):" << std::endl;
+
+      for(std::size_t t = 0; t < times.size(); ++t)
+      {
+        std::cout << "  " << std::left << std::setw(16) << times[t].first << std::right << std::fixed << std::setprecision(3) << times[t].second << std::endl;
+
+        total += times[t].second;
+      }
+
+      std::cout << "  " << std::left << std::setw(16) << "Total" << std::right << std::fixed << std::setprecision(3) << total << std::endl;
+    }
+  }
+  catch(const std::exception& e)
+  {
+    std::cerr << "Error: " << e.what() << std::endl;
+
+    status = EXIT_FAILURE;
+  }
+
+  te::common::ProgressManager::getInstance().removeViewer(viewerId);
+
+  te::plugin::PluginManager::getInstance().unloadAll();
+
+  TerraLib::getInstance().finalize();
+
+  return status;
+}
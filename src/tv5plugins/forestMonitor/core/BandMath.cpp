@@ -0,0 +1,510 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*! \file terralib/qt/plugins/thirdParty/forestMonitor/core/BandMath.cpp
+
+    \brief This file contains the band math engine used to compute vegetation indices.
+*/
+
+//TerraLib Includes
+#include <terralib/common/Exception.h>
+#include <terralib/datatype/Enums.h>
+#include <terralib/raster/Band.h>
+#include <terralib/raster/BandProperty.h>
+#include <terralib/raster/Grid.h>
+#include <terralib/raster/Raster.h>
+#include <terralib/raster/RasterFactory.h>
+#include "BandMath.h"
+#include "RasterBlock.h"
+
+//STL Includes
+#include <algorithm>
+#include <cmath>
+
+// Boost
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
+
+//tolerance, in pixels, used to compare the grids of the input bands
+#define BAND_MATH_GRID_TOLERANCE 0.000001
+
+namespace
+{
+  /*! \brief True if the rasters have the same SRID and grid, the origin and the far corners of raster are compared on the grid of ref. */
+  bool SameGrid(const te::rst::Raster* ref, const te::rst::Raster* raster)
+  {
+    if(raster == ref)
+      return true;
+
+    if(raster->getSRID() != ref->getSRID() ||
+       raster->getNumberOfColumns() != ref->getNumberOfColumns() ||
+       raster->getNumberOfRows() != ref->getNumberOfRows())
+      return false;
+
+    const te::rst::Grid* refGrid = ref->getGrid();
+    const te::rst::Grid* grid = raster->getGrid();
+
+    double corners[3][2] = { { 0., 0. }, { (double)raster->getNumberOfColumns(), 0. }, { 0., (double)raster->getNumberOfRows() } };
+
+    for(int t = 0; t < 3; ++t)
+    {
+      double x = 0.;
+      double y = 0.;
+      double col = 0.;
+      double row = 0.;
+
+      grid->gridToGeo(corners[t][0], corners[t][1], x, y);
+      refGrid->geoToGrid(x, y, col, row);
+
+      if(std::fabs(col - corners[t][0]) > BAND_MATH_GRID_TOLERANCE || std::fabs(row - corners[t][1]) > BAND_MATH_GRID_TOLERANCE)
+        return false;
+    }
+
+    return true;
+  }
+
+  /*! \brief Output pixel of the index value, the 8 bit output is clamped to [0, 255]. */
+  template<class Out> inline Out ToPixel(double value)
+  {
+    return (Out)value;
+  }
+
+  template<> inline unsigned char ToPixel<unsigned char>(double value)
+  {
+    return (unsigned char)std::max(0., std::min(255., value));
+  }
+
+  /*! \brief (nir - other) / (nir + other), the invert is folded into nir = a + b * nir. */
+  template<class In> class NormalizedDifference
+  {
+    public:
+
+      NormalizedDifference(const te::qt::plugins::tv5plugins::IndexDefinition& index, const std::vector<const In*>& bands, int other) :
+        m_nir(bands[index.m_nir]), m_other(bands[other]), m_a(index.m_invert ? 255. : 0.), m_b(index.m_invert ? -1. : 1.)
+      {
+      }
+
+      double operator()(std::size_t i) const
+      {
+        double nir = m_a + m_b * (double)m_nir[i];
+        double other = (double)m_other[i];
+        double den = nir + other;
+
+        return den != 0. ? (nir - other) / den : 0.;
+      }
+
+    protected:
+
+      const In* m_nir;
+      const In* m_other;
+      double m_a;
+      double m_b;
+  };
+
+  /*! \brief (1 + L) * (nir - red) / (nir + red + L), on reflectances. */
+  template<class In> class SAVIFormula
+  {
+    public:
+
+      SAVIFormula(const te::qt::plugins::tv5plugins::IndexDefinition& index, const std::vector<const In*>& bands) :
+        m_nir(bands[index.m_nir]), m_red(bands[index.m_red]), m_a(index.m_invert ? 255. : 0.), m_b(index.m_invert ? -1. : 1.),
+        m_scale(index.m_reflectanceScale), m_L(index.m_L)
+      {
+      }
+
+      double operator()(std::size_t i) const
+      {
+        double nir = (m_a + m_b * (double)m_nir[i]) * m_scale;
+        double red = (double)m_red[i] * m_scale;
+        double den = nir + red + m_L;
+
+        return den != 0. ? (1. + m_L) * (nir - red) / den : 0.;
+      }
+
+    protected:
+
+      const In* m_nir;
+      const In* m_red;
+      double m_a;
+      double m_b;
+      double m_scale;
+      double m_L;
+  };
+
+  /*! \brief G * (nir - red) / (nir + C1 * red - C2 * blue + L), on reflectances. */
+  template<class In> class EVIFormula
+  {
+    public:
+
+      EVIFormula(const te::qt::plugins::tv5plugins::IndexDefinition& index, const std::vector<const In*>& bands) :
+        m_nir(bands[index.m_nir]), m_red(bands[index.m_red]), m_blue(bands[index.m_blue]), m_a(index.m_invert ? 255. : 0.), m_b(index.m_invert ? -1. : 1.),
+        m_scale(index.m_reflectanceScale), m_L(index.m_L), m_C1(index.m_C1), m_C2(index.m_C2), m_G(index.m_G)
+      {
+      }
+
+      double operator()(std::size_t i) const
+      {
+        double nir = (m_a + m_b * (double)m_nir[i]) * m_scale;
+        double red = (double)m_red[i] * m_scale;
+        double blue = (double)m_blue[i] * m_scale;
+        double den = nir + m_C1 * red - m_C2 * blue + m_L;
+
+        return den != 0. ? m_G * (nir - red) / den : 0.;
+      }
+
+    protected:
+
+      const In* m_nir;
+      const In* m_red;
+      const In* m_blue;
+      double m_a;
+      double m_b;
+      double m_scale;
+      double m_L;
+      double m_C1;
+      double m_C2;
+      double m_G;
+  };
+
+  /*! \brief (n0 + sum ni * band i) / (d0 + sum di * band i), only the bands with a coefficient are read. */
+  template<class In> class RatioFormula
+  {
+    public:
+
+      RatioFormula(const te::qt::plugins::tv5plugins::IndexDefinition& index, const std::vector<const In*>& bands) :
+        m_num0(index.m_numerator[0]), m_den0(index.m_denominator[0])
+      {
+        for(std::size_t b = 0; b < bands.size(); ++b)
+        {
+          double num = index.m_numerator[b + 1];
+          double den = index.m_denominator[b + 1];
+
+          if(num == 0. && den == 0.)
+            continue;
+
+          m_bands.push_back(bands[b]);
+          m_num.push_back(num);
+          m_den.push_back(den);
+        }
+      }
+
+      double operator()(std::size_t i) const
+      {
+        double num = m_num0;
+        double den = m_den0;
+
+        for(std::size_t b = 0; b < m_bands.size(); ++b)
+        {
+          double value = (double)m_bands[b][i];
+
+          num += m_num[b] * value;
+          den += m_den[b] * value;
+        }
+
+        return den != 0. ? num / den : 0.;
+      }
+
+    protected:
+
+      double m_num0;
+      double m_den0;
+      std::vector<const In*> m_bands;
+      std::vector<double> m_num;
+      std::vector<double> m_den;
+  };
+
+  template<class Out, class Formula> void ApplyFormula(const Formula& formula, std::size_t size, double gain, double offset, Out* out)
+  {
+    for(std::size_t i = 0; i < size; ++i)
+      out[i] = ToPixel<Out>(gain * formula(i) + offset);
+  }
+
+  /*! \brief Computes the index of size pixels, the formula is chosen once for the whole window. */
+  template<class In, class Out> void ComputeIndex(const te::qt::plugins::tv5plugins::IndexDefinition& index, const std::vector<const In*>& bands,
+                                                  std::size_t size, Out* out)
+  {
+    switch(index.m_formula)
+    {
+      case te::qt::plugins::tv5plugins::INDEX_NDVI:
+        ApplyFormula(NormalizedDifference<In>(index, bands, index.m_red), size, index.m_gain, index.m_offset, out);
+        break;
+      case te::qt::plugins::tv5plugins::INDEX_GNDVI:
+        ApplyFormula(NormalizedDifference<In>(index, bands, index.m_green), size, index.m_gain, index.m_offset, out);
+        break;
+      case te::qt::plugins::tv5plugins::INDEX_SAVI:
+        ApplyFormula(SAVIFormula<In>(index, bands), size, index.m_gain, index.m_offset, out);
+        break;
+      case te::qt::plugins::tv5plugins::INDEX_EVI:
+        ApplyFormula(EVIFormula<In>(index, bands), size, index.m_gain, index.m_offset, out);
+        break;
+      case te::qt::plugins::tv5plugins::INDEX_RATIO:
+        ApplyFormula(RatioFormula<In>(index, bands), size, index.m_gain, index.m_offset, out);
+        break;
+    }
+  }
+
+  /*! \brief Bands read by the index. */
+  std::vector<int> GetIndexBands(const te::qt::plugins::tv5plugins::IndexDefinition& index, std::size_t nBands)
+  {
+    std::vector<int> bands;
+
+    switch(index.m_formula)
+    {
+      case te::qt::plugins::tv5plugins::INDEX_NDVI:
+      case te::qt::plugins::tv5plugins::INDEX_SAVI:
+        bands.push_back(index.m_nir);
+        bands.push_back(index.m_red);
+        break;
+      case te::qt::plugins::tv5plugins::INDEX_GNDVI:
+        bands.push_back(index.m_nir);
+        bands.push_back(index.m_green);
+        break;
+      case te::qt::plugins::tv5plugins::INDEX_EVI:
+        bands.push_back(index.m_nir);
+        bands.push_back(index.m_red);
+        bands.push_back(index.m_blue);
+        break;
+      case te::qt::plugins::tv5plugins::INDEX_RATIO:
+        if(index.m_numerator.size() != nBands + 1 || index.m_denominator.size() != nBands + 1)
+          throw te::common::Exception("Invalid ratio coefficients.");
+
+        for(std::size_t b = 0; b < nBands; ++b)
+        {
+          if(index.m_numerator[b + 1] != 0. || index.m_denominator[b + 1] != 0.)
+            bands.push_back((int)b);
+        }
+        break;
+    }
+
+    for(std::size_t b = 0; b < bands.size(); ++b)
+    {
+      if(bands[b] < 0 || bands[b] >= (int)nBands)
+        throw te::common::Exception("Invalid index band.");
+    }
+
+    return bands;
+  }
+
+  /*! \brief Buffers of a worker thread. */
+  template<class In, class Out> struct IndexBuffers
+  {
+    std::vector<std::vector<In> > m_inputs;   //!< Indexed by the band, empty if the band is not used.
+    std::vector<const In*> m_pointers;
+    std::vector<In> m_blockIn;
+    std::vector<Out> m_out;
+    std::vector<Out> m_blockOut;
+    std::vector<unsigned char> m_raw;
+  };
+
+  /*! \brief Reads the used bands of a window once and computes all indices. */
+  template<class In, class Out> class IndexKernel
+  {
+    public:
+
+      IndexKernel(const std::vector<te::rst::Band*>& bands, const std::vector<bool>& used, const std::vector<te::qt::plugins::tv5plugins::IndexDefinition>& indices,
+                  te::rst::Raster* outRaster, std::size_t windowSize, std::size_t nThreads) :
+        m_bands(bands), m_used(used), m_indices(indices), m_outRaster(outRaster), m_buffers(nThreads)
+      {
+        for(std::size_t t = 0; t < m_buffers.size(); ++t)
+        {
+          IndexBuffers<In, Out>& b = m_buffers[t];
+
+          b.m_inputs.resize(bands.size());
+          b.m_pointers.assign(bands.size(), 0);
+          b.m_out.assign(windowSize, Out());
+
+          for(std::size_t i = 0; i < bands.size(); ++i)
+          {
+            if(!used[i])
+              continue;
+
+            b.m_inputs[i].assign(windowSize, In());
+            b.m_pointers[i] = &b.m_inputs[i][0];
+          }
+        }
+      }
+
+      void process(std::size_t worker, const te::qt::plugins::tv5plugins::RasterBlock& window)
+      {
+        IndexBuffers<In, Out>& b = m_buffers[worker];
+
+        std::size_t windowSize = (std::size_t)window.m_width * window.m_height;
+
+        {
+          boost::mutex::scoped_lock lock(m_ioMutex);
+
+          for(std::size_t i = 0; i < m_bands.size(); ++i)
+          {
+            if(m_used[i])
+              te::qt::plugins::tv5plugins::ReadWindow(m_bands[i], window.m_col, window.m_row, window.m_width, window.m_height,
+                                                      b.m_raw, b.m_blockIn, &b.m_inputs[i][0]);
+          }
+        }
+
+        for(std::size_t k = 0; k < m_indices.size(); ++k)
+        {
+          ComputeIndex(m_indices[k], b.m_pointers, windowSize, &b.m_out[0]);
+
+          boost::mutex::scoped_lock lock(m_ioMutex);
+
+          te::qt::plugins::tv5plugins::WriteWindow(m_outRaster->getBand(k), window.m_col, window.m_row, window.m_width, window.m_height,
+                                                   b.m_raw, b.m_blockOut, &b.m_out[0]);
+        }
+      }
+
+    protected:
+
+      std::vector<te::rst::Band*> m_bands;
+      std::vector<bool> m_used;
+      std::vector<te::qt::plugins::tv5plugins::IndexDefinition> m_indices;
+      te::rst::Raster* m_outRaster;
+      std::vector<IndexBuffers<In, Out> > m_buffers;    //!< Indexed by the worker.
+      boost::mutex m_ioMutex;                           //!< The raster bands are read and written by one worker at a time.
+  };
+
+  template<class In, class Out> void ProcessIndices(const std::vector<te::rst::Band*>& bands, const std::vector<bool>& used,
+                                                    const std::vector<te::qt::plugins::tv5plugins::IndexDefinition>& indices,
+                                                    te::rst::Raster* outRaster, std::size_t nThreads, std::size_t memoryBudget)
+  {
+    std::size_t bytesPerPixel = (std::size_t)std::count(used.begin(), used.end(), true) * sizeof(In) + sizeof(Out);
+
+    std::vector<te::qt::plugins::tv5plugins::RasterBlock> windows = te::qt::plugins::tv5plugins::GetBudgetWindows(outRaster->getBand(0),
+      outRaster->getNumberOfColumns(), outRaster->getNumberOfRows(), memoryBudget, bytesPerPixel, nThreads);
+
+    if(windows.empty())
+      return;
+
+    IndexKernel<In, Out> kernel(bands, used, indices, outRaster, te::qt::plugins::tv5plugins::GetMaxWindowSize(windows), nThreads);
+
+    te::qt::plugins::tv5plugins::ProcessRasterBlocks(windows, boost::bind(&IndexKernel<In, Out>::process, &kernel, _1, _2), nThreads, "Calculating indices.");
+  }
+
+  template<class In> void ProcessIndices(int outType, const std::vector<te::rst::Band*>& bands, const std::vector<bool>& used,
+                                         const std::vector<te::qt::plugins::tv5plugins::IndexDefinition>& indices,
+                                         te::rst::Raster* outRaster, std::size_t nThreads, std::size_t memoryBudget)
+  {
+    switch(outType)
+    {
+      case te::dt::UCHAR_TYPE:
+        ProcessIndices<In, unsigned char>(bands, used, indices, outRaster, nThreads, memoryBudget);
+        break;
+      case te::dt::FLOAT_TYPE:
+        ProcessIndices<In, float>(bands, used, indices, outRaster, nThreads, memoryBudget);
+        break;
+      default:
+        ProcessIndices<In, double>(bands, used, indices, outRaster, nThreads, memoryBudget);
+        break;
+    }
+  }
+}
+
+te::qt::plugins::tv5plugins::IndexDefinition::IndexDefinition(IndexFormula formula) :
+  m_formula(formula), m_nir(0), m_red(1), m_green(1), m_blue(2), m_gain(1.), m_offset(0.), m_invert(false),
+  m_reflectanceScale(1.), m_L(formula == INDEX_EVI ? 1. : 0.5), m_C1(6.), m_C2(7.5), m_G(2.5)
+{
+}
+
+std::auto_ptr<te::rst::Raster> te::qt::plugins::tv5plugins::GenerateIndexRaster(const std::vector<te::rst::Band*>& bands, const std::vector<IndexDefinition>& indices,
+                                                                                int outType, const std::map<std::string, std::string>& rInfo, const std::string& type,
+                                                                                std::size_t nThreads, std::size_t memoryBudget)
+{
+  //check input parameters
+  if(bands.empty() || indices.empty())
+  {
+    throw te::common::Exception("Invalid input parameters.");
+  }
+
+  const te::rst::Raster* refRaster = bands[0]->getRaster();
+
+  //the pixels are combined by position, the bands are not resampled
+  for(std::size_t b = 0; b < bands.size(); ++b)
+  {
+    if(!SameGrid(refRaster, bands[b]->getRaster()))
+    {
+      throw te::common::Exception("Incompatible rasters.");
+    }
+  }
+
+  //bands read by any index, all of them are read with the same pixel type
+  std::vector<bool> used(bands.size(), false);
+
+  for(std::size_t k = 0; k < indices.size(); ++k)
+  {
+    std::vector<int> indexBands = GetIndexBands(indices[k], bands.size());
+
+    for(std::size_t b = 0; b < indexBands.size(); ++b)
+      used[indexBands[b]] = true;
+  }
+
+  int inType = -1;
+
+  for(std::size_t b = 0; b < bands.size(); ++b)
+  {
+    if(!used[b])
+      continue;
+
+    int bandType = bands[b]->getProperty()->m_type;
+
+    if(inType == -1)
+      inType = bandType;
+    else if(inType != bandType)
+      inType = te::dt::DOUBLE_TYPE;
+  }
+
+  if(outType != te::dt::UCHAR_TYPE && outType != te::dt::FLOAT_TYPE)
+    outType = te::dt::DOUBLE_TYPE;
+
+  //create raster out, one band for each index with the block layout of the first band
+  const te::rst::BandProperty* refProp = bands[0]->getProperty();
+
+  std::vector<te::rst::BandProperty*> bandsProperties;
+
+  for(std::size_t k = 0; k < indices.size(); ++k)
+  {
+    te::rst::BandProperty* bandProp = new te::rst::BandProperty(k, outType);
+    bandProp->m_nblocksx = refProp->m_nblocksx;
+    bandProp->m_nblocksy = refProp->m_nblocksy;
+    bandProp->m_blkh = refProp->m_blkh;
+    bandProp->m_blkw = refProp->m_blkw;
+    bandsProperties.push_back(bandProp);
+  }
+
+  te::rst::Grid* grid = new te::rst::Grid(*(refRaster->getGrid()));
+
+  std::auto_ptr<te::rst::Raster> outRaster(te::rst::RasterFactory::make(type, grid, bandsProperties, rInfo));
+
+  switch(inType)
+  {
+    case te::dt::UCHAR_TYPE:
+      ProcessIndices<unsigned char>(outType, bands, used, indices, outRaster.get(), nThreads, memoryBudget);
+      break;
+    case te::dt::UINT16_TYPE:
+      ProcessIndices<boost::uint16_t>(outType, bands, used, indices, outRaster.get(), nThreads, memoryBudget);
+      break;
+    case te::dt::FLOAT_TYPE:
+      ProcessIndices<float>(outType, bands, used, indices, outRaster.get(), nThreads, memoryBudget);
+      break;
+    default:
+      ProcessIndices<double>(outType, bands, used, indices, outRaster.get(), nThreads, memoryBudget);
+      break;
+  }
+
+  return outRaster;
+}
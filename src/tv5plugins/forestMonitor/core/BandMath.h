@@ -0,0 +1,107 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*! \file terralib/qt/plugins/thirdParty/forestMonitor/core/BandMath.h
+
+    \brief This file contains the band math engine used to compute vegetation indices.
+*/
+
+#ifndef __TE_QT_PLUGINS_THIRDPARTY_INTERNAL_BANDMATH_H
+#define __TE_QT_PLUGINS_THIRDPARTY_INTERNAL_BANDMATH_H
+
+// TerraLib
+#include "../../Config.h"
+
+//STL Includes
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace te
+{
+  namespace rst
+  {
+    class Band;
+    class Raster;
+  }
+
+  namespace qt
+  {
+    namespace plugins
+    {
+      namespace tv5plugins
+      {
+        /*! \brief Index formulas of the band math engine. */
+        enum IndexFormula
+        {
+          INDEX_NDVI,     //!< (nir - red) / (nir + red).
+          INDEX_GNDVI,    //!< (nir - green) / (nir + green).
+          INDEX_SAVI,     //!< (1 + L) * (nir - red) / (nir + red + L), on reflectances.
+          INDEX_EVI,      //!< G * (nir - red) / (nir + C1 * red - C2 * blue + L), on reflectances.
+          INDEX_RATIO     //!< (n0 + sum ni * band i) / (d0 + sum di * band i).
+        };
+
+        /*!
+          \brief Definition of an index, the output value is gain * index + offset.
+
+          The band members are positions in the band list given to GenerateIndexRaster,
+          a zero denominator gives an index of 0.
+        */
+        struct IndexDefinition
+        {
+          IndexDefinition(IndexFormula formula = INDEX_NDVI);
+
+          IndexFormula m_formula;
+          int m_nir;                          //!< NIR band, used by all formulas but the ratio.
+          int m_red;                          //!< Red band of NDVI, SAVI and EVI.
+          int m_green;                        //!< Green band of GNDVI.
+          int m_blue;                         //!< Blue band of EVI.
+          double m_gain;
+          double m_offset;
+          bool m_invert;                      //!< The NIR value is inverted (255 - nir).
+          double m_reflectanceScale;          //!< Pixel value to reflectance factor of SAVI and EVI.
+          double m_L;                         //!< Soil adjustment of SAVI and EVI.
+          double m_C1;                        //!< Red coefficient of EVI.
+          double m_C2;                        //!< Blue coefficient of EVI.
+          double m_G;                         //!< Gain factor of EVI.
+          std::vector<double> m_numerator;    //!< Ratio coefficients, the constant and one for each band.
+          std::vector<double> m_denominator;  //!< Ratio coefficients, the constant and one for each band.
+        };
+
+        /*!
+          \brief Computes the indices in one pass, the output raster has one band of outType for each index.
+
+          Each combination of input pixel type (UCHAR, UINT16, FLOAT or DOUBLE when the bands differ),
+          output pixel type (UCHAR, FLOAT or DOUBLE) and formula has its own inner loop. The UCHAR
+          output is clamped to [0, 255]. The input bands are read once for all indices, in windows
+          of the output blocks that fit in memoryBudget bytes (0 uses a default of 256 MB).
+
+          The bands must have the same grid and SRID, they are not resampled.
+        */
+        std::auto_ptr<te::rst::Raster> GenerateIndexRaster(const std::vector<te::rst::Band*>& bands, const std::vector<IndexDefinition>& indices,
+                                                           int outType, const std::map<std::string, std::string>& rInfo, const std::string& type,
+                                                           std::size_t nThreads = 0, std::size_t memoryBudget = 0);
+
+      } // end namespace thirdParty
+    }   // end namespace plugins
+  }     // end namespace qt
+}       // end namespace te
+
+#endif //__TE_QT_PLUGINS_THIRDPARTY_INTERNAL_BANDMATH_H
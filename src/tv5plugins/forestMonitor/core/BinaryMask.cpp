@@ -0,0 +1,237 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*! \file terralib/qt/plugins/thirdParty/forestMonitor/core/BinaryMask.cpp
+
+    \brief This file contains a binary mask with one bit for each pixel.
+*/
+
+//TerraLib Includes
+#include "BinaryMask.h"
+
+//STL Includes
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace
+{
+  typedef te::qt::plugins::tv5plugins::BinaryMask::Word Word;
+
+  const unsigned int WORD_BITS = te::qt::plugins::tv5plugins::BinaryMask::WORD_BITS;
+
+  /*! \brief Mask of the first n bits of a word (n < 64). */
+  Word FirstBits(unsigned int n)
+  {
+    return (((Word)1) << n) - 1;
+  }
+
+  unsigned int CountBits(Word w)
+  {
+    unsigned int n = 0;
+
+    while(w)
+    {
+      w &= w - 1;
+      ++n;
+    }
+
+    return n;
+  }
+
+  /*! \brief Packs value <= threshold of n values (n <= 64) into a word. */
+  template<class T, class C> Word PackWord(const T* values, unsigned int n, C threshold)
+  {
+    Word word = 0;
+
+    for(unsigned int b = 0; b < n; ++b)
+      word |= ((Word)((C)values[b] <= threshold)) << b;
+
+    return word;
+  }
+
+  template<class T, class C> void PackThreshold(const T* values, std::size_t count, C threshold, Word* bits)
+  {
+    std::size_t nWords = count / WORD_BITS;
+
+    for(std::size_t w = 0; w < nWords; ++w)
+      bits[w] = PackWord(values + w * WORD_BITS, WORD_BITS, threshold);
+
+    unsigned int rest = (unsigned int)(count % WORD_BITS);
+
+    if(rest)
+      bits[nWords] = PackWord(values + nWords * WORD_BITS, rest, threshold);
+  }
+}
+
+const unsigned int te::qt::plugins::tv5plugins::BinaryMask::WORD_BITS;
+
+te::qt::plugins::tv5plugins::BinaryMask::BinaryMask() :
+  m_width(0),
+  m_height(0),
+  m_stride(0)
+{
+}
+
+te::qt::plugins::tv5plugins::BinaryMask::BinaryMask(unsigned int width, unsigned int height) :
+  m_width(0),
+  m_height(0),
+  m_stride(0)
+{
+  reset(width, height);
+}
+
+te::qt::plugins::tv5plugins::BinaryMask::~BinaryMask()
+{
+}
+
+void te::qt::plugins::tv5plugins::BinaryMask::reset(unsigned int width, unsigned int height)
+{
+  m_width = width;
+  m_height = height;
+  m_stride = ((std::size_t)width + WORD_BITS - 1) / WORD_BITS;
+
+  m_words.assign(m_stride * height, 0);
+}
+
+unsigned int te::qt::plugins::tv5plugins::BinaryMask::getWidth() const
+{
+  return m_width;
+}
+
+unsigned int te::qt::plugins::tv5plugins::BinaryMask::getHeight() const
+{
+  return m_height;
+}
+
+std::size_t te::qt::plugins::tv5plugins::BinaryMask::getStride() const
+{
+  return m_stride;
+}
+
+te::qt::plugins::tv5plugins::BinaryMask::Word* te::qt::plugins::tv5plugins::BinaryMask::getRow(unsigned int row)
+{
+  assert(row < m_height);
+
+  return &m_words[(std::size_t)row * m_stride];
+}
+
+const te::qt::plugins::tv5plugins::BinaryMask::Word* te::qt::plugins::tv5plugins::BinaryMask::getRow(unsigned int row) const
+{
+  assert(row < m_height);
+
+  return &m_words[(std::size_t)row * m_stride];
+}
+
+bool te::qt::plugins::tv5plugins::BinaryMask::get(unsigned int col, unsigned int row) const
+{
+  assert(col < m_width && row < m_height);
+
+  return ((m_words[(std::size_t)row * m_stride + col / WORD_BITS] >> (col % WORD_BITS)) & 1) != 0;
+}
+
+void te::qt::plugins::tv5plugins::BinaryMask::set(unsigned int col, unsigned int row, bool value)
+{
+  assert(col < m_width && row < m_height);
+
+  Word& w = m_words[(std::size_t)row * m_stride + col / WORD_BITS];
+
+  Word bit = ((Word)1) << (col % WORD_BITS);
+
+  if(value)
+    w |= bit;
+  else
+    w &= ~bit;
+}
+
+void te::qt::plugins::tv5plugins::BinaryMask::fill(bool value)
+{
+  std::fill(m_words.begin(), m_words.end(), value ? ~((Word)0) : (Word)0);
+
+  if(value)
+    clearPadding();
+}
+
+void te::qt::plugins::tv5plugins::BinaryMask::invert()
+{
+  for(std::size_t t = 0; t < m_words.size(); ++t)
+    m_words[t] = ~m_words[t];
+
+  clearPadding();
+}
+
+std::size_t te::qt::plugins::tv5plugins::BinaryMask::count() const
+{
+  std::size_t n = 0;
+
+  for(std::size_t t = 0; t < m_words.size(); ++t)
+    n += CountBits(m_words[t]);
+
+  return n;
+}
+
+void te::qt::plugins::tv5plugins::BinaryMask::getRowValues(unsigned int row, unsigned char* values, unsigned char foreground) const
+{
+  const Word* bits = getRow(row);
+
+  for(unsigned int c = 0; c < m_width; ++c)
+    values[c] = ((bits[c / WORD_BITS] >> (c % WORD_BITS)) & 1) ? foreground : 0;
+}
+
+void te::qt::plugins::tv5plugins::BinaryMask::setRowValues(unsigned int row, const unsigned char* values)
+{
+  Word* bits = getRow(row);
+
+  for(std::size_t w = 0; w < m_stride; ++w)
+  {
+    unsigned int first = (unsigned int)(w * WORD_BITS);
+    unsigned int n = std::min(WORD_BITS, m_width - first);
+
+    Word word = 0;
+
+    for(unsigned int b = 0; b < n; ++b)
+      word |= ((Word)(values[first + b] != 0)) << b;
+
+    bits[w] = word;
+  }
+}
+
+void te::qt::plugins::tv5plugins::BinaryMask::clearPadding()
+{
+  unsigned int rest = m_width % WORD_BITS;
+
+  if(rest == 0 || m_stride == 0)
+    return;
+
+  for(unsigned int r = 0; r < m_height; ++r)
+    m_words[(std::size_t)r * m_stride + m_stride - 1] &= FirstBits(rest);
+}
+
+void te::qt::plugins::tv5plugins::ThresholdBits(const double* values, std::size_t count, double threshold, BinaryMask::Word* bits)
+{
+  PackThreshold(values, count, threshold, bits);
+}
+
+void te::qt::plugins::tv5plugins::ThresholdBits(const unsigned char* values, std::size_t count, double threshold, BinaryMask::Word* bits)
+{
+  //the integer comparison gives the same result as the double one
+  int intThreshold = (int)std::max(-1., std::min(255., std::floor(threshold)));
+
+  PackThreshold(values, count, intThreshold, bits);
+}
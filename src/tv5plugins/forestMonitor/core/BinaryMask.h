@@ -0,0 +1,131 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*! \file terralib/qt/plugins/thirdParty/forestMonitor/core/BinaryMask.h
+
+    \brief This file contains a binary mask with one bit for each pixel.
+*/
+
+#ifndef __TE_QT_PLUGINS_THIRDPARTY_INTERNAL_BINARYMASK_H
+#define __TE_QT_PLUGINS_THIRDPARTY_INTERNAL_BINARYMASK_H
+
+// TerraLib
+#include "../../Config.h"
+
+//STL Includes
+#include <vector>
+
+// Boost
+#include <boost/cstdint.hpp>
+
+namespace te
+{
+  namespace qt
+  {
+    namespace plugins
+    {
+      namespace tv5plugins
+      {
+        /*!
+          \class BinaryMask
+
+          \brief Binary image packed in 64 bit words, 1 is foreground (tree) and 0 background.
+
+          Each row starts in a new word, pixel c of a row is the bit (c % 64) of the word c / 64.
+          The bits after the last column of a row are always 0, so whole words can be combined
+          and counted.
+        */
+        class BinaryMask
+        {
+          public:
+
+            typedef boost::uint64_t Word;
+
+            /*! \brief Number of pixels of a word. */
+            static const unsigned int WORD_BITS = 64;
+
+            BinaryMask();
+
+            /*! \brief Creates a mask of width x height background pixels. */
+            BinaryMask(unsigned int width, unsigned int height);
+
+            ~BinaryMask();
+
+            /*! \brief Resizes the mask, all pixels are background. */
+            void reset(unsigned int width, unsigned int height);
+
+            unsigned int getWidth() const;
+
+            unsigned int getHeight() const;
+
+            /*! \brief Number of words of each row. */
+            std::size_t getStride() const;
+
+            Word* getRow(unsigned int row);
+
+            const Word* getRow(unsigned int row) const;
+
+            bool get(unsigned int col, unsigned int row) const;
+
+            void set(unsigned int col, unsigned int row, bool value);
+
+            /*! \brief Sets all pixels. */
+            void fill(bool value);
+
+            /*! \brief Swaps foreground and background. */
+            void invert();
+
+            /*! \brief Number of foreground pixels. */
+            std::size_t count() const;
+
+            /*! \brief Unpacks a row, the foreground pixels take the value foreground and the background ones 0. */
+            void getRowValues(unsigned int row, unsigned char* values, unsigned char foreground = 255) const;
+
+            /*! \brief Packs a row, the non zero values are foreground. */
+            void setRowValues(unsigned int row, const unsigned char* values);
+
+            /*! \brief Clears the bits after the last column of each row. */
+            void clearPadding();
+
+          protected:
+
+            unsigned int m_width;
+            unsigned int m_height;
+            std::size_t m_stride;
+            std::vector<Word> m_words;
+        };
+
+        /*!
+          \brief Packs the threshold of count values, value <= threshold is foreground.
+
+          The values start at bit 0 of bits[0]. The words are written as a whole, so the bits of
+          the last word after count are cleared. The comparisons have no branches, the compiler
+          may vectorize them.
+        */
+        void ThresholdBits(const double* values, std::size_t count, double threshold, BinaryMask::Word* bits);
+
+        /*! \brief Packs the threshold of 8 bit values, see ThresholdBits. */
+        void ThresholdBits(const unsigned char* values, std::size_t count, double threshold, BinaryMask::Word* bits);
+
+      } // end namespace thirdParty
+    }   // end namespace plugins
+  }     // end namespace qt
+}       // end namespace te
+
+#endif //__TE_QT_PLUGINS_THIRDPARTY_INTERNAL_BINARYMASK_H
@@ -0,0 +1,261 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*! \file terralib/qt/plugins/thirdParty/forestMonitor/core/BinaryMorphology.cpp
+
+    \brief This file contains the morphology operations of the binary masks.
+*/
+
+//TerraLib Includes
+#include "BinaryMorphology.h"
+
+//STL Includes
+#include <algorithm>
+
+namespace
+{
+  typedef te::qt::plugins::tv5plugins::BinaryMask::Word Word;
+
+  const unsigned int WORD_BITS = te::qt::plugins::tv5plugins::BinaryMask::WORD_BITS;
+
+  /*! \brief Moves the row bits shift columns to the right, out[c] = in[c - shift]. */
+  void ShiftRight(const Word* in, Word* out, std::size_t stride, std::size_t shift)
+  {
+    std::size_t q = shift / WORD_BITS;
+    unsigned int b = (unsigned int)(shift % WORD_BITS);
+
+    for(std::size_t w = 0; w < stride; ++w)
+    {
+      Word v = 0;
+
+      if(w >= q)
+      {
+        v = in[w - q] << b;
+
+        if(b && w > q)
+          v |= in[w - q - 1] >> (WORD_BITS - b);
+      }
+
+      out[w] = v;
+    }
+  }
+
+  /*! \brief Moves the row bits shift columns to the left, out[c] = in[c + shift]. */
+  void ShiftLeft(const Word* in, Word* out, std::size_t stride, std::size_t shift)
+  {
+    std::size_t q = shift / WORD_BITS;
+    unsigned int b = (unsigned int)(shift % WORD_BITS);
+
+    for(std::size_t w = 0; w < stride; ++w)
+    {
+      Word v = 0;
+
+      if(w + q < stride)
+      {
+        v = in[w + q] >> b;
+
+        if(b && w + q + 1 < stride)
+          v |= in[w + q + 1] << (WORD_BITS - b);
+      }
+
+      out[w] = v;
+    }
+  }
+
+  /*!
+    \brief Each bit of the row becomes the OR of the length bits ending (toRight) or starting at it.
+
+    The run is doubled at each step, so it takes log(length) shifts.
+  */
+  void OrRuns(std::vector<Word>& row, std::vector<Word>& shifted, std::size_t length, bool toRight)
+  {
+    std::size_t stride = row.size();
+
+    std::size_t run = 1;
+
+    while(run < length)
+    {
+      //the last step only adds what is missing
+      std::size_t shift = std::min(run, length - run);
+
+      if(toRight)
+        ShiftRight(&row[0], &shifted[0], stride, shift);
+      else
+        ShiftLeft(&row[0], &shifted[0], stride, shift);
+
+      for(std::size_t w = 0; w < stride; ++w)
+        row[w] |= shifted[w];
+
+      run += shift;
+    }
+  }
+}
+
+te::qt::plugins::tv5plugins::BinaryMorphology::BinaryMorphology()
+{
+}
+
+te::qt::plugins::tv5plugins::BinaryMorphology::~BinaryMorphology()
+{
+}
+
+void te::qt::plugins::tv5plugins::BinaryMorphology::dilate(BinaryMask& mask, int radius)
+{
+  if(radius <= 0 || mask.getWidth() == 0 || mask.getHeight() == 0)
+    return;
+
+  //a larger square gives the same result
+  unsigned int r = (unsigned int)std::min<std::size_t>((std::size_t)radius, std::max(mask.getWidth(), mask.getHeight()));
+
+  dilateRows(mask, r);
+
+  dilateColumns(mask, r);
+}
+
+void te::qt::plugins::tv5plugins::BinaryMorphology::erode(BinaryMask& mask, int radius)
+{
+  if(radius <= 0)
+    return;
+
+  //the pixels out of the mask are background of the inverted mask, so they do not erode
+  mask.invert();
+
+  dilate(mask, radius);
+
+  mask.invert();
+}
+
+void te::qt::plugins::tv5plugins::BinaryMorphology::open(BinaryMask& mask, int radius)
+{
+  erode(mask, radius);
+
+  dilate(mask, radius);
+}
+
+void te::qt::plugins::tv5plugins::BinaryMorphology::close(BinaryMask& mask, int radius)
+{
+  dilate(mask, radius);
+
+  erode(mask, radius);
+}
+
+void te::qt::plugins::tv5plugins::BinaryMorphology::dilateRows(BinaryMask& mask, unsigned int radius)
+{
+  std::size_t stride = mask.getStride();
+
+  m_left.resize(stride);
+  m_right.resize(stride);
+  m_shift.resize(stride);
+
+  for(unsigned int r = 0; r < mask.getHeight(); ++r)
+  {
+    BinaryMask::Word* row = mask.getRow(r);
+
+    std::copy(row, row + stride, m_left.begin());
+    std::copy(row, row + stride, m_right.begin());
+
+    //columns c - radius to c and c to c + radius
+    OrRuns(m_left, m_shift, (std::size_t)radius + 1, true);
+    OrRuns(m_right, m_shift, (std::size_t)radius + 1, false);
+
+    for(std::size_t w = 0; w < stride; ++w)
+      row[w] = m_left[w] | m_right[w];
+  }
+
+  mask.clearPadding();
+}
+
+void te::qt::plugins::tv5plugins::BinaryMorphology::dilateColumns(BinaryMask& mask, unsigned int radius)
+{
+  std::size_t stride = mask.getStride();
+  std::size_t height = mask.getHeight();
+  std::size_t block = 2 * (std::size_t)radius + 1;
+
+  m_prefix.reset(mask.getWidth(), mask.getHeight());
+  m_suffix.reset(mask.getWidth(), mask.getHeight());
+
+  //OR from the first row of the block to each row
+  for(std::size_t r = 0; r < height; ++r)
+  {
+    const BinaryMask::Word* in = mask.getRow((unsigned int)r);
+    BinaryMask::Word* prefix = m_prefix.getRow((unsigned int)r);
+
+    if(r % block == 0)
+    {
+      std::copy(in, in + stride, prefix);
+    }
+    else
+    {
+      const BinaryMask::Word* previous = m_prefix.getRow((unsigned int)r - 1);
+
+      for(std::size_t w = 0; w < stride; ++w)
+        prefix[w] = in[w] | previous[w];
+    }
+  }
+
+  //OR from each row to the last row of the block
+  for(std::size_t r = height; r-- > 0;)
+  {
+    const BinaryMask::Word* in = mask.getRow((unsigned int)r);
+    BinaryMask::Word* suffix = m_suffix.getRow((unsigned int)r);
+
+    if(r % block == block - 1 || r + 1 == height)
+    {
+      std::copy(in, in + stride, suffix);
+    }
+    else
+    {
+      const BinaryMask::Word* next = m_suffix.getRow((unsigned int)r + 1);
+
+      for(std::size_t w = 0; w < stride; ++w)
+        suffix[w] = in[w] | next[w];
+    }
+  }
+
+  //the rows r - radius to r + radius span at most two blocks
+  for(std::size_t r = 0; r < height; ++r)
+  {
+    BinaryMask::Word* out = mask.getRow((unsigned int)r);
+
+    std::size_t last = std::min(r + radius, height - 1);
+
+    const BinaryMask::Word* prefix = m_prefix.getRow((unsigned int)last);
+
+    if(r < radius)
+    {
+      std::copy(prefix, prefix + stride, out);
+
+      continue;
+    }
+
+    std::size_t first = r - radius;
+
+    const BinaryMask::Word* suffix = m_suffix.getRow((unsigned int)first);
+
+    if(first / block == last / block)
+    {
+      std::copy(suffix, suffix + stride, out);
+    }
+    else
+    {
+      for(std::size_t w = 0; w < stride; ++w)
+        out[w] = suffix[w] | prefix[w];
+    }
+  }
+}
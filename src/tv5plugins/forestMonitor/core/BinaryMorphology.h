@@ -0,0 +1,99 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*! \file terralib/qt/plugins/thirdParty/forestMonitor/core/BinaryMorphology.h
+
+    \brief This file contains the morphology operations of the binary masks.
+*/
+
+#ifndef __TE_QT_PLUGINS_THIRDPARTY_INTERNAL_BINARYMORPHOLOGY_H
+#define __TE_QT_PLUGINS_THIRDPARTY_INTERNAL_BINARYMORPHOLOGY_H
+
+// TerraLib
+#include "../../Config.h"
+#include "BinaryMask.h"
+
+//STL Includes
+#include <vector>
+
+namespace te
+{
+  namespace qt
+  {
+    namespace plugins
+    {
+      namespace tv5plugins
+      {
+        /*!
+          \class BinaryMorphology
+
+          \brief Dilation, erosion, opening and closing of a BinaryMask by a square.
+
+          An operation of radius n gives the same mask as n iterations of the 3x3 operation,
+          with the square clipped at the mask borders (the pixels out of the mask neither
+          dilate nor erode). The square is split in a row and a column pass: the rows are
+          dilated 64 pixels at a time by doubling word shifts (log n steps) and the columns
+          by the van Herk/Gil-Werman algorithm over whole words (3 operations per word for
+          any n). The erosion is the dilation of the background.
+
+          The buffers are kept between calls, an object must not be shared by threads.
+        */
+        class BinaryMorphology
+        {
+          public:
+
+            BinaryMorphology();
+
+            ~BinaryMorphology();
+
+            /*! \brief Dilation by a (2 * radius + 1) square, nothing is done if radius <= 0. */
+            void dilate(BinaryMask& mask, int radius);
+
+            /*! \brief Erosion by a (2 * radius + 1) square, nothing is done if radius <= 0. */
+            void erode(BinaryMask& mask, int radius);
+
+            /*! \brief Erosion followed by dilation, removes the foreground smaller than the square. */
+            void open(BinaryMask& mask, int radius);
+
+            /*! \brief Dilation followed by erosion, fills the background smaller than the square. */
+            void close(BinaryMask& mask, int radius);
+
+          protected:
+
+            /*! \brief Each pixel becomes the OR of the pixels up to radius columns to the left and to the right. */
+            void dilateRows(BinaryMask& mask, unsigned int radius);
+
+            /*! \brief Each pixel becomes the OR of the pixels up to radius rows above and below. */
+            void dilateColumns(BinaryMask& mask, unsigned int radius);
+
+          protected:
+
+            std::vector<BinaryMask::Word> m_left;       //!< OR of the row runs ending at each pixel.
+            std::vector<BinaryMask::Word> m_right;      //!< OR of the row runs starting at each pixel.
+            std::vector<BinaryMask::Word> m_shift;
+            BinaryMask m_prefix;                        //!< Column OR from the start of each block of rows.
+            BinaryMask m_suffix;                        //!< Column OR to the end of each block of rows.
+        };
+
+      } // end namespace thirdParty
+    }   // end namespace plugins
+  }     // end namespace qt
+}       // end namespace te
+
+#endif //__TE_QT_PLUGINS_THIRDPARTY_INTERNAL_BINARYMORPHOLOGY_H
@@ -0,0 +1,86 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*! \file terralib/qt/plugins/thirdParty/forestMonitor/core/CentroidStore.cpp
+
+    \brief This file contains a compact store for tree centroids.
+*/
+
+//TerraLib Includes
+#include <terralib/geometry/MultiPoint.h>
+#include <terralib/geometry/Point.h>
+#include "CentroidStore.h"
+
+te::qt::plugins::tv5plugins::CentroidStore::CentroidStore()
+{
+}
+
+te::qt::plugins::tv5plugins::CentroidStore::~CentroidStore()
+{
+}
+
+void te::qt::plugins::tv5plugins::CentroidStore::clear()
+{
+  m_ids.clear();
+  m_x.clear();
+  m_y.clear();
+}
+
+void te::qt::plugins::tv5plugins::CentroidStore::reserve(std::size_t size)
+{
+  m_ids.reserve(size);
+  m_x.reserve(size);
+  m_y.reserve(size);
+}
+
+std::size_t te::qt::plugins::tv5plugins::CentroidStore::add(int id, double x, double y)
+{
+  m_ids.push_back(id);
+  m_x.push_back(x);
+  m_y.push_back(y);
+
+  return m_ids.size() - 1;
+}
+
+bool te::qt::plugins::tv5plugins::CentroidStore::add(int id, te::gm::Geometry* geom, std::size_t& idx)
+{
+  if(!geom)
+    return false;
+
+  te::gm::Point* point = 0;
+
+  if(geom->getGeomTypeId() == te::gm::MultiPointType)
+  {
+    te::gm::MultiPoint* mPoint = dynamic_cast<te::gm::MultiPoint*>(geom);
+
+    if(mPoint->getNumGeometries() != 0)
+      point = dynamic_cast<te::gm::Point*>(mPoint->getGeometryN(0));
+  }
+  else if(geom->getGeomTypeId() == te::gm::PointType)
+  {
+    point = dynamic_cast<te::gm::Point*>(geom);
+  }
+
+  if(!point)
+    return false;
+
+  idx = add(id, point->getX(), point->getY());
+
+  return true;
+}
@@ -0,0 +1,96 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*! \file terralib/qt/plugins/thirdParty/forestMonitor/core/CentroidStore.h
+
+    \brief This file contains a compact store for tree centroids.
+*/
+
+#ifndef __TE_QT_PLUGINS_THIRDPARTY_INTERNAL_CENTROIDSTORE_H
+#define __TE_QT_PLUGINS_THIRDPARTY_INTERNAL_CENTROIDSTORE_H
+
+// TerraLib
+#include "../../Config.h"
+
+//STL Includes
+#include <vector>
+
+namespace te
+{
+  namespace gm { class Geometry; }
+
+  namespace qt
+  {
+    namespace plugins
+    {
+      namespace tv5plugins
+      {
+        /*!
+          \class CentroidStore
+
+          \brief Structure of arrays with the id and coordinates of each centroid.
+
+          Centroids are addressed by a dense index (the insertion order), the original
+          centroid id is kept only to be reported in the output.
+        */
+        class CentroidStore
+        {
+          public:
+
+            CentroidStore();
+
+            ~CentroidStore();
+
+          public:
+
+            void clear();
+
+            void reserve(std::size_t size);
+
+            /*! \brief Adds a centroid and returns its dense index. */
+            std::size_t add(int id, double x, double y);
+
+            /*!
+              \brief Adds the first point of a point or multi point geometry.
+
+              \return True if the geometry has a point, false otherwise.
+            */
+            bool add(int id, te::gm::Geometry* geom, std::size_t& idx);
+
+            std::size_t size() const { return m_ids.size(); }
+
+            int getId(std::size_t idx) const { return m_ids[idx]; }
+
+            double getX(std::size_t idx) const { return m_x[idx]; }
+
+            double getY(std::size_t idx) const { return m_y[idx]; }
+
+          protected:
+
+            std::vector<int> m_ids;     //!< Original centroid ids.
+            std::vector<double> m_x;    //!< Centroid x coordinates.
+            std::vector<double> m_y;    //!< Centroid y coordinates.
+        };
+
+      } // end namespace thirdParty
+    }   // end namespace plugins
+  }     // end namespace qt
+}       // end namespace te
+
+#endif //__TE_QT_PLUGINS_THIRDPARTY_INTERNAL_CENTROIDSTORE_H
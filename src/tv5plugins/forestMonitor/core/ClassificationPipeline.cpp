@@ -0,0 +1,513 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*! \file terralib/qt/plugins/thirdParty/forestMonitor/core/ClassificationPipeline.cpp
+
+    \brief This file contains the tile pipeline used to detect the trees of a parcel.
+*/
+
+//TerraLib Includes
+#include <terralib/common/Exception.h>
+#include <terralib/geometry/Envelope.h>
+#include <terralib/geometry/Geometry.h>
+#include <terralib/geometry/Point.h>
+#include <terralib/raster/Band.h>
+#include <terralib/raster/BandProperty.h>
+#include <terralib/raster/Grid.h>
+#include <terralib/raster/Raster.h>
+#include <terralib/raster/RasterFactory.h>
+#include "ClassificationPipeline.h"
+#include "PreparedPolygon.h"
+#include "RasterBlock.h"
+
+//STL Includes
+#include <algorithm>
+#include <cmath>
+
+//tile size, without the halo, used by default
+#define DEFAULT_TILE_SIZE 512
+
+namespace
+{
+  typedef te::qt::plugins::tv5plugins::BinaryMask BinaryMask;
+  typedef BinaryMask::Word Word;
+
+  /*! \brief Sets the bits first to last - 1. */
+  void SetBits(Word* bits, unsigned int first, unsigned int last)
+  {
+    while(first < last)
+    {
+      unsigned int b = first % BinaryMask::WORD_BITS;
+      unsigned int n = std::min(BinaryMask::WORD_BITS - b, last - first);
+
+      Word word = n == BinaryMask::WORD_BITS ? ~((Word)0) : ((((Word)1) << n) - 1) << b;
+
+      bits[first / BinaryMask::WORD_BITS] |= word;
+
+      first += n;
+    }
+  }
+}
+
+te::qt::plugins::tv5plugins::ClassificationPipeline::ClassificationPipeline(double threshold, int dilation, int erosion) :
+  m_threshold(threshold),
+  m_dilation(std::max(0, dilation)),
+  m_erosion(std::max(0, erosion)),
+  m_tileSize(DEFAULT_TILE_SIZE),
+  m_rasterNDVI(0),
+  m_bandNDVI(0),
+  m_ioMutex(0),
+  m_debugNDVI(0),
+  m_debugThreshold(0),
+  m_debugDilation(0),
+  m_debugErosion(0)
+{
+}
+
+te::qt::plugins::tv5plugins::ClassificationPipeline::~ClassificationPipeline()
+{
+}
+
+void te::qt::plugins::tv5plugins::ClassificationPipeline::setInputNDVI(te::rst::Raster* rasterNDVI, int bandNDVI)
+{
+  if(!rasterNDVI)
+    throw te::common::Exception("Invalid input rasters.");
+
+  m_rasterNDVI = rasterNDVI;
+  m_bandNDVI = bandNDVI;
+}
+
+void te::qt::plugins::tv5plugins::ClassificationPipeline::setTileSize(unsigned int tileSize)
+{
+  m_tileSize = std::max(1u, tileSize);
+}
+
+void te::qt::plugins::tv5plugins::ClassificationPipeline::setIOMutex(boost::mutex* ioMutex)
+{
+  m_ioMutex = ioMutex;
+}
+
+std::auto_ptr<te::rst::Raster> te::qt::plugins::tv5plugins::ClassificationPipeline::createMaskRaster(const te::gm::Geometry* parcel, const std::map<std::string, std::string>& rInfo,
+                                                                                                     const std::string& type) const
+{
+  return createWindowRaster(parcel, te::dt::UCHAR_TYPE, rInfo, type);
+}
+
+void te::qt::plugins::tv5plugins::ClassificationPipeline::setDebugRasters(te::rst::Raster* ndvi, te::rst::Raster* threshold, te::rst::Raster* dilation, te::rst::Raster* erosion)
+{
+  m_debugNDVI = ndvi;
+  m_debugThreshold = threshold;
+  m_debugDilation = dilation;
+  m_debugErosion = erosion;
+}
+
+std::auto_ptr<te::rst::Raster> te::qt::plugins::tv5plugins::ClassificationPipeline::createWindowRaster(const te::gm::Geometry* parcel, int dataType,
+                                                                                                       const std::map<std::string, std::string>& rInfo,
+                                                                                                       const std::string& type) const
+{
+  std::auto_ptr<te::rst::Raster> mask;
+
+  Window window;
+
+  if(!getWindow(parcel, window))
+    return mask;
+
+  const te::rst::Grid* grid = getInputRaster()->getGrid();
+
+  double resX = grid->getResolutionX();
+  double resY = grid->getResolutionY();
+
+  //extent of the window pixels
+  te::gm::Coord2D ul = grid->gridToGeo(window.m_col, window.m_row);
+  te::gm::Coord2D lr = grid->gridToGeo(window.m_col + window.m_width - 1, window.m_row + window.m_height - 1);
+
+  te::gm::Envelope* env = new te::gm::Envelope(ul.getX() - resX / 2., lr.getY() - resY / 2., lr.getX() + resX / 2., ul.getY() + resY / 2.);
+
+  te::rst::Grid* maskGrid = new te::rst::Grid(window.m_width, window.m_height, env, grid->getSRID());
+
+  std::vector<te::rst::BandProperty*> bandsProperties;
+  te::rst::BandProperty* bandProp = new te::rst::BandProperty(0, dataType);
+  bandProp->m_nblocksx = 1;
+  bandProp->m_nblocksy = window.m_height;
+  bandProp->m_blkw = window.m_width;
+  bandProp->m_blkh = 1;
+  bandsProperties.push_back(bandProp);
+
+  mask.reset(te::rst::RasterFactory::make(type, maskGrid, bandsProperties, rInfo));
+
+  return mask;
+}
+
+void te::qt::plugins::tv5plugins::ClassificationPipeline::classify(const te::gm::Geometry* parcel, int parcelId, std::vector<CentroidInfo*>& centroids, te::rst::Raster* mask)
+{
+  te::rst::Raster* raster = getInputRaster();
+
+  if(!raster)
+    throw te::common::Exception("Input raster not defined.");
+
+  Window window;
+
+  if(!getWindow(parcel, window))
+  {
+    setDebugRasters(0, 0, 0, 0);
+    return;
+  }
+
+  std::auto_ptr<PreparedPolygon> poly;
+
+  if(parcel)
+    poly.reset(new PreparedPolygon(parcel));
+
+  //the morphology of a core pixel depends on the pixels up to this distance
+  unsigned int halo = (unsigned int)(m_dilation + m_erosion);
+
+  m_parent.clear();
+  m_stats.clear();
+  m_topLabels.assign(window.m_width, -1);
+
+  for(unsigned int ty = 0; ty < window.m_height; ty += m_tileSize)
+  {
+    unsigned int coreHeight = std::min(m_tileSize, window.m_height - ty);
+    unsigned int y0 = ty > halo ? ty - halo : 0;
+    unsigned int y1 = std::min(window.m_height, ty + coreHeight + halo);
+
+    m_leftLabels.assign(coreHeight, -1);
+
+    for(unsigned int tx = 0; tx < window.m_width; tx += m_tileSize)
+    {
+      unsigned int coreWidth = std::min(m_tileSize, window.m_width - tx);
+      unsigned int x0 = tx > halo ? tx - halo : 0;
+      unsigned int x1 = std::min(window.m_width, tx + coreWidth + halo);
+
+      unsigned int regionWidth = x1 - x0;
+      unsigned int regionHeight = y1 - y0;
+
+      readNDVI(window.m_col + x0, window.m_row + y0, regionWidth, regionHeight);
+
+      if(m_debugNDVI)
+      {
+        for(unsigned int r = 0; r < coreHeight; ++r)
+        {
+          const double* ndviRow = &m_ndvi[(std::size_t)(ty - y0 + r) * regionWidth + (tx - x0)];
+
+          for(unsigned int c = 0; c < coreWidth; ++c)
+            m_debugNDVI->setValue(tx + c, ty + r, ndviRow[c]);
+        }
+      }
+
+      threshold(window.m_col + x0, window.m_row + y0, regionWidth, regionHeight, poly.get());
+
+      writeMask(m_debugThreshold, tx, ty, coreWidth, coreHeight, tx - x0, ty - y0, regionWidth);
+
+      //dilation followed by erosion, as the filter rasters of the classification dialog
+      m_morphology.dilate(m_mask, m_dilation);
+
+      writeMask(m_debugDilation, tx, ty, coreWidth, coreHeight, tx - x0, ty - y0, regionWidth);
+
+      m_morphology.erode(m_mask, m_erosion);
+
+      writeMask(m_debugErosion, tx, ty, coreWidth, coreHeight, tx - x0, ty - y0, regionWidth);
+
+      label(window, tx, ty, coreWidth, coreHeight, tx - x0, ty - y0, regionWidth);
+
+      writeMask(mask, tx, ty, coreWidth, coreHeight, tx - x0, ty - y0, regionWidth);
+    }
+  }
+
+  setDebugRasters(0, 0, 0, 0);
+
+  //merge the labels of each blob into its root
+  for(std::size_t l = 0; l < m_parent.size(); ++l)
+  {
+    int root = findLabel((int)l);
+
+    if(root != (int)l)
+    {
+      m_stats[root].m_count += m_stats[l].m_count;
+      m_stats[root].m_sumCol += m_stats[l].m_sumCol;
+      m_stats[root].m_sumRow += m_stats[l].m_sumRow;
+    }
+  }
+
+  //the centroid of a blob is the mean of its pixel centers
+  const te::rst::Grid* grid = raster->getGrid();
+
+  double pixelArea = grid->getResolutionX() * grid->getResolutionY();
+
+  for(std::size_t l = 0; l < m_parent.size(); ++l)
+  {
+    if(m_parent[l] != (int)l)
+      continue;
+
+    const BlobStats& s = m_stats[l];
+
+    double x = 0.;
+    double y = 0.;
+
+    grid->gridToGeo(s.m_sumCol / (double)s.m_count, s.m_sumRow / (double)s.m_count, x, y);
+
+    CentroidInfo* ci = new CentroidInfo();
+    ci->m_point = new te::gm::Point(x, y, grid->getSRID());
+    ci->m_area = (double)s.m_count * pixelArea;
+    ci->m_parentId = parcelId;
+    ci->type = FOREST_UNKNOWN;
+
+    centroids.push_back(ci);
+  }
+}
+
+te::rst::Raster* te::qt::plugins::tv5plugins::ClassificationPipeline::getInputRaster() const
+{
+  return m_rasterNDVI;
+}
+
+bool te::qt::plugins::tv5plugins::ClassificationPipeline::getWindow(const te::gm::Geometry* parcel, Window& window) const
+{
+  te::rst::Raster* raster = getInputRaster();
+
+  double nCols = (double)raster->getNumberOfColumns();
+  double nRows = (double)raster->getNumberOfRows();
+
+  double minCol = 0.;
+  double minRow = 0.;
+  double maxCol = nCols - 1.;
+  double maxRow = nRows - 1.;
+
+  if(parcel)
+  {
+    const te::gm::Envelope* env = parcel->getMBR();
+
+    double c0, r0, c1, r1;
+
+    raster->getGrid()->geoToGrid(env->m_llx, env->m_ury, c0, r0);
+    raster->getGrid()->geoToGrid(env->m_urx, env->m_lly, c1, r1);
+
+    //pixels that contain the envelope corners (the pixel centers are integer grid coordinates)
+    minCol = std::max(minCol, std::floor(std::min(c0, c1) + 0.5));
+    maxCol = std::min(maxCol, std::floor(std::max(c0, c1) + 0.5));
+    minRow = std::max(minRow, std::floor(std::min(r0, r1) + 0.5));
+    maxRow = std::min(maxRow, std::floor(std::max(r0, r1) + 0.5));
+  }
+
+  if(minCol > maxCol || minRow > maxRow)
+    return false;
+
+  window.m_col = (unsigned int)minCol;
+  window.m_row = (unsigned int)minRow;
+  window.m_width = (unsigned int)(maxCol - minCol) + 1;
+  window.m_height = (unsigned int)(maxRow - minRow) + 1;
+
+  return true;
+}
+
+void te::qt::plugins::tv5plugins::ClassificationPipeline::readNDVI(unsigned int col, unsigned int row, unsigned int width, unsigned int height)
+{
+  std::size_t size = (std::size_t)width * height;
+
+  m_ndvi.resize(size);
+
+  std::auto_ptr<boost::mutex::scoped_lock> lock;
+
+  if(m_ioMutex)
+    lock.reset(new boost::mutex::scoped_lock(*m_ioMutex));
+
+  ReadWindow(m_rasterNDVI->getBand(m_bandNDVI), col, row, width, height, m_raw, m_blockValues, &m_ndvi[0]);
+}
+
+void te::qt::plugins::tv5plugins::ClassificationPipeline::threshold(unsigned int col, unsigned int row, unsigned int width, unsigned int height, const PreparedPolygon* poly)
+{
+  m_mask.reset(width, height);
+
+  const te::rst::Grid* grid = getInputRaster()->getGrid();
+
+  for(unsigned int r = 0; r < height; ++r)
+  {
+    BinaryMask::Word* mask = m_mask.getRow(r);
+
+    ThresholdBits(&m_ndvi[(std::size_t)r * width], width, m_threshold, mask);
+
+    if(!poly)
+      continue;
+
+    //only the pixels with the center inside the parcel spans of this row
+    m_spanBits.assign(m_mask.getStride(), 0);
+
+    double x = 0.;
+    double y = 0.;
+
+    grid->gridToGeo(0., (double)(row + r), x, y);
+
+    poly->getCrossings(y, m_crossings);
+
+    for(std::size_t t = 0; t + 1 < m_crossings.size(); t += 2)
+    {
+      double colA, colB, rowAux;
+
+      grid->geoToGrid(m_crossings[t], y, colA, rowAux);
+      grid->geoToGrid(m_crossings[t + 1], y, colB, rowAux);
+
+      double first = std::max(std::ceil(std::min(colA, colB)) - (double)col, 0.);
+      double last = std::min(std::ceil(std::max(colA, colB)) - (double)col, (double)width);
+
+      if(first < last)
+        SetBits(&m_spanBits[0], (unsigned int)first, (unsigned int)std::ceil(last));
+    }
+
+    for(std::size_t w = 0; w < m_spanBits.size(); ++w)
+      mask[w] &= m_spanBits[w];
+  }
+}
+
+void te::qt::plugins::tv5plugins::ClassificationPipeline::writeMask(te::rst::Raster* raster, unsigned int coreX, unsigned int coreY, unsigned int coreWidth, unsigned int coreHeight,
+                                                                    unsigned int haloX, unsigned int haloY, unsigned int regionWidth) const
+{
+  if(!raster)
+    return;
+
+  for(unsigned int r = 0; r < coreHeight; ++r)
+  {
+    for(unsigned int c = 0; c < coreWidth; ++c)
+      raster->setValue(coreX + c, coreY + r, m_mask.get(haloX + c, haloY + r) ? 255. : 0.);
+  }
+}
+
+void te::qt::plugins::tv5plugins::ClassificationPipeline::label(const Window& window, unsigned int coreX, unsigned int coreY, unsigned int coreWidth, unsigned int coreHeight,
+                                                                unsigned int haloX, unsigned int haloY, unsigned int /*regionWidth*/)
+{
+  m_prevRuns.clear();
+  m_prevRunLabels.clear();
+
+  for(unsigned int r = 0; r < coreHeight; ++r)
+  {
+    m_runs.clear();
+
+    FindRuns(m_mask, haloY + r, haloX, haloX + coreWidth, m_runs);
+
+    m_runLabels.resize(m_runs.size());
+
+    std::size_t p = 0;
+
+    for(std::size_t i = 0; i < m_runs.size(); ++i)
+    {
+      //core columns of the run
+      unsigned int c0 = m_runs[i].m_col0 - haloX;
+      unsigned int c1 = m_runs[i].m_col1 - haloX;
+
+      int l = -1;
+
+      if(c0 == 0)
+        l = joinLabels(l, m_leftLabels[r]);
+
+      if(r == 0)
+      {
+        for(unsigned int c = c0; c < c1; ++c)
+          l = joinLabels(l, m_topLabels[coreX + c]);
+      }
+      else
+      {
+        //the runs of the row above that share a column
+        while(p < m_prevRuns.size() && m_prevRuns[p].m_col1 <= m_runs[i].m_col0)
+          ++p;
+
+        for(std::size_t q = p; q < m_prevRuns.size() && m_prevRuns[q].m_col0 < m_runs[i].m_col1; ++q)
+          l = joinLabels(l, m_prevRunLabels[q]);
+      }
+
+      if(l < 0)
+        l = newLabel();
+
+      m_runLabels[i] = l;
+
+      double length = (double)(c1 - c0);
+      double col0 = (double)(window.m_col + coreX + c0);
+
+      BlobStats& s = m_stats[l];
+      s.m_count += c1 - c0;
+      s.m_sumCol += length * (2. * col0 + length - 1.) / 2.;
+      s.m_sumRow += length * (double)(window.m_row + coreY + r);
+    }
+
+    //borders used by the next tiles
+    m_leftLabels[r] = (!m_runs.empty() && m_runs.back().m_col1 == haloX + coreWidth) ? m_runLabels.back() : -1;
+
+    m_prevRuns.swap(m_runs);
+    m_prevRunLabels.swap(m_runLabels);
+  }
+
+  std::fill(m_topLabels.begin() + coreX, m_topLabels.begin() + coreX + coreWidth, -1);
+
+  for(std::size_t i = 0; i < m_prevRuns.size(); ++i)
+  {
+    for(unsigned int c = m_prevRuns[i].m_col0; c < m_prevRuns[i].m_col1; ++c)
+      m_topLabels[coreX + c - haloX] = m_prevRunLabels[i];
+  }
+}
+
+int te::qt::plugins::tv5plugins::ClassificationPipeline::joinLabels(int label, int other)
+{
+  if(other < 0)
+    return label;
+
+  if(label < 0)
+    return other;
+
+  if(label != other)
+    unionLabels(label, other);
+
+  return label;
+}
+
+int te::qt::plugins::tv5plugins::ClassificationPipeline::newLabel()
+{
+  int l = (int)m_parent.size();
+
+  m_parent.push_back(l);
+
+  BlobStats s;
+  s.m_count = 0;
+  s.m_sumCol = 0.;
+  s.m_sumRow = 0.;
+
+  m_stats.push_back(s);
+
+  return l;
+}
+
+int te::qt::plugins::tv5plugins::ClassificationPipeline::findLabel(int label)
+{
+  while(m_parent[label] != label)
+  {
+    m_parent[label] = m_parent[m_parent[label]];
+    label = m_parent[label];
+  }
+
+  return label;
+}
+
+void te::qt::plugins::tv5plugins::ClassificationPipeline::unionLabels(int a, int b)
+{
+  a = findLabel(a);
+  b = findLabel(b);
+
+  //the lowest label is the root, so the blobs keep the raster order
+  if(a < b)
+    m_parent[b] = a;
+  else if(b < a)
+    m_parent[a] = b;
+}
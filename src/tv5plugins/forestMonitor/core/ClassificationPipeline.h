@@ -0,0 +1,197 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*! \file terralib/qt/plugins/thirdParty/forestMonitor/core/ClassificationPipeline.h
+
+    \brief This file contains the tile pipeline used to detect the trees of a parcel.
+*/
+
+#ifndef __TE_QT_PLUGINS_THIRDPARTY_INTERNAL_CLASSIFICATIONPIPELINE_H
+#define __TE_QT_PLUGINS_THIRDPARTY_INTERNAL_CLASSIFICATIONPIPELINE_H
+
+// TerraLib
+#include "../../Config.h"
+#include "BinaryMask.h"
+#include "BinaryMorphology.h"
+#include "ConnectedComponents.h"
+#include "ForestMonitorClassification.h"
+
+//STL Includes
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Boost
+#include <boost/thread/mutex.hpp>
+
+namespace te
+{
+  namespace gm { class Geometry; }
+  namespace rst { class Raster; }
+
+  namespace qt
+  {
+    namespace plugins
+    {
+      namespace tv5plugins
+      {
+        class PreparedPolygon;
+
+        /*!
+          \class ClassificationPipeline
+
+          \brief Detects the trees of a parcel without intermediate rasters.
+
+          The parcel window is processed in tiles. Each tile is read with a halo of
+          (dilation + erosion) pixels, the NDVI is read, thresholded
+          into a packed mask (NDVI <= threshold is tree), clipped by the parcel,
+          dilated and eroded by squares. The tile core is then labeled (4-connectivity) and the
+          blobs that cross the tile borders are merged, each blob gives a centroid.
+        */
+        class ClassificationPipeline
+        {
+          public:
+
+            ClassificationPipeline(double threshold, int dilation, int erosion);
+
+            ~ClassificationPipeline();
+
+            /*! \brief The NDVI is read from an existing raster. */
+            void setInputNDVI(te::rst::Raster* rasterNDVI, int bandNDVI);
+
+            /*! \brief Tile size in pixels, without the halo. */
+            void setTileSize(unsigned int tileSize);
+
+            /*! \brief Mutex locked by the raster reads, used when pipelines of several threads share the input rasters. */
+            void setIOMutex(boost::mutex* ioMutex);
+
+            /*! \brief Creates a raster of dataType with the grid of the parcel window, null if the parcel is out of the raster. */
+            std::auto_ptr<te::rst::Raster> createWindowRaster(const te::gm::Geometry* parcel, int dataType, const std::map<std::string, std::string>& rInfo,
+                                                              const std::string& type) const;
+
+            /*! \brief Creates a UCHAR raster with the grid of the parcel window, used as the mask output of classify. */
+            std::auto_ptr<te::rst::Raster> createMaskRaster(const te::gm::Geometry* parcel, const std::map<std::string, std::string>& rInfo,
+                                                            const std::string& type) const;
+
+            /*!
+              \brief Rasters from createWindowRaster that receive the intermediate results of the next classify, to debug the pipeline.
+
+              The NDVI raster must be DOUBLE, the threshold, dilation and erosion masks UCHAR (255 tree, 0 background).
+              Null rasters are skipped, the rasters are released by the caller and are not used after classify.
+            */
+            void setDebugRasters(te::rst::Raster* ndvi, te::rst::Raster* threshold, te::rst::Raster* dilation, te::rst::Raster* erosion);
+
+            /*!
+              \brief Detects the trees of a parcel.
+
+              \param parcel    Parcel geometry in the raster SRID, null to use the whole raster.
+              \param parcelId  Parent id of the centroids.
+              \param centroids The tree centroids are appended, the caller takes their ownership.
+              \param mask      Optional raster from createMaskRaster, receives the final tree mask (255 tree, 0 background).
+            */
+            void classify(const te::gm::Geometry* parcel, int parcelId, std::vector<CentroidInfo*>& centroids, te::rst::Raster* mask = 0);
+
+          protected:
+
+            /*! \brief Pixel window of the input raster. */
+            struct Window
+            {
+              unsigned int m_col;
+              unsigned int m_row;
+              unsigned int m_width;
+              unsigned int m_height;
+            };
+
+            /*! \brief Pixel count and coordinate sums of a blob. */
+            struct BlobStats
+            {
+              std::size_t m_count;
+              double m_sumCol;
+              double m_sumRow;
+            };
+
+            te::rst::Raster* getInputRaster() const;
+
+            bool getWindow(const te::gm::Geometry* parcel, Window& window) const;
+
+            /*! \brief Reads the NDVI of the region into m_ndvi. */
+            void readNDVI(unsigned int col, unsigned int row, unsigned int width, unsigned int height);
+
+            /*! \brief Thresholds m_ndvi into m_mask, the pixels outside the parcel are background. */
+            void threshold(unsigned int col, unsigned int row, unsigned int width, unsigned int height, const PreparedPolygon* poly);
+
+            /*! \brief Writes the tile core of the mask into the raster, as 255 (tree) and 0. */
+            void writeMask(te::rst::Raster* raster, unsigned int coreX, unsigned int coreY, unsigned int coreWidth, unsigned int coreHeight,
+                           unsigned int haloX, unsigned int haloY, unsigned int regionWidth) const;
+
+            /*! \brief Labels the runs of the tile core, merging with the labels of the tiles above and to the left. */
+            void label(const Window& window, unsigned int coreX, unsigned int coreY, unsigned int coreWidth, unsigned int coreHeight,
+                       unsigned int haloX, unsigned int haloY, unsigned int regionWidth);
+
+            int newLabel();
+
+            /*! \brief Joins other (if it is a label) to label, returns the label or other if label is -1. */
+            int joinLabels(int label, int other);
+
+            int findLabel(int label);
+
+            void unionLabels(int a, int b);
+
+          protected:
+
+            double m_threshold;
+            int m_dilation;                             //!< Number of 3x3 dilation iterations.
+            int m_erosion;                              //!< Number of 3x3 erosion iterations, after the dilation.
+            unsigned int m_tileSize;
+
+            te::rst::Raster* m_rasterNDVI;
+            int m_bandNDVI;
+
+            boost::mutex* m_ioMutex;
+
+            te::rst::Raster* m_debugNDVI;
+            te::rst::Raster* m_debugThreshold;
+            te::rst::Raster* m_debugDilation;
+            te::rst::Raster* m_debugErosion;
+
+            std::vector<double> m_ndvi;                 //!< NDVI of the tile with halo.
+            std::vector<double> m_blockValues;
+            std::vector<unsigned char> m_raw;
+            BinaryMask m_mask;                          //!< Tree mask of the tile with halo.
+            BinaryMorphology m_morphology;
+            std::vector<BinaryMask::Word> m_spanBits;   //!< Pixels of a mask row inside the parcel.
+            std::vector<double> m_crossings;
+
+            std::vector<MaskRun> m_runs;                //!< Runs of the current row of the tile core.
+            std::vector<int> m_runLabels;
+            std::vector<MaskRun> m_prevRuns;            //!< Runs of the previous row of the tile core.
+            std::vector<int> m_prevRunLabels;
+            std::vector<int> m_topLabels;               //!< Labels of the last row of the tiles above, by window column.
+            std::vector<int> m_leftLabels;              //!< Labels of the last column of the tile to the left, by tile row.
+            std::vector<int> m_parent;                  //!< Union find of the labels.
+            std::vector<BlobStats> m_stats;             //!< Indexed by the label.
+        };
+
+      } // end namespace thirdParty
+    }   // end namespace plugins
+  }     // end namespace qt
+}       // end namespace te
+
+#endif //__TE_QT_PLUGINS_THIRDPARTY_INTERNAL_CLASSIFICATIONPIPELINE_H
@@ -0,0 +1,356 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*! \file terralib/qt/plugins/thirdParty/forestMonitor/core/ConnectedComponents.cpp
+
+    \brief This file contains the connected component labeling of the binary masks.
+*/
+
+//TerraLib Includes
+#include <terralib/common/Exception.h>
+#include "ConnectedComponents.h"
+#include "RasterBlock.h"
+
+//STL Includes
+#include <algorithm>
+
+// Boost
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace
+{
+  typedef te::qt::plugins::tv5plugins::BinaryMask::Word Word;
+
+  const unsigned int WORD_BITS = te::qt::plugins::tv5plugins::BinaryMask::WORD_BITS;
+
+  //bit index of the lowest set bit of w & -w, multiplied by the de Bruijn sequence 0x03f79d71b4cb0a89
+  const unsigned int DEBRUIJN_INDEX[64] =
+  {
+     0,  1, 48,  2, 57, 49, 28,  3,
+    61, 58, 50, 42, 38, 29, 17,  4,
+    62, 55, 59, 36, 53, 51, 43, 22,
+    45, 39, 33, 30, 24, 18, 12,  5,
+    63, 47, 56, 27, 60, 41, 37, 16,
+    54, 35, 52, 21, 44, 32, 23, 11,
+    46, 26, 40, 15, 34, 20, 31, 10,
+    25, 14, 19,  9, 13,  8,  7,  6
+  };
+
+  /*! \brief Index of the lowest set bit, w must not be 0. */
+  unsigned int LowestBit(Word w)
+  {
+    return DEBRUIJN_INDEX[((w & (~w + 1)) * UINT64_C(0x03f79d71b4cb0a89)) >> 58];
+  }
+
+  /*! \brief Mask of the first n bits of a word (n < 64). */
+  Word FirstBits(unsigned int n)
+  {
+    return (((Word)1) << n) - 1;
+  }
+
+  void AddRun(te::qt::plugins::tv5plugins::BlobInfo& blob, const te::qt::plugins::tv5plugins::MaskRun& run)
+  {
+    double length = (double)(run.m_col1 - run.m_col0);
+
+    blob.m_count += run.m_col1 - run.m_col0;
+    blob.m_sumCol += length * ((double)run.m_col0 + (double)run.m_col1 - 1.) / 2.;
+    blob.m_sumRow += length * (double)run.m_row;
+    blob.m_minCol = std::min(blob.m_minCol, run.m_col0);
+    blob.m_minRow = std::min(blob.m_minRow, run.m_row);
+    blob.m_maxCol = std::max(blob.m_maxCol, run.m_col1 - 1);
+    blob.m_maxRow = std::max(blob.m_maxRow, run.m_row);
+  }
+}
+
+void te::qt::plugins::tv5plugins::FindRuns(const BinaryMask& mask, unsigned int row, unsigned int first, unsigned int last, std::vector<MaskRun>& runs)
+{
+  if(first >= last)
+    return;
+
+  const BinaryMask::Word* bits = mask.getRow(row);
+
+  std::size_t firstWord = first / WORD_BITS;
+  std::size_t lastWord = (last - 1) / WORD_BITS;
+
+  MaskRun run;
+  run.m_row = row;
+  run.m_col0 = 0;
+
+  bool open = false;
+
+  //value of the pixel before the word
+  Word carry = 0;
+
+  for(std::size_t w = firstWord; w <= lastWord; ++w)
+  {
+    Word word = bits[w];
+
+    if(w == firstWord)
+      word &= ~FirstBits(first % WORD_BITS);
+
+    if(w == lastWord && last % WORD_BITS)
+      word &= FirstBits(last % WORD_BITS);
+
+    //the bits where the value changes start or end a run
+    Word changes = word ^ ((word << 1) | carry);
+
+    carry = word >> (WORD_BITS - 1);
+
+    while(changes)
+    {
+      unsigned int col = (unsigned int)(w * WORD_BITS) + LowestBit(changes);
+
+      changes &= changes - 1;
+
+      if(!open)
+      {
+        run.m_col0 = col;
+      }
+      else
+      {
+        run.m_col1 = col;
+        runs.push_back(run);
+      }
+
+      open = !open;
+    }
+  }
+
+  if(open)
+  {
+    run.m_col1 = last;
+    runs.push_back(run);
+  }
+}
+
+te::qt::plugins::tv5plugins::ConnectedComponents::ConnectedComponents() :
+  m_nThreads(1)
+{
+}
+
+te::qt::plugins::tv5plugins::ConnectedComponents::~ConnectedComponents()
+{
+}
+
+void te::qt::plugins::tv5plugins::ConnectedComponents::setNumberOfThreads(std::size_t nThreads)
+{
+  m_nThreads = nThreads;
+}
+
+void te::qt::plugins::tv5plugins::ConnectedComponents::execute(const BinaryMask& mask)
+{
+  m_blobs.clear();
+  m_errorMessage.clear();
+
+  if(mask.getWidth() == 0 || mask.getHeight() == 0)
+    return;
+
+  std::size_t nStrips = std::min<std::size_t>(GetNumberOfThreads(m_nThreads), mask.getHeight());
+
+  std::vector<Strip> strips(nStrips);
+
+  for(std::size_t s = 0; s < nStrips; ++s)
+  {
+    strips[s].m_row0 = (unsigned int)((std::size_t)mask.getHeight() * s / nStrips);
+    strips[s].m_row1 = (unsigned int)((std::size_t)mask.getHeight() * (s + 1) / nStrips);
+  }
+
+  if(nStrips == 1)
+  {
+    labelStrip(mask, strips[0]);
+  }
+  else
+  {
+    boost::thread_group threads;
+
+    for(std::size_t s = 0; s < nStrips; ++s)
+      threads.create_thread(boost::bind(&ConnectedComponents::runStrip, this, boost::cref(mask), boost::ref(strips[s])));
+
+    threads.join_all();
+
+    if(!m_errorMessage.empty())
+      throw te::common::Exception(m_errorMessage);
+  }
+
+  merge(strips);
+}
+
+const std::vector<te::qt::plugins::tv5plugins::BlobInfo>& te::qt::plugins::tv5plugins::ConnectedComponents::getBlobs() const
+{
+  return m_blobs;
+}
+
+void te::qt::plugins::tv5plugins::ConnectedComponents::labelStrip(const BinaryMask& mask, Strip& strip)
+{
+  std::vector<MaskRun>& runs = strip.m_runs;
+  std::vector<std::size_t>& parent = strip.m_parent;
+
+  runs.clear();
+  parent.clear();
+
+  std::size_t prevBegin = 0;
+  std::size_t prevEnd = 0;
+
+  strip.m_firstRowEnd = 0;
+
+  for(unsigned int row = strip.m_row0; row < strip.m_row1; ++row)
+  {
+    std::size_t begin = runs.size();
+
+    FindRuns(mask, row, 0, mask.getWidth(), runs);
+
+    std::size_t end = runs.size();
+
+    for(std::size_t i = begin; i < end; ++i)
+      parent.push_back(i);
+
+    if(row == strip.m_row0)
+      strip.m_firstRowEnd = end;
+
+    //the runs of the row above that share a column
+    std::size_t p = prevBegin;
+
+    for(std::size_t i = begin; i < end; ++i)
+    {
+      while(p < prevEnd && runs[p].m_col1 <= runs[i].m_col0)
+        ++p;
+
+      for(std::size_t q = p; q < prevEnd && runs[q].m_col0 < runs[i].m_col1; ++q)
+        unionRuns(parent, q, i);
+    }
+
+    prevBegin = begin;
+    prevEnd = end;
+  }
+
+  strip.m_lastRowBegin = prevBegin;
+}
+
+void te::qt::plugins::tv5plugins::ConnectedComponents::runStrip(const BinaryMask& mask, Strip& strip)
+{
+  try
+  {
+    labelStrip(mask, strip);
+  }
+  catch(const std::exception& e)
+  {
+    boost::mutex::scoped_lock lock(m_mutex);
+
+    m_errorMessage = e.what();
+  }
+  catch(...)
+  {
+    boost::mutex::scoped_lock lock(m_mutex);
+
+    m_errorMessage = "Error labeling the mask.";
+  }
+}
+
+void te::qt::plugins::tv5plugins::ConnectedComponents::merge(std::vector<Strip>& strips)
+{
+  //the runs of all strips, in raster order
+  std::vector<std::size_t> offsets(strips.size() + 1, 0);
+
+  for(std::size_t s = 0; s < strips.size(); ++s)
+    offsets[s + 1] = offsets[s] + strips[s].m_runs.size();
+
+  std::vector<std::size_t> parent(offsets.back());
+
+  for(std::size_t s = 0; s < strips.size(); ++s)
+  {
+    for(std::size_t i = 0; i < strips[s].m_parent.size(); ++i)
+      parent[offsets[s] + i] = offsets[s] + strips[s].m_parent[i];
+
+    std::vector<std::size_t>().swap(strips[s].m_parent);
+  }
+
+  //seams, the last row of a strip and the first row of the next one
+  for(std::size_t s = 1; s < strips.size(); ++s)
+  {
+    const std::vector<MaskRun>& top = strips[s - 1].m_runs;
+    const std::vector<MaskRun>& bottom = strips[s].m_runs;
+
+    std::size_t p = strips[s - 1].m_lastRowBegin;
+
+    for(std::size_t i = 0; i < strips[s].m_firstRowEnd; ++i)
+    {
+      while(p < top.size() && top[p].m_col1 <= bottom[i].m_col0)
+        ++p;
+
+      for(std::size_t q = p; q < top.size() && top[q].m_col0 < bottom[i].m_col1; ++q)
+        unionRuns(parent, offsets[s - 1] + q, offsets[s] + i);
+    }
+  }
+
+  //the root of a blob is its first run, so it is found before the other runs
+  std::vector<std::size_t> blobIndex(parent.size());
+
+  for(std::size_t s = 0; s < strips.size(); ++s)
+  {
+    const std::vector<MaskRun>& runs = strips[s].m_runs;
+
+    for(std::size_t i = 0; i < runs.size(); ++i)
+    {
+      std::size_t run = offsets[s] + i;
+      std::size_t root = findRun(parent, run);
+
+      if(root == run)
+      {
+        BlobInfo blob;
+        blob.m_count = 0;
+        blob.m_sumCol = 0.;
+        blob.m_sumRow = 0.;
+        blob.m_minCol = runs[i].m_col0;
+        blob.m_minRow = runs[i].m_row;
+        blob.m_maxCol = runs[i].m_col0;
+        blob.m_maxRow = runs[i].m_row;
+
+        blobIndex[run] = m_blobs.size();
+
+        m_blobs.push_back(blob);
+      }
+
+      AddRun(m_blobs[blobIndex[root]], runs[i]);
+    }
+  }
+}
+
+std::size_t te::qt::plugins::tv5plugins::ConnectedComponents::findRun(std::vector<std::size_t>& parent, std::size_t run)
+{
+  while(parent[run] != run)
+  {
+    parent[run] = parent[parent[run]];
+    run = parent[run];
+  }
+
+  return run;
+}
+
+void te::qt::plugins::tv5plugins::ConnectedComponents::unionRuns(std::vector<std::size_t>& parent, std::size_t a, std::size_t b)
+{
+  a = findRun(parent, a);
+  b = findRun(parent, b);
+
+  //the lowest run is the root, so the blobs keep the raster order
+  if(a < b)
+    parent[b] = a;
+  else if(b < a)
+    parent[a] = b;
+}
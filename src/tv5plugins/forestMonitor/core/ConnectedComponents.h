@@ -0,0 +1,137 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*! \file terralib/qt/plugins/thirdParty/forestMonitor/core/ConnectedComponents.h
+
+    \brief This file contains the connected component labeling of the binary masks.
+*/
+
+#ifndef __TE_QT_PLUGINS_THIRDPARTY_INTERNAL_CONNECTEDCOMPONENTS_H
+#define __TE_QT_PLUGINS_THIRDPARTY_INTERNAL_CONNECTEDCOMPONENTS_H
+
+// TerraLib
+#include "../../Config.h"
+#include "BinaryMask.h"
+
+//STL Includes
+#include <string>
+#include <vector>
+
+// Boost
+#include <boost/thread/mutex.hpp>
+
+namespace te
+{
+  namespace qt
+  {
+    namespace plugins
+    {
+      namespace tv5plugins
+      {
+        /*! \brief Foreground pixels m_col0 to m_col1 - 1 of a mask row. */
+        struct MaskRun
+        {
+          unsigned int m_row;
+          unsigned int m_col0;
+          unsigned int m_col1;
+        };
+
+        /*! \brief Pixel count, coordinate sums and bounding box (inclusive) of a blob. */
+        struct BlobInfo
+        {
+          std::size_t m_count;
+          double m_sumCol;
+          double m_sumRow;
+          unsigned int m_minCol;
+          unsigned int m_minRow;
+          unsigned int m_maxCol;
+          unsigned int m_maxRow;
+        };
+
+        /*! \brief Appends the runs of the row between the columns first and last - 1, the runs are clipped to them. */
+        void FindRuns(const BinaryMask& mask, unsigned int row, unsigned int first, unsigned int last, std::vector<MaskRun>& runs);
+
+        /*!
+          \class ConnectedComponents
+
+          \brief Labels the 4-connected blobs of a BinaryMask in a single pass over the rows.
+
+          The rows are split in one strip for each thread. Each strip finds the runs of its rows
+          (whole mask words at a time) and joins the overlapping runs of consecutive rows with a
+          union-find, the strips are then merged at their seams. The blobs only keep their
+          statistics, no label image is built, and are given in the order of their first pixel,
+          so the result is the same for any number of threads.
+        */
+        class ConnectedComponents
+        {
+          protected:
+
+            struct Strip
+            {
+              unsigned int m_row0;
+              unsigned int m_row1;
+              std::vector<MaskRun> m_runs;
+              std::vector<std::size_t> m_parent;        //!< Union-find of the runs of the strip.
+              std::size_t m_firstRowEnd;                //!< Number of runs of the first row.
+              std::size_t m_lastRowBegin;               //!< Index of the first run of the last row.
+            };
+
+          public:
+
+            ConnectedComponents();
+
+            ~ConnectedComponents();
+
+            /*! \brief Number of threads, 0 uses the number of hardware threads and 1 (default) labels in the calling thread. */
+            void setNumberOfThreads(std::size_t nThreads);
+
+            /*! \brief Labels the mask, the previous blobs are cleared. */
+            void execute(const BinaryMask& mask);
+
+            /*! \brief The blobs, in mask coordinates. */
+            const std::vector<BlobInfo>& getBlobs() const;
+
+          protected:
+
+            void labelStrip(const BinaryMask& mask, Strip& strip);
+
+            /*! \brief Thread function, labels the strip and keeps the error message. */
+            void runStrip(const BinaryMask& mask, Strip& strip);
+
+            void merge(std::vector<Strip>& strips);
+
+            std::size_t findRun(std::vector<std::size_t>& parent, std::size_t run);
+
+            void unionRuns(std::vector<std::size_t>& parent, std::size_t a, std::size_t b);
+
+          protected:
+
+            std::size_t m_nThreads;
+            std::vector<BlobInfo> m_blobs;
+
+            boost::mutex m_mutex;
+            std::string m_errorMessage;
+        };
+
+      } // end namespace thirdParty
+    }   // end namespace plugins
+  }     // end namespace qt
+}       // end namespace te
+
+#endif //__TE_QT_PLUGINS_THIRDPARTY_INTERNAL_CONNECTEDCOMPONENTS_H
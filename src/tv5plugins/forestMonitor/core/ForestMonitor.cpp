@@ -24,117 +24,431 @@
 
 //TerraLib Includes
 #include <terralib/common/progress/TaskProgress.h>
+#include <terralib/common/Exception.h>
 #include <terralib/common/STLUtils.h>
 #include <terralib/geometry/MultiLineString.h>
 #include <terralib/geometry/MultiPoint.h>
 #include <terralib/memory/DataSetItem.h>
+#include <terralib/srs/Config.h>
 #include "ForestMonitor.h"
+#include "PreparedPolygon.h"
+#include "TrackCache.h"
+#include "TrackWriter.h"
 
 //STL Includes
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <limits>
+
+// Boost
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread/thread.hpp>
+
+//number of parcels processed by thread before merging the results into the output data set
+#define PARCELS_PER_THREAD 8
 
 te::qt::plugins::tv5plugins::ForestMonitor::ForestMonitor(double tolAngle, double distance, double distTol, te::mem::DataSet* ds) :
-  m_tolAngle(tolAngle), m_distance(distance), m_distTol(distTol), m_ds(ds)
+  m_indexType(GRID_POINT_INDEX), m_tolAngle(tolAngle), m_distance(distance), m_distTol(distTol), m_ds(ds), m_writer(0), m_cache(0), m_nThreads(1)
 {
   m_count = 0;
 }
 
 te::qt::plugins::tv5plugins::ForestMonitor::~ForestMonitor()
 {
-  m_ignoredCentroids.clear();
+  m_centroids.clear();
 
-  m_usedCentroids.clear();
+  te::common::FreeContents(m_angleGeomMap);
+}
 
-  m_trackMap.clear();
+void te::qt::plugins::tv5plugins::ForestMonitor::setNumberOfThreads(std::size_t nThreads)
+{
+  m_nThreads = nThreads;
+}
 
-  m_centroidRtree.clear();
-  te::common::FreeContents(m_centroidGeomMap);
+void te::qt::plugins::tv5plugins::ForestMonitor::setPointIndexType(PointIndexType type)
+{
+  m_indexType = type;
+}
 
-  m_angleRtree.clear();
-  te::common::FreeContents(m_angleGeomMap);
+void te::qt::plugins::tv5plugins::ForestMonitor::setTrackWriter(TrackWriter* writer)
+{
+  m_writer = writer;
+}
+
+void te::qt::plugins::tv5plugins::ForestMonitor::setTrackCache(TrackCache* cache, int firstTrackId)
+{
+  m_cache = cache;
+
+  m_count = firstTrackId;
 }
 
 void te::qt::plugins::tv5plugins::ForestMonitor::execute(std::auto_ptr<te::da::DataSet> parcelDs, int parcelGeomIdx, int parcelIdIdx,
                                                          std::auto_ptr<te::da::DataSet> angleDs, int angleGeomIdx, int angleIdIdx,
                                                          std::auto_ptr<te::da::DataSet> centroidDs, int centroidGeomIdx, int centroidIdIdx)
 {
+  m_stageTimes.clear();
+
+  boost::posix_time::ptime start = boost::posix_time::microsec_clock::local_time();
+
   //set centroid info
   setCentroidDataSet(centroidDs, centroidGeomIdx, centroidIdIdx);
+
+  boost::posix_time::ptime centroidsDone = boost::posix_time::microsec_clock::local_time();
+
+  m_stageTimes.push_back(std::make_pair(std::string("Centroid index"), (centroidsDone - start).total_milliseconds() / 1000.));
   
   //set angle info
   setAngleDataSet(angleDs, angleGeomIdx, angleIdIdx);
 
+  boost::posix_time::ptime anglesDone = boost::posix_time::microsec_clock::local_time();
+
+  m_stageTimes.push_back(std::make_pair(std::string("Angle lines"), (anglesDone - centroidsDone).total_milliseconds() / 1000.));
+
   //set parcel info and create the track information
   setParcelDataSet(parcelDs, parcelGeomIdx, parcelIdIdx);
+
+  boost::posix_time::ptime tracksDone = boost::posix_time::microsec_clock::local_time();
+
+  m_stageTimes.push_back(std::make_pair(std::string("Tracks"), (tracksDone - anglesDone).total_milliseconds() / 1000.));
+}
+
+const std::vector<std::pair<std::string, double> >& te::qt::plugins::tv5plugins::ForestMonitor::getStageTimes() const
+{
+  return m_stageTimes;
 }
 
 void te::qt::plugins::tv5plugins::ForestMonitor::setParcelDataSet(std::auto_ptr<te::da::DataSet> ds, int geomIdx, int idIdx)
 {
   assert(ds.get());
 
-  std::size_t size = ds->size();
-
-  te::common::TaskProgress task("Creating Tracks");
-  task.setTotalSteps(size);
+  //read all parcels, each one is processed independently
+  std::vector<ParcelInfo> parcels;
 
-  //move over the data set
   ds->moveBeforeFirst();
 
   while(ds->moveNext())
   {
-    //clear memory data
-    m_trackMap.clear();
+    std::string strId = ds->getAsString(idIdx);
+
+    ParcelInfo pi;
+    pi.m_id = atoi(strId.c_str());
+    pi.m_geom = ds->getGeometry(geomIdx).release();
+
+    parcels.push_back(pi);
+  }
+
+  std::size_t nThreads = m_nThreads;
+
+  if(nThreads == 0)
+    nThreads = boost::thread::hardware_concurrency();
+
+  if(nThreads == 0)
+    nThreads = 1;
+
+  //join the parcels with their direction and label each centroid with its parcel
+  try
+  {
+    createAngleTable(parcels, nThreads);
+
+    labelCentroids(parcels, nThreads);
+
+    if(m_cache)
+      selectChangedParcels(parcels);
+  }
+  catch(...)
+  {
+    for(std::size_t t = 0; t < parcels.size(); ++t)
+      delete parcels[t].m_geom;
+
+    throw;
+  }
+
+  te::common::TaskProgress task("Creating Tracks");
+  task.setTotalSteps(parcels.size());
 
-    m_ignoredCentroids.clear();
+  //the parcels are processed in batches, the results of each batch are saved in parcel order
+  std::size_t batchSize = nThreads * PARCELS_PER_THREAD;
 
-    m_usedCentroids.clear();
+  std::string errorMessage;
 
+  for(std::size_t begin = 0; begin < parcels.size(); begin += batchSize)
+  {
+    //a canceled run throws, so the caller does not take the parcels left as done
     if(!task.isActive())
+    {
+      errorMessage = "Operation Canceled.";
       break;
+    }
 
-    //get parcel (polygon)
-    std::auto_ptr<te::gm::Geometry> g = ds->getGeometry(geomIdx);
+    std::size_t end = std::min(begin + batchSize, parcels.size());
 
-    std::string strId = ds->getAsString(idIdx);
+    std::vector<ParcelState> states(end - begin);
 
-    int id = atoi(strId.c_str());
+    ParcelQueue queue;
+    queue.m_next = begin;
+    queue.m_end = end;
 
-    //get parcel angle
-    double angle = getParcelLineAngle(g.get());
+    runWorkers(boost::bind(&ForestMonitor::processParcels, this, boost::ref(parcels), boost::ref(states), begin, boost::ref(queue)), nThreads);
 
-    //get centroids
-    std::vector<int> results = getParcelCentroids(g.get());
+    if(!queue.m_errorMessage.empty())
+    {
+      errorMessage = queue.m_errorMessage;
+      break;
+    }
 
-    //create parcel lines
-    createParcelLines(g.get(), id, results, angle);
+    //merge results
+    for(std::size_t t = 0; t < states.size(); ++t)
+    {
+      saveTrackLines(states[t]);
+
+      task.pulse();
+    }
+  }
+
+  for(std::size_t t = 0; t < parcels.size(); ++t)
+    delete parcels[t].m_geom;
 
-    saveTrackLines();
+  m_parcelCentroids.clear();
 
-    task.pulse();
+  if(!errorMessage.empty())
+    throw te::common::Exception(errorMessage);
+}
+
+void te::qt::plugins::tv5plugins::ForestMonitor::runWorkers(const boost::function<void ()>& worker, std::size_t nThreads)
+{
+  if(nThreads == 1)
+  {
+    worker();
 
-    break;
+    return;
   }
+
+  boost::thread_group threads;
+
+  for(std::size_t t = 0; t < nThreads; ++t)
+    threads.create_thread(worker);
+
+  threads.join_all();
 }
 
-void te::qt::plugins::tv5plugins::ForestMonitor::setCentroidDataSet(std::auto_ptr<te::da::DataSet> ds, int geomIdx, int idIdx)
+void te::qt::plugins::tv5plugins::ForestMonitor::labelCentroids(const std::vector<ParcelInfo>& parcels, std::size_t nThreads)
 {
-  //create tree
-  createRTree(m_centroidRtree, m_centroidGeomMap, ds, geomIdx, idIdx);
+  //get the centroids inside each parcel
+  std::vector<std::vector<int> > members(parcels.size());
+
+  ParcelQueue queue;
+  queue.m_next = 0;
+  queue.m_end = parcels.size();
+
+  runWorkers(boost::bind(&ForestMonitor::labelParcels, this, boost::cref(parcels), boost::ref(members), boost::ref(queue)), nThreads);
+
+  if(!queue.m_errorMessage.empty())
+    throw te::common::Exception(queue.m_errorMessage);
+
+  //each centroid belongs to the first parcel (in data set order) that contains it
+  m_centroidLabels.assign(m_centroids.size(), -1);
+  m_centroidLocalIdx.assign(m_centroids.size(), 0);
+
+  m_parcelCentroids.clear();
+  m_parcelCentroids.resize(parcels.size());
+
+  for(std::size_t p = 0; p < members.size(); ++p)
+  {
+    for(std::size_t t = 0; t < members[p].size(); ++t)
+    {
+      int idx = members[p][t];
+
+      if(m_centroidLabels[idx] != -1)
+        continue;
+
+      m_centroidLabels[idx] = (int)p;
+      m_centroidLocalIdx[idx] = m_parcelCentroids[p].size();
+
+      m_parcelCentroids[p].push_back(idx);
+    }
+
+    std::vector<int>().swap(members[p]);
+  }
 }
 
-void te::qt::plugins::tv5plugins::ForestMonitor::setAngleDataSet(std::auto_ptr<te::da::DataSet> ds, int geomIdx, int idIdx)
+void te::qt::plugins::tv5plugins::ForestMonitor::labelParcels(const std::vector<ParcelInfo>& parcels, std::vector<std::vector<int> >& members, ParcelQueue& queue)
 {
-  //create tree
-  createRTree(m_angleRtree, m_angleGeomMap, ds, geomIdx, idIdx);
+  while(true)
+  {
+    std::size_t idx;
+
+    {
+      boost::mutex::scoped_lock lock(queue.m_mutex);
+
+      if(queue.m_next >= queue.m_end || !queue.m_errorMessage.empty())
+        return;
+
+      idx = queue.m_next++;
+    }
+
+    try
+    {
+      te::qt::plugins::tv5plugins::PreparedPolygon poly(parcels[idx].m_geom);
+
+      std::vector<int> resultsTree;
+
+      m_centroidIndex->search(poly.getMBR(), resultsTree);
+
+      //the result order depends on the index type, keep the centroids in the input order
+      std::sort(resultsTree.begin(), resultsTree.end());
+
+      for(std::size_t t = 0; t < resultsTree.size(); ++t)
+      {
+        if(poly.contains(m_centroids.getX(resultsTree[t]), m_centroids.getY(resultsTree[t])))
+          members[idx].push_back(resultsTree[t]);
+      }
+    }
+    catch(const std::exception& e)
+    {
+      boost::mutex::scoped_lock lock(queue.m_mutex);
+
+      queue.m_errorMessage = e.what();
+    }
+    catch(...)
+    {
+      boost::mutex::scoped_lock lock(queue.m_mutex);
+
+      queue.m_errorMessage = "Error getting parcel centroids.";
+    }
+  }
 }
 
-void te::qt::plugins::tv5plugins::ForestMonitor::createRTree(te::sam::rtree::Index<int> &tree, std::map<int, te::gm::Geometry*> &geomMap, std::auto_ptr<te::da::DataSet> ds, int geomIdx, int idIdx)
+void te::qt::plugins::tv5plugins::ForestMonitor::selectChangedParcels(std::vector<ParcelInfo>& parcels)
+{
+  assert(m_cache);
+
+  std::vector<ParcelInfo> changed;
+  std::vector<std::vector<int> > changedCentroids;
+  std::vector<int> newIdx(parcels.size(), -1);
+
+  std::vector<std::pair<int, std::size_t> > members;
+
+  for(std::size_t p = 0; p < parcels.size(); ++p)
+  {
+    //parameters and direction
+    boost::uint64_t hash = TrackCache::InitialHash();
+
+    hash = TrackCache::Hash(&parcels[p].m_id, sizeof(int), hash);
+    hash = TrackCache::Hash(&m_tolAngle, sizeof(double), hash);
+    hash = TrackCache::Hash(&m_distance, sizeof(double), hash);
+    hash = TrackCache::Hash(&m_distTol, sizeof(double), hash);
+
+    const ParcelAngle* pa = m_angleTable.find(parcels[p].m_id);
+
+    double angle = pa ? pa->m_angle : -1.;
+
+    hash = TrackCache::Hash(&angle, sizeof(double), hash);
+
+    //centroids, in id order so the hash does not depend on the input order
+    const std::vector<int>& centroidsIdx = m_parcelCentroids[p];
+
+    members.clear();
+
+    for(std::size_t t = 0; t < centroidsIdx.size(); ++t)
+      members.push_back(std::make_pair(m_centroids.getId(centroidsIdx[t]), (std::size_t)centroidsIdx[t]));
+
+    std::sort(members.begin(), members.end());
+
+    for(std::size_t t = 0; t < members.size(); ++t)
+    {
+      double x = m_centroids.getX(members[t].second);
+      double y = m_centroids.getY(members[t].second);
+
+      hash = TrackCache::Hash(&members[t].first, sizeof(int), hash);
+      hash = TrackCache::Hash(&x, sizeof(double), hash);
+      hash = TrackCache::Hash(&y, sizeof(double), hash);
+    }
+
+    if(m_cache->update(parcels[p].m_id, hash))
+    {
+      newIdx[p] = (int)changed.size();
+
+      changed.push_back(parcels[p]);
+
+      changedCentroids.push_back(m_parcelCentroids[p]);
+    }
+  }
+
+  //the centroid labels refer to the new parcel positions
+  for(std::size_t t = 0; t < m_centroidLabels.size(); ++t)
+  {
+    if(m_centroidLabels[t] != -1)
+      m_centroidLabels[t] = newIdx[m_centroidLabels[t]];
+  }
+
+  //release the parcels that keep their tracks
+  for(std::size_t p = 0; p < parcels.size(); ++p)
+  {
+    if(newIdx[p] == -1)
+      delete parcels[p].m_geom;
+  }
+
+  parcels.swap(changed);
+  m_parcelCentroids.swap(changedCentroids);
+}
+
+void te::qt::plugins::tv5plugins::ForestMonitor::processParcels(std::vector<ParcelInfo>& parcels, std::vector<ParcelState>& states, std::size_t begin, ParcelQueue& queue)
+{
+  while(true)
+  {
+    std::size_t idx;
+
+    {
+      boost::mutex::scoped_lock lock(queue.m_mutex);
+
+      if(queue.m_next >= queue.m_end || !queue.m_errorMessage.empty())
+        return;
+
+      idx = queue.m_next++;
+    }
+
+    try
+    {
+      processParcel(parcels[idx], idx, states[idx - begin]);
+    }
+    catch(const std::exception& e)
+    {
+      boost::mutex::scoped_lock lock(queue.m_mutex);
+
+      queue.m_errorMessage = e.what();
+    }
+    catch(...)
+    {
+      boost::mutex::scoped_lock lock(queue.m_mutex);
+
+      queue.m_errorMessage = "Error creating parcel tracks.";
+    }
+  }
+}
+
+void te::qt::plugins::tv5plugins::ForestMonitor::processParcel(const ParcelInfo& parcel, std::size_t parcelIdx, ParcelState& state)
+{
+  //get parcel angle
+  const ParcelAngle* pa = m_angleTable.find(parcel.m_id);
+
+  double angle = pa ? pa->m_angle : 0.;
+
+  //create parcel lines
+  createParcelLines(parcel.m_geom, parcel.m_id, (int)parcelIdx, angle, state);
+
+  createTrackLines(state);
+}
+
+void te::qt::plugins::tv5plugins::ForestMonitor::setCentroidDataSet(std::auto_ptr<te::da::DataSet> ds, int geomIdx, int idIdx)
 {
   assert(ds.get());
 
-  //create tree
-  tree.clear();
-  te::common::FreeContents(geomMap);
+  //create centroid store and index, the index uses the centroid dense index as id
+  m_centroidIndex = CreatePointIndex(m_indexType, m_distance);
+  m_centroids.clear();
+  m_centroids.reserve(ds->size());
 
   ds->moveBeforeFirst();
 
@@ -144,119 +458,155 @@ void te::qt::plugins::tv5plugins::ForestMonitor::createRTree(te::sam::rtree::Ind
 
     int id = atoi(strId.c_str());
 
-    te::gm::Geometry* g = ds->getGeometry(geomIdx).release();
-    const te::gm::Envelope* box = g->getMBR();
+    std::auto_ptr<te::gm::Geometry> g = ds->getGeometry(geomIdx);
 
-    tree.insert(*box, id);
+    std::size_t idx;
 
-    geomMap.insert(std::map<int, te::gm::Geometry*>::value_type(id, g));
+    if(!m_centroids.add(id, g.get(), idx))
+      continue;
+
+    double x = m_centroids.getX(idx);
+    double y = m_centroids.getY(idx);
+
+    m_centroidIndex->insert(x, y, (int)idx);
   }
+
+  m_centroidIndex->build(m_nThreads);
 }
 
-void te::qt::plugins::tv5plugins::ForestMonitor::createParcelLines(te::gm::Geometry* parcelGeom, int parcelId, std::vector<int> centroidsIdx, double angle)
+void te::qt::plugins::tv5plugins::ForestMonitor::setAngleDataSet(std::auto_ptr<te::da::DataSet> ds, int geomIdx, int idIdx)
 {
-  assert(parcelGeom);
+  assert(ds.get());
 
-  for(std::size_t t = 0; t < centroidsIdx.size(); ++t)
-  {
-    int centroidId = centroidsIdx[t];
+  te::common::FreeContents(m_angleGeomMap);
+  m_angleGeomMap.clear();
 
-    std::set<int>::iterator it = m_usedCentroids.find(centroidId);
+  m_angleTable.clear();
 
-    if(it != m_usedCentroids.end())
-      continue;
+  //read the direction lines, they are joined with the parcels by createAngleTable
+  ds->moveBeforeFirst();
 
-    //add as used centroid
-    m_usedCentroids.insert(centroidId);
+  while(ds->moveNext())
+  {
+    std::string strId = ds->getAsString(idIdx);
+
+    int id = atoi(strId.c_str());
 
-    createParcelLine(parcelGeom, parcelId, centroidsIdx, angle, centroidId);
+    te::gm::Geometry* g = ds->getGeometry(geomIdx).release();
+
+    if(!m_angleGeomMap.insert(std::map<int, te::gm::Geometry*>::value_type(id, g)).second)
+      delete g;
   }
 }
 
-void te::qt::plugins::tv5plugins::ForestMonitor::createParcelLine(te::gm::Geometry* parcelGeom, int parcelId, std::vector<int> centroidsIdx, double angle, int centroidId)
+void te::qt::plugins::tv5plugins::ForestMonitor::createAngleTable(const std::vector<ParcelInfo>& parcels, std::size_t nThreads)
 {
-  std::set<int>::iterator itIgnored = m_ignoredCentroids.find(centroidId);
+  std::vector<std::pair<int, te::gm::Geometry*> > parcelGeoms(parcels.size());
 
-  if(itIgnored != m_ignoredCentroids.end())
-    return;
+  for(std::size_t t = 0; t < parcels.size(); ++t)
+    parcelGeoms[t] = std::make_pair(parcels[t].m_id, parcels[t].m_geom);
 
-  bool newSeg = false;
-  int newId;
+  m_angleTable.build(parcelGeoms, m_angleGeomMap, TE_UNKNOWN_SRS, nThreads);
 
-  std::map<int, te::gm::Geometry*>::iterator it = m_centroidGeomMap.find(centroidId);
+  //the tracks only read the table
+  te::common::FreeContents(m_angleGeomMap);
+  m_angleGeomMap.clear();
+}
 
-  if(it != m_centroidGeomMap.end())
-  {
-    te::gm::Geometry* centroid = it->second;
+void te::qt::plugins::tv5plugins::ForestMonitor::createParcelLines(te::gm::Geometry* parcelGeom, int parcelId, int parcelIdx, double angle, ParcelState& state)
+{
+  assert(parcelGeom);
 
-    te::gm::MultiPoint* mFirst = dynamic_cast<te::gm::MultiPoint*>(centroid);
-    te::gm::Point* first = dynamic_cast<te::gm::Point*>(mFirst->getGeometryN(0));
+  const std::vector<int>& centroidsIdx = m_parcelCentroids[parcelIdx];
 
-    std::vector<int> centroids = getCentroidNeighborsCandidates(parcelGeom, angle, centroid);
+  //create the neighbor graph for all centroids of this parcel
+  buildNeighborGraph(parcelIdx, angle, state.m_graph);
 
-    std::map<double, std::pair<int, int> > anglesDiffs;
+  state.m_usedCentroids.assign(centroidsIdx.size(), 0);
+  state.m_ignoredCentroids.assign(centroidsIdx.size(), 0);
 
-    for(std::size_t p = 0; p < centroids.size(); ++p)
-    {
-      std::map<int, te::gm::Geometry*>::iterator itP = m_centroidGeomMap.find(centroids[p]);
+  for(std::size_t t = 0; t < centroidsIdx.size(); ++t)
+  {
+    if(state.m_usedCentroids[t])
+      continue;
 
-      te::gm::Geometry* c = itP->second;
+    //add as used centroid
+    state.m_usedCentroids[t] = 1;
 
-      if(centroid == c)
-        continue;
+    createParcelLine(parcelId, parcelGeom->getSRID(), angle, t, state);
+  }
+}
 
-      te::gm::MultiPoint* mLast = dynamic_cast<te::gm::MultiPoint*>(c);
-      te::gm::Point* last = dynamic_cast<te::gm::Point*>(mLast->getGeometryN(0));
+void te::qt::plugins::tv5plugins::ForestMonitor::createParcelLine(int parcelId, int parcelSRID, double angle, std::size_t centroidIdx, ParcelState& state)
+{
+  const NeighborGraph& graph = state.m_graph;
 
-      double a = getAngle(first, last);
-      double angleDiff = abs(angle - a);
+  std::size_t current = centroidIdx;
 
-      std::pair<int, int> pair(centroidId, centroids[p]);
+  //walk over the neighbor graph following the line
+  while(!state.m_ignoredCentroids[current])
+  {
+    std::map<double, std::size_t> anglesDiffs;
+
+    for(std::size_t e = graph.m_offsets[current]; e < graph.m_offsets[current + 1]; ++e)
+    {
+      const NeighborEdge& edge = graph.m_edges[e];
 
-      anglesDiffs.insert(std::map<double, std::pair<int, int> >::value_type(angleDiff, pair));
+      if(!edge.m_candidate)
+      {
+        state.m_ignoredCentroids[edge.m_target] = 1;
+      }
+      else if(!state.m_ignoredCentroids[edge.m_target] && !state.m_usedCentroids[edge.m_target])
+      {
+        anglesDiffs.insert(std::map<double, std::size_t>::value_type(edge.m_angleDiff, edge.m_target));
+      }
     }
 
-    //get line with minimum distance
-    double minDist = std::numeric_limits<double>::max();
+    //get line with minimum angle difference
+    double minDiff = std::numeric_limits<double>::max();
 
-    std::pair<int, int> pairTrack;
+    std::size_t next = current;
 
-    std::map<double, std::pair<int, int> >::iterator itAngles = anglesDiffs.begin();
+    std::map<double, std::size_t>::iterator itAngles = anglesDiffs.begin();
 
     while(itAngles != anglesDiffs.end())
     {
-      if(itAngles->first != 0. && itAngles->first < minDist)
+      if(itAngles->first != 0. && itAngles->first < minDiff)
       {
-        minDist = itAngles->first;
-        pairTrack = itAngles->second;
+        minDiff = itAngles->first;
+        next = itAngles->second;
       }
 
       ++itAngles;
     }
 
+    bool newSeg = false;
+
     //add to track map
-    if(minDist != std::numeric_limits<double>::max())
+    if(minDiff != std::numeric_limits<double>::max())
     {
-      std::map<int, TrackPair>::iterator itTrackMap = m_trackMap.find(pairTrack.second);
+      int firstId = graph.m_centroids[current];
+      int lastId = graph.m_centroids[next];
 
-      if(itTrackMap != m_trackMap.end())
+      std::map<int, TrackPair>::iterator itTrackMap = state.m_trackMap.find(lastId);
+
+      if(itTrackMap != state.m_trackMap.end())
       {
-        itTrackMap->second.m_startCentroids.insert(pairTrack.first);
+        itTrackMap->second.m_startCentroids.insert(firstId);
       }
       else
       {
         TrackPair tp;
         tp.m_parcelId = parcelId;
         tp.m_parcelAngle = angle;
-        tp.m_parcelSRID = parcelGeom->getSRID();
-        tp.m_startCentroids.insert(pairTrack.first);
+        tp.m_parcelSRID = parcelSRID;
+        tp.m_startCentroids.insert(firstId);
 
-        m_trackMap.insert(std::map<int, TrackPair>::value_type(pairTrack.second, tp));
+        state.m_trackMap.insert(std::map<int, TrackPair>::value_type(lastId, tp));
 
-        m_usedCentroids.insert(pairTrack.second);
+        state.m_usedCentroids[next] = 1;
 
         newSeg = true;
-        newId = pairTrack.second;
       }
     }
 
@@ -265,184 +615,108 @@ void te::qt::plugins::tv5plugins::ForestMonitor::createParcelLine(te::gm::Geomet
 
     while(itAngles != anglesDiffs.end())
     {
-      if(itAngles->second.second != newId)
+      if(!newSeg || itAngles->second != next)
       {
-        m_ignoredCentroids.insert(itAngles->second.second);
+        state.m_ignoredCentroids[itAngles->second] = 1;
       }
-     
+
       ++itAngles;
     }
 
-    anglesDiffs.clear();
-  }
+    if(!newSeg)
+      break;
 
-  //recursive... used to continue the line
-  if(newSeg)
-    createParcelLine(parcelGeom, parcelId, centroidsIdx, angle, newId);
+    //continue the line
+    current = next;
+  }
 }
 
-std::vector<int> te::qt::plugins::tv5plugins::ForestMonitor::getParcelCentroids(te::gm::Geometry* geom)
+void te::qt::plugins::tv5plugins::ForestMonitor::buildNeighborGraph(int parcelIdx, double angle, NeighborGraph& graph)
 {
-  assert(geom);
+  const std::vector<int>& centroidsIdx = m_parcelCentroids[parcelIdx];
 
-  te::gm::Envelope ext(*geom->getMBR());
+  std::size_t size = centroidsIdx.size();
 
-  std::vector<int> resultsTree;
+  graph.m_centroids = centroidsIdx;
+  graph.m_offsets.assign(size + 1, 0);
+  graph.m_edges.clear();
 
-  std::vector<int> resultsContains;
+  double minDist = m_distance - m_distTol;
+  double maxDist = m_distance + m_distTol;
 
-  m_centroidRtree.search(ext, resultsTree);
+  std::vector<int> resultsTree;
 
-  for(size_t t = 0; t < resultsTree.size(); ++t)
+  for(std::size_t t = 0; t < size; ++t)
   {
-    std::map<int, te::gm::Geometry*>::iterator it = m_centroidGeomMap.find(resultsTree[t]);
+    graph.m_offsets[t] = graph.m_edges.size();
 
-    if(it != m_centroidGeomMap.end())
-    {
-      if(geom->contains(it->second))
-      {
-        resultsContains.push_back(resultsTree[t]);
-      }
-    }
-  }
+    double x = m_centroids.getX(centroidsIdx[t]);
+    double y = m_centroids.getY(centroidsIdx[t]);
 
-  return resultsContains;
-}
+    resultsTree.clear();
 
-std::vector<int> te::qt::plugins::tv5plugins::ForestMonitor::getCentroidNeighborsCandidates(te::gm::Geometry* parcelGeom, double angle, te::gm::Geometry* centroidGeom)
-{
-  assert(parcelGeom && centroidGeom);
+    m_centroidIndex->search(createCentroidBox(x, y), resultsTree);
 
-  std::vector<int> resultsTree;
+    //neighbors with the same angle difference are chosen by edge order, make it independent of the index type
+    std::sort(resultsTree.begin(), resultsTree.end());
 
-  std::vector<int> resultsContains;
+    for(std::size_t r = 0; r < resultsTree.size(); ++r)
+    {
+      //only centroids inside the parcel are part of the graph
+      if(m_centroidLabels[resultsTree[r]] != parcelIdx)
+        continue;
 
-  te::gm::Envelope ext = createCentroidBox(centroidGeom);
+      double xCandidate = m_centroids.getX(resultsTree[r]);
+      double yCandidate = m_centroids.getY(resultsTree[r]);
 
-  m_centroidRtree.search(ext, resultsTree);
+      double dx = xCandidate - x;
+      double dy = yCandidate - y;
 
-  for(size_t t = 0; t < resultsTree.size(); ++t)
-  {
-    std::map<int, te::gm::Geometry*>::iterator it = m_centroidGeomMap.find(resultsTree[t]);
+      double dist = std::sqrt((dx * dx) + (dy * dy));
 
-    if(it != m_centroidGeomMap.end())
-    {
-      //check if centroid is inside parcel
-      if(parcelGeom->contains(it->second))
-      {
-        //check distance
-        double minDist = m_distance - m_distTol;
-        double maxDist = m_distance + m_distTol;
+      NeighborEdge edge;
+      edge.m_target = m_centroidLocalIdx[resultsTree[r]];
+      edge.m_candidate = false;
+      edge.m_angleDiff = 0.;
 
-        double dist = centroidGeom->distance(it->second);
+      if(dist > minDist && dist < maxDist)
+      {
+        double a = getAngle(x, y, xCandidate, yCandidate);
 
-        if(dist > minDist && dist < maxDist)
+        //check angle
+        if(centroidsSameTrack(x, y, xCandidate, yCandidate, angle))
         {
-          te::gm::MultiPoint* mFirst = dynamic_cast<te::gm::MultiPoint*>(centroidGeom);
-          te::gm::Point* first = dynamic_cast<te::gm::Point*>(mFirst->getGeometryN(0));
-
-          te::gm::MultiPoint* mLast = dynamic_cast<te::gm::MultiPoint*>(it->second);
-          te::gm::Point* last = dynamic_cast<te::gm::Point*>(mLast->getGeometryN(0));
-
-          //check angle
-          if(centroidsSameTrack(first, last, angle))
-          {
-            //check if is not ignored or used
-            std::set<int>::iterator itIgnored = m_ignoredCentroids.find(resultsTree[t]);
-            std::set<int>::iterator itUsed = m_usedCentroids.find(resultsTree[t]);
-
-            if(itIgnored == m_ignoredCentroids.end() && itUsed == m_usedCentroids.end())
-            {
-              resultsContains.push_back(resultsTree[t]);
-            }
-          }
-          else
-          {
-            //check inverted angle
-            double a = getAngle(first, last);
-
-            bool ignore = true;
-
-            //case 1
-            double minus180a = angle - 180 - m_tolAngle;
-            double minus180b = angle - 180 + m_tolAngle;
-
-            if(a > minus180a && a < minus180b)
-              ignore = false;
-
-            //case 2
-            double plus180a = angle + 180 - m_tolAngle;
-            double plus180b = angle + 180 + m_tolAngle;
-
-            if(a > plus180a && a < plus180b)
-              ignore = false;
-             
-
-            if(ignore)
-              m_ignoredCentroids.insert(resultsTree[t]);
-          }
+          edge.m_candidate = true;
+          edge.m_angleDiff = std::fabs(angle - a);
         }
-        else if(dist < minDist && dist != 0.)
+        else
         {
-          m_ignoredCentroids.insert(resultsTree[t]);
+          //check inverted angle, centroids in the opposite direction are not ignored
+          if(a > angle - 180 - m_tolAngle && a < angle - 180 + m_tolAngle)
+            continue;
+
+          if(a > angle + 180 - m_tolAngle && a < angle + 180 + m_tolAngle)
+            continue;
         }
       }
-      else
+      else if(!(dist < minDist && dist != 0.))
       {
-        m_ignoredCentroids.insert(resultsTree[t]);
+        continue;
       }
-    }
-  }
-
-  return resultsContains;
-}
-
-double te::qt::plugins::tv5plugins::ForestMonitor::getParcelLineAngle(te::gm::Geometry* geom)
-{
-  assert(geom);
-
-  te::gm::Envelope ext(*geom->getMBR());
-
-  std::vector<int> results;
-
-  m_angleRtree.search(ext, results);
-
-  for(size_t t = 0; t < results.size(); ++t)
-  {
-    std::map<int, te::gm::Geometry*>::iterator it = m_angleGeomMap.find(results[t]);
 
-    if(it != m_angleGeomMap.end())
-    {
-      if(geom->contains(it->second))
-      {
-        te::gm::MultiLineString* mLine = dynamic_cast<te::gm::MultiLineString*>(it->second);
-
-        if(mLine && mLine->getNumGeometries() != 0)
-        {
-          te::gm::LineString* line = dynamic_cast<te::gm::LineString*>(mLine->getGeometryN(0));
-
-          assert(line && line->size() == 2);
-
-          std::auto_ptr<te::gm::Point> first(line->getPointN(0));
-          std::auto_ptr<te::gm::Point> last(line->getPointN(1));
-
-          return getAngle(first.get(), last.get());
-        }
-      }
+      graph.m_edges.push_back(edge);
     }
   }
 
-  return 0.;
+  graph.m_offsets[size] = graph.m_edges.size();
 }
 
-bool te::qt::plugins::tv5plugins::ForestMonitor::centroidsSameTrack(te::gm::Point* first, te::gm::Point* last, double parcelAngle)
+bool te::qt::plugins::tv5plugins::ForestMonitor::centroidsSameTrack(double x0, double y0, double x1, double y1, double parcelAngle)
 {
-  assert(first && last);
-
-  double angle = getAngle(first, last);
+  double angle = getAngle(x0, y0, x1, y1);
 
   //check tolerance
-  double absDiff = abs(parcelAngle - angle);
+  double absDiff = std::fabs(parcelAngle - angle);
 
   if(absDiff > m_tolAngle)
     return false;
@@ -452,33 +726,17 @@ bool te::qt::plugins::tv5plugins::ForestMonitor::centroidsSameTrack(te::gm::Poin
 
 double te::qt::plugins::tv5plugins::ForestMonitor::getAngle(te::gm::Point* first, te::gm::Point* last)
 {
-  double dx = last->getX() - first->getX();
-  double ax = fabs(dx);
-  double dy = last->getY() - first->getY();
-  double ay = fabs(dy);
-
-  double t = 0.0;
-
-  if((dx == 0.0) && (dy == 0.0))
-    t = 0.0;
-  else
-    t = dy / (ax + ay);
-
-  if(dx < 0.0)
-    t = 2 - t;
-  else if(dy < 0.0)
-    t = 4.0 + t;
-
-  double angle = t * 90.0;
-
-  return angle;
+  return getAngle(first->getX(), first->getY(), last->getX(), last->getY());
 }
 
-te::gm::Envelope te::qt::plugins::tv5plugins::ForestMonitor::createCentroidBox(te::gm::Geometry* geom)
+double te::qt::plugins::tv5plugins::ForestMonitor::getAngle(double x0, double y0, double x1, double y1)
 {
-  assert(geom);
+  return GetDirectionAngle(x0, y0, x1, y1);
+}
 
-  te::gm::Envelope ext(*geom->getMBR());
+te::gm::Envelope te::qt::plugins::tv5plugins::ForestMonitor::createCentroidBox(double x, double y)
+{
+  te::gm::Envelope ext(x, y, x, y);
 
   ext.m_llx -= m_distance - m_distTol;
   ext.m_lly -= m_distance - m_distTol;
@@ -488,30 +746,56 @@ te::gm::Envelope te::qt::plugins::tv5plugins::ForestMonitor::createCentroidBox(t
   return ext;
 }
 
-void te::qt::plugins::tv5plugins::ForestMonitor::saveTrackLines()
+void te::qt::plugins::tv5plugins::ForestMonitor::createTrackLines(ParcelState& state)
 {
-  checkConsistency();
+  checkConsistency(state);
 
-  std::map<int, TrackPair>::iterator it =  m_trackMap.begin();
+  std::map<int, TrackPair>::iterator it =  state.m_trackMap.begin();
 
-  while(it != m_trackMap.end())
+  while(it != state.m_trackMap.end())
   {
-    int parcelId = it->second.m_parcelId;
+    //get centroid start and last
+    int first = *it->second.m_startCentroids.begin();
+    int last = it->first;
+
+    TrackLine tl;
+    tl.m_parcelId = it->second.m_parcelId;
+    tl.m_srid = it->second.m_parcelSRID;
+    tl.m_x0 = m_centroids.getX(first);
+    tl.m_y0 = m_centroids.getY(first);
+    tl.m_x1 = m_centroids.getX(last);
+    tl.m_y1 = m_centroids.getY(last);
+
+    state.m_lines.push_back(tl);
 
-    //get centroid start
-    std::map<int, te::gm::Geometry*>::iterator itCentroid = m_centroidGeomMap.find(*it->second.m_startCentroids.begin());
-    te::gm::MultiPoint* mFirst = dynamic_cast<te::gm::MultiPoint*>(itCentroid->second);
-    te::gm::Point* first = dynamic_cast<te::gm::Point*>(mFirst->getGeometryN(0));
+    ++it;
+  }
 
-    //get centroid last
-    itCentroid = m_centroidGeomMap.find(it->first);
-    te::gm::MultiPoint* mLast = dynamic_cast<te::gm::MultiPoint*>(itCentroid->second);
-    te::gm::Point* last = dynamic_cast<te::gm::Point*>(mLast->getGeometryN(0));
+  state.m_trackMap.clear();
+  state.m_ignoredCentroids.clear();
+  state.m_usedCentroids.clear();
+
+  state.m_graph.m_centroids.clear();
+  state.m_graph.m_offsets.clear();
+  state.m_graph.m_edges.clear();
+}
+
+void te::qt::plugins::tv5plugins::ForestMonitor::saveTrackLines(const ParcelState& state)
+{
+  for(std::size_t t = 0; t < state.m_lines.size(); ++t)
+  {
+    const TrackLine& tl = state.m_lines[t];
 
     //create line
-    te::gm::LineString* line = new te::gm::LineString(2, te::gm::LineStringType, it->second.m_parcelSRID);
-    line->setPoint(0, first->getX(), first->getY());
-    line->setPoint(1, last->getX(), last->getY());
+    te::gm::LineString* line = new te::gm::LineString(2, te::gm::LineStringType, tl.m_srid);
+    line->setPoint(0, tl.m_x0, tl.m_y0);
+    line->setPoint(1, tl.m_x1, tl.m_y1);
+
+    if(m_writer)
+    {
+      m_writer->add(m_count++, tl.m_parcelId, line);
+      continue;
+    }
 
     //create dataset item
     te::mem::DataSetItem* item = new te::mem::DataSetItem(m_ds);
@@ -520,7 +804,7 @@ void te::qt::plugins::tv5plugins::ForestMonitor::saveTrackLines()
     item->setInt32("trackId", m_count);
 
     //set parcel id
-    item->setInt32("parcelId", parcelId);
+    item->setInt32("parcelId", tl.m_parcelId);
 
     //set geometry
     item->setGeometry("geom", line);
@@ -528,23 +812,20 @@ void te::qt::plugins::tv5plugins::ForestMonitor::saveTrackLines()
     m_ds->add(item);
 
     ++m_count;
-
-    ++it;
   }
 }
 
-void te::qt::plugins::tv5plugins::ForestMonitor::checkConsistency()
+void te::qt::plugins::tv5plugins::ForestMonitor::checkConsistency(ParcelState& state)
 {
-  std::map<int, TrackPair>::iterator it =  m_trackMap.begin();
+  std::map<int, TrackPair>::iterator it =  state.m_trackMap.begin();
 
-  while(it != m_trackMap.end())
+  while(it != state.m_trackMap.end())
   {
     if(it->second.m_startCentroids.size() == 2)
     {
       //get last centroid
-      std::map<int, te::gm::Geometry*>::iterator itCentroid = m_centroidGeomMap.find(it->first);
-      te::gm::MultiPoint* mLast = dynamic_cast<te::gm::MultiPoint*>(itCentroid->second);
-      te::gm::Point* last = dynamic_cast<te::gm::Point*>(mLast->getGeometryN(0));
+      double xLast = m_centroids.getX(it->first);
+      double yLast = m_centroids.getY(it->first);
 
       //vector with angle diffs
       double minDiff = std::numeric_limits<double>::max();
@@ -555,14 +836,10 @@ void te::qt::plugins::tv5plugins::ForestMonitor::checkConsistency()
       std::set<int>::iterator itSet = it->second.m_startCentroids.begin();
       while(itSet != it->second.m_startCentroids.end())
       {
-        itCentroid = m_centroidGeomMap.find(*itSet);
-        te::gm::MultiPoint* mFirst = dynamic_cast<te::gm::MultiPoint*>(itCentroid->second);
-        te::gm::Point* first = dynamic_cast<te::gm::Point*>(mFirst->getGeometryN(0));
-
-        double angle = getAngle(first, last);
+        double angle = getAngle(m_centroids.getX(*itSet), m_centroids.getY(*itSet), xLast, yLast);
 
         //check tolerance
-        double absDiff = abs(it->second.m_parcelAngle - angle);
+        double absDiff = std::fabs(it->second.m_parcelAngle - angle);
 
         if(absDiff < minDiff)
         {
@@ -29,10 +29,20 @@
 #include <terralib/dataaccess/dataset/DataSet.h>
 #include <terralib/memory/DataSet.h>
 #include "../../Config.h"
+#include "CentroidStore.h"
+#include "ParcelAngleTable.h"
+#include "PointIndex.h"
 
 //STL Includes
 #include <memory>
 #include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Boost
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
 
 namespace te
 {
@@ -42,6 +52,9 @@ namespace te
     {
       namespace tv5plugins
       {
+        class TrackCache;
+        class TrackWriter;
+
         /*!
           \class ForestMonitor
           
@@ -60,6 +73,68 @@ namespace te
             std::set<int> m_startCentroids;
           };
 
+          /*! \brief Track line (start and end centroids) generated for a parcel. */
+          struct TrackLine
+          {
+            int m_parcelId;
+            int m_srid;
+            double m_x0;
+            double m_y0;
+            double m_x1;
+            double m_y1;
+          };
+
+          /*! \brief Parcel geometry and id read from the parcel data set. */
+          struct ParcelInfo
+          {
+            int m_id;
+            te::gm::Geometry* m_geom;
+          };
+
+          /*! \brief Edge from a centroid to a neighbor centroid of the same parcel. */
+          struct NeighborEdge
+          {
+            std::size_t m_target;       //!< Parcel local index of the neighbor centroid.
+            bool m_candidate;           //!< True if the neighbor may continue the line, false if it must be ignored.
+            double m_angleDiff;         //!< Difference between the parcel angle and the edge angle.
+          };
+
+          /*!
+            \brief Neighbor graph of the centroids from a parcel, in compressed row format.
+
+            The edges of the centroid with local index i are in [m_offsets[i], m_offsets[i + 1]).
+          */
+          struct NeighborGraph
+          {
+            std::vector<int> m_centroids;             //!< Centroid dense index for each local index.
+            std::vector<std::size_t> m_offsets;
+            std::vector<NeighborEdge> m_edges;
+          };
+
+          /*!
+            \brief Working state used to extract the tracks from a single parcel.
+
+            Each parcel is processed with its own state, so parcels can be processed
+            concurrently sharing only the read-only centroid and angle indexes.
+          */
+          struct ParcelState
+          {
+            std::map<int, TrackPair> m_trackMap;
+            std::vector<char> m_ignoredCentroids;     //!< Flags indexed by the parcel local index.
+            std::vector<char> m_usedCentroids;        //!< Flags indexed by the parcel local index.
+            NeighborGraph m_graph;
+            std::vector<TrackLine> m_lines;
+          };
+
+          /*! \brief Shared cursor used by the worker threads to get the next parcel to be processed. */
+          struct ParcelQueue
+          {
+            boost::mutex m_mutex;
+            std::size_t m_next;
+            std::size_t m_end;
+            std::string m_errorMessage;
+          };
+
           public:
 
             ForestMonitor(double tolAngle, double distance, double distTol, te::mem::DataSet* ds);
@@ -68,10 +143,35 @@ namespace te
 
           public:
 
+            /*!
+              \brief Defines the number of threads used to process the parcels.
+
+              \param nThreads Number of threads, 0 uses the number of hardware threads and 1 processes the parcels sequentially.
+            */
+            void setNumberOfThreads(std::size_t nThreads);
+
+            /*! \brief Defines the spatial index used for the centroid neighbor queries, the grid cell size is the planting distance. */
+            void setPointIndexType(PointIndexType type);
+
+            /*! \brief Sends the tracks to a writer instead of the memory data set given to the constructor. */
+            void setTrackWriter(TrackWriter* writer);
+
+            /*!
+              \brief Creates only the tracks of the parcels that changed since the execution that filled the cache.
+
+              \param cache        Cache updated with the hash of each parcel.
+              \param firstTrackId Id of the first track created, greater than the ids already in the output.
+            */
+            void setTrackCache(TrackCache* cache, int firstTrackId);
+
+            /*! \brief Creates the tracks, throws if the task is canceled, so no partial run is taken as complete. */
             void execute(std::auto_ptr<te::da::DataSet> parcelDs, int parcelGeomIdx, int parcelIdIdx,
                          std::auto_ptr<te::da::DataSet> angleDs, int angleGeomIdx, int angleIdIdx,
                          std::auto_ptr<te::da::DataSet> centroidDs, int centroidGeomIdx, int centroidIdIdx);
 
+            /*! \brief Name and duration in seconds of each stage of the last execution. */
+            const std::vector<std::pair<std::string, double> >& getStageTimes() const;
+
           protected:
 
             void setParcelDataSet(std::auto_ptr<te::da::DataSet> ds, int geomIdx, int idIdx);
@@ -80,47 +180,71 @@ namespace te
 
             void setAngleDataSet(std::auto_ptr<te::da::DataSet> ds, int geomIdx, int idIdx);
 
-            void createRTree(te::sam::rtree::Index<int> &tree, std::map<int, te::gm::Geometry*> &geomMap, std::auto_ptr<te::da::DataSet> ds, int geomIdx, int idIdx);
+            /*! \brief Runs the worker function in nThreads threads and waits for all of them. */
+            void runWorkers(const boost::function<void ()>& worker, std::size_t nThreads);
+
+            /*! \brief Labels each centroid with the parcel that contains it, done once for all parcels. */
+            void labelCentroids(const std::vector<ParcelInfo>& parcels, std::size_t nThreads);
+
+            /*! \brief Worker function, gets the centroids inside each parcel from the queue. */
+            void labelParcels(const std::vector<ParcelInfo>& parcels, std::vector<std::vector<int> >& members, ParcelQueue& queue);
+
+            /*! \brief Hashes the inputs of each parcel and keeps only the parcels that changed, releasing the others. */
+            void selectChangedParcels(std::vector<ParcelInfo>& parcels);
+
+            /*! \brief Worker function, gets parcels from the queue until it is empty. */
+            void processParcels(std::vector<ParcelInfo>& parcels, std::vector<ParcelState>& states, std::size_t begin, ParcelQueue& queue);
 
-            void createParcelLines(te::gm::Geometry* parcelGeom, int parcelId, std::vector<int> centroidsIdx, double angle);
+            void processParcel(const ParcelInfo& parcel, std::size_t parcelIdx, ParcelState& state);
 
-            void createParcelLine(te::gm::Geometry* parcelGeom, int parcelId, std::vector<int> centroidsIdx, double angle, int centroidId);
+            void createParcelLines(te::gm::Geometry* parcelGeom, int parcelId, int parcelIdx, double angle, ParcelState& state);
 
-            std::vector<int> getParcelCentroids(te::gm::Geometry* geom);
+            /*! \brief Follows the line that starts at the given centroid (parcel local index) over the neighbor graph. */
+            void createParcelLine(int parcelId, int parcelSRID, double angle, std::size_t centroidIdx, ParcelState& state);
 
-            std::vector<int> getCentroidNeighborsCandidates(te::gm::Geometry* parcelGeom, double angle, te::gm::Geometry* centroidGeom);
+            /*! \brief Creates, in one pass, the neighbors (distance and angle candidates) of all centroids from a parcel. */
+            void buildNeighborGraph(int parcelIdx, double angle, NeighborGraph& graph);
 
-            double getParcelLineAngle(te::gm::Geometry* geom);
+            /*! \brief Joins the parcels with the direction lines, the lines are released after the join. */
+            void createAngleTable(const std::vector<ParcelInfo>& parcels, std::size_t nThreads);
 
-            bool centroidsSameTrack(te::gm::Point* first, te::gm::Point* last, double parcelAngle);
+            bool centroidsSameTrack(double x0, double y0, double x1, double y1, double parcelAngle);
 
             double getAngle(te::gm::Point* first, te::gm::Point* last);
 
-            te::gm::Envelope createCentroidBox(te::gm::Geometry* geom);
+            double getAngle(double x0, double y0, double x1, double y1);
 
-            void saveTrackLines();
+            te::gm::Envelope createCentroidBox(double x, double y);
 
-            void checkConsistency();
+            void createTrackLines(ParcelState& state);
+
+            void saveTrackLines(const ParcelState& state);
+
+            void checkConsistency(ParcelState& state);
 
           protected:
 
-            te::sam::rtree::Index<int> m_centroidRtree;
-            std::map<int, te::gm::Geometry*> m_centroidGeomMap;
+            std::auto_ptr<PointIndex> m_centroidIndex;        //!< Centroid index, indexed by the centroid dense index.
+            PointIndexType m_indexType;
+            CentroidStore m_centroids;                        //!< Centroid ids and coordinates.
+            std::vector<int> m_centroidLabels;                //!< Parcel index of each centroid (-1 if outside all parcels).
+            std::vector<std::size_t> m_centroidLocalIdx;      //!< Position of each centroid in its parcel centroid list.
+            std::vector<std::vector<int> > m_parcelCentroids; //!< Centroids of each parcel.
 
-            te::sam::rtree::Index<int> m_angleRtree;
-            std::map<int, te::gm::Geometry*> m_angleGeomMap;
+            std::map<int, te::gm::Geometry*> m_angleGeomMap;  //!< Direction lines, kept only until the angle table is built.
+            ParcelAngleTable m_angleTable;                    //!< Row direction of each parcel.
 
             double m_tolAngle;
             double m_distance;
             double m_distTol;
 
             te::mem::DataSet* m_ds;
+            TrackWriter* m_writer;
+            TrackCache* m_cache;
 
-            std::map<int, TrackPair> m_trackMap;
-
-            std::set<int> m_ignoredCentroids;
+            std::size_t m_nThreads;
 
-            std::set<int> m_usedCentroids;
+            std::vector<std::pair<std::string, double> > m_stageTimes;
 
             int m_count;
         };
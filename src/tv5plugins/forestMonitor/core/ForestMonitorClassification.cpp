@@ -33,11 +33,13 @@
 #include <terralib/dataaccess/datasource/DataSourceManager.h>
 #include <terralib/dataaccess/datasource/DataSourceFactory.h>
 #include <terralib/dataaccess/utils/Utils.h>
+#include <terralib/datatype/Enums.h>
 #include <terralib/datatype/SimpleProperty.h>
 #include <terralib/datatype/StringProperty.h>
 #include <terralib/geometry/GeometryProperty.h>
 #include <terralib/geometry/MultiPoint.h>
 #include <terralib/geometry/MultiPolygon.h>
+#include <terralib/geometry/Point.h>
 #include <terralib/geometry/Utils.h>
 #include <terralib/memory/DataSet.h>
 #include <terralib/memory/DataSetItem.h>
@@ -47,19 +49,125 @@
 #include <terralib/raster/Raster.h>
 #include <terralib/raster/RasterFactory.h>
 #include <terralib/raster/Utils.h>
+#include "../../PackedRTree.h"
+#include "BinaryMorphology.h"
+#include "ConnectedComponents.h"
 #include "ForestMonitorClassification.h"
+#include "RasterBlock.h"
 
 //STL Includes
+#include <algorithm>
 #include <cassert>
 
 // Boost
+#include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/uuid/random_generator.hpp>
 #include <boost/uuid/uuid_io.hpp>
 
+//bytes of the worker buffers for each pixel of a threshold window (values and raw block)
+#define THRESHOLD_BYTES_PER_PIXEL 16
+
+//bytes of the buffers for each pixel of a mask raster window (values and raw block)
+#define MASK_RASTER_BYTES_PER_PIXEL 2
+
+namespace
+{
+  /*!
+    \brief Packs the threshold of the raster windows into the mask.
+
+    The windows start at multiples of 64 columns, so each one writes its own words of the mask rows.
+  */
+  class ThresholdKernel
+  {
+    public:
+
+      ThresholdKernel(const te::rst::Band* band, double threshold, te::qt::plugins::tv5plugins::BinaryMask& mask,
+                      std::size_t nThreads, std::size_t windowSize) :
+        m_band(band),
+        m_threshold(threshold),
+        m_mask(mask),
+        m_byteBand(band->getProperty()->m_type == te::dt::UCHAR_TYPE),
+        m_workers(nThreads)
+      {
+        for(std::size_t t = 0; t < m_workers.size(); ++t)
+        {
+          if(m_byteBand)
+            m_workers[t].m_bytes.resize(windowSize);
+          else
+            m_workers[t].m_values.resize(windowSize);
+        }
+      }
+
+      void process(std::size_t worker, const te::qt::plugins::tv5plugins::RasterBlock& window)
+      {
+        WorkerData& data = m_workers[worker];
+
+        {
+          boost::mutex::scoped_lock lock(m_ioMutex);
+
+          if(m_byteBand)
+            te::qt::plugins::tv5plugins::ReadWindow(m_band, window.m_col, window.m_row, window.m_width, window.m_height, data.m_raw, data.m_blockBytes, &data.m_bytes[0]);
+          else
+            te::qt::plugins::tv5plugins::ReadWindow(m_band, window.m_col, window.m_row, window.m_width, window.m_height, data.m_raw, data.m_blockValues, &data.m_values[0]);
+        }
+
+        std::size_t firstWord = window.m_col / te::qt::plugins::tv5plugins::BinaryMask::WORD_BITS;
+
+        for(unsigned int r = 0; r < window.m_height; ++r)
+        {
+          te::qt::plugins::tv5plugins::BinaryMask::Word* bits = m_mask.getRow(window.m_row + r) + firstWord;
+
+          std::size_t offset = (std::size_t)r * window.m_width;
+
+          if(m_byteBand)
+            te::qt::plugins::tv5plugins::ThresholdBits(&data.m_bytes[offset], window.m_width, m_threshold, bits);
+          else
+            te::qt::plugins::tv5plugins::ThresholdBits(&data.m_values[offset], window.m_width, m_threshold, bits);
+        }
+      }
+
+    protected:
+
+      struct WorkerData
+      {
+        std::vector<unsigned char> m_raw;
+        std::vector<double> m_blockValues;
+        std::vector<double> m_values;
+        std::vector<unsigned char> m_blockBytes;
+        std::vector<unsigned char> m_bytes;
+      };
+
+      const te::rst::Band* m_band;
+      double m_threshold;
+      te::qt::plugins::tv5plugins::BinaryMask& m_mask;
+      bool m_byteBand;                                    //!< The UCHAR bands are compared without conversion.
+      std::vector<WorkerData> m_workers;
+      boost::mutex m_ioMutex;
+  };
+}
+
 std::auto_ptr<te::rst::Raster> te::qt::plugins::tv5plugins::GenerateFilterRaster(te::rst::Raster* raster, int band, int nIter,
   te::rp::Filter::InputParameters::FilterType fType, std::string type, std::map<std::string, std::string> rinfo)
 {
+  //binary morphology on the packed mask, the positive pixels are foreground
+  if(fType == te::rp::Filter::InputParameters::DilationFilterT || fType == te::rp::Filter::InputParameters::ErosionFilterT)
+  {
+    std::auto_ptr<BinaryMask> mask = GenerateThresholdMask(raster, band, 0.);
+
+    mask->invert();
+
+    BinaryMorphology morphology;
+
+    if(fType == te::rp::Filter::InputParameters::DilationFilterT)
+      morphology.dilate(*mask, nIter);
+    else
+      morphology.erode(*mask, nIter);
+
+    return GenerateMaskRaster(*mask, raster, band, type, rinfo);
+  }
+
   std::auto_ptr<te::rst::Raster> rasterOut;
 
   te::rp::Filter algorithmInstance;
@@ -89,41 +197,80 @@ std::auto_ptr<te::rst::Raster> te::qt::plugins::tv5plugins::GenerateFilterRaster
 std::auto_ptr<te::rst::Raster> te::qt::plugins::tv5plugins::GenerateThresholdRaster(te::rst::Raster* raster, int band, double value,
   std::string type, std::map<std::string, std::string> rinfo)
 {
+  std::auto_ptr<BinaryMask> mask = GenerateThresholdMask(raster, band, value);
+
+  return GenerateMaskRaster(*mask, raster, band, type, rinfo);
+}
+
+std::auto_ptr<te::qt::plugins::tv5plugins::BinaryMask> te::qt::plugins::tv5plugins::GenerateThresholdMask(te::rst::Raster* raster, int band, double value,
+  std::size_t nThreads, std::size_t memoryBudget)
+{
+  assert(raster);
+
+  unsigned int nCols = raster->getNumberOfColumns();
+  unsigned int nRows = raster->getNumberOfRows();
+
+  std::auto_ptr<BinaryMask> mask(new BinaryMask(nCols, nRows));
+
+  const te::rst::Band* inBand = raster->getBand(band);
+
+  //the windows are aligned to the mask words
+  std::vector<RasterBlock> windows = GetBudgetWindows(inBand, nCols, nRows, memoryBudget, THRESHOLD_BYTES_PER_PIXEL, nThreads, BinaryMask::WORD_BITS);
+
+  ThresholdKernel kernel(inBand, value, *mask, nThreads, GetMaxWindowSize(windows));
+
+  ProcessRasterBlocks(windows, boost::bind(&ThresholdKernel::process, &kernel, _1, _2), nThreads, "Generating Threshold Mask");
+
+  return mask;
+}
+
+std::auto_ptr<te::rst::Raster> te::qt::plugins::tv5plugins::GenerateMaskRaster(const BinaryMask& mask, te::rst::Raster* reference, int band,
+  std::string type, std::map<std::string, std::string> rinfo)
+{
+  assert(reference);
+  assert(mask.getWidth() == reference->getNumberOfColumns() && mask.getHeight() == reference->getNumberOfRows());
+
   std::auto_ptr<te::rst::Raster> rasterOut;
 
   //create raster out
   std::vector<te::rst::BandProperty*> bandsProperties;
   te::rst::BandProperty* bandProp = new te::rst::BandProperty(0, te::dt::UCHAR_TYPE);
-  bandProp->m_nblocksx = raster->getBand(band)->getProperty()->m_nblocksx;
-  bandProp->m_nblocksy = raster->getBand(band)->getProperty()->m_nblocksy;
-  bandProp->m_blkh = raster->getBand(band)->getProperty()->m_blkh;
-  bandProp->m_blkw = raster->getBand(band)->getProperty()->m_blkw;
+  bandProp->m_nblocksx = reference->getBand(band)->getProperty()->m_nblocksx;
+  bandProp->m_nblocksy = reference->getBand(band)->getProperty()->m_nblocksy;
+  bandProp->m_blkh = reference->getBand(band)->getProperty()->m_blkh;
+  bandProp->m_blkw = reference->getBand(band)->getProperty()->m_blkw;
   bandsProperties.push_back(bandProp);
 
-  te::rst::Grid* grid = new te::rst::Grid(*(raster->getGrid()));
+  te::rst::Grid* grid = new te::rst::Grid(*(reference->getGrid()));
 
   te::rst::Raster* rOut = te::rst::RasterFactory::make(type, grid, bandsProperties, rinfo);
 
   rasterOut.reset(rOut);
 
-  //fill threshold raster
-  for (unsigned int i = 0; i < raster->getNumberOfRows(); ++i)
+  //fill mask raster, unpacking a window at a time
+  te::rst::Band* outBand = rasterOut->getBand(0);
+
+  std::size_t nThreads = 1;
+
+  std::vector<RasterBlock> windows = GetBudgetWindows(outBand, mask.getWidth(), mask.getHeight(), 0, MASK_RASTER_BYTES_PER_PIXEL, nThreads);
+
+  std::vector<unsigned char> raw;
+  std::vector<unsigned char> blockValues;
+  std::vector<unsigned char> values(GetMaxWindowSize(windows));
+  std::vector<unsigned char> rowValues(mask.getWidth());
+
+  for(std::size_t w = 0; w < windows.size(); ++w)
   {
-    for (unsigned int j = 0; j < raster->getNumberOfColumns(); ++j)
-    {
-      double curValue;
+    const RasterBlock& window = windows[w];
 
-      raster->getValue(j, i, curValue);
+    for(unsigned int r = 0; r < window.m_height; ++r)
+    {
+      mask.getRowValues(window.m_row + r, &rowValues[0]);
 
-      if (curValue <= value)
-      {
-        rasterOut->setValue(j, i, 255.);
-      }
-      else
-      {
-        rasterOut->setValue(j, i, 0.);
-      }
+      std::copy(rowValues.begin() + window.m_col, rowValues.begin() + window.m_col + window.m_width, values.begin() + (std::size_t)r * window.m_width);
     }
+
+    WriteWindow(outBand, window.m_col, window.m_row, window.m_width, window.m_height, raw, blockValues, &values[0]);
   }
 
   return rasterOut;
@@ -191,6 +338,39 @@ void te::qt::plugins::tv5plugins::ExtractCentroids(std::vector<te::gm::Geometry*
   }
 }
 
+void te::qt::plugins::tv5plugins::ExtractCentroids(const BinaryMask& mask, const te::rst::Grid* grid, std::vector<CentroidInfo*>& centroids, int parcelId,
+                                                   std::size_t nThreads)
+{
+  assert(grid);
+
+  ConnectedComponents components;
+  components.setNumberOfThreads(nThreads);
+  components.execute(mask);
+
+  const std::vector<BlobInfo>& blobs = components.getBlobs();
+
+  double pixelArea = grid->getResolutionX() * grid->getResolutionY();
+
+  for(std::size_t t = 0; t < blobs.size(); ++t)
+  {
+    const BlobInfo& blob = blobs[t];
+
+    double x = 0.;
+    double y = 0.;
+
+    grid->gridToGeo(blob.m_sumCol / (double)blob.m_count, blob.m_sumRow / (double)blob.m_count, x, y);
+
+    te::qt::plugins::tv5plugins::CentroidInfo* ci = new te::qt::plugins::tv5plugins::CentroidInfo();
+
+    ci->m_point = new te::gm::Point(x, y, grid->getSRID());
+    ci->m_area = (double)blob.m_count * pixelArea;
+    ci->m_parentId = parcelId;
+    ci->type = te::qt::plugins::tv5plugins::FOREST_UNKNOWN;
+
+    centroids.push_back(ci);
+  }
+}
+
 void te::qt::plugins::tv5plugins::AssociateObjects(te::map::AbstractLayer* layer, std::vector<te::qt::plugins::tv5plugins::CentroidInfo*>& points, int srid)
 {
   std::auto_ptr<te::da::DataSet> dataSet = layer->getData();
@@ -440,7 +620,7 @@ void te::qt::plugins::tv5plugins::ClearData(te::map::AbstractLayerPtr layer)
 
   ds->moveBeforeFirst();
 
-  te::sam::rtree::Index<int> rtree;
+  te::qt::plugins::tv5plugins::PackedRTree rtree;
 
   struct CentroidInfo
   {
@@ -485,6 +665,9 @@ void te::qt::plugins::tv5plugins::ClearData(te::map::AbstractLayerPtr layer)
     centroidInfoMap.insert(std::map<int, CentroidInfo>::value_type(id, ci));
   }
 
+  //pack the tree with all envelopes
+  rtree.build();
+
   //get all elements and check into rtree
   std::set<int> rightValues;
 
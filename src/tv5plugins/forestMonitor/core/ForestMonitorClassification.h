@@ -29,6 +29,7 @@
 #include <terralib/maptools/AbstractLayer.h>
 #include <terralib/rp/Filter.h>
 #include "../../Config.h"
+#include "BinaryMask.h"
 
 //STL Includes
 #include <map>
@@ -36,7 +37,11 @@
 
 namespace te
 {
-  namespace rst { class Raster; }
+  namespace rst
+  {
+    class Grid;
+    class Raster;
+  }
 
   namespace qt
   {
@@ -61,12 +66,31 @@ namespace te
 
 
 
+        /*!
+          \brief Filters the band nIter times with a 3x3 window.
+
+          The dilation and erosion are done by BinaryMorphology on the mask of the positive pixels,
+          giving a raster of 255 (foreground) and 0, the other filters use te::rp::Filter.
+        */
         std::auto_ptr<te::rst::Raster> GenerateFilterRaster(te::rst::Raster* raster, int band, int nIter, te::rp::Filter::InputParameters::FilterType fType,
                                                             std::string type, std::map<std::string, std::string> rinfo);
 
+        /*! \brief Thresholds the band as a raster of 255 (value <= threshold) and 0, see GenerateThresholdMask. */
         std::auto_ptr<te::rst::Raster> GenerateThresholdRaster(te::rst::Raster* raster, int band, double value,
                                                                std::string type, std::map<std::string, std::string> rinfo);
 
+        /*!
+          \brief Thresholds the band into a packed mask, the pixels with value <= threshold are foreground.
+
+          The band is read in windows of whole blocks, processed by nThreads (0 means the hardware threads)
+          using at most memoryBudget bytes (0 uses the default budget).
+        */
+        std::auto_ptr<BinaryMask> GenerateThresholdMask(te::rst::Raster* raster, int band, double value, std::size_t nThreads = 0, std::size_t memoryBudget = 0);
+
+        /*! \brief Creates a UCHAR raster of 255 (foreground) and 0 from the mask, with the grid and the block layout of the reference band. */
+        std::auto_ptr<te::rst::Raster> GenerateMaskRaster(const BinaryMask& mask, te::rst::Raster* reference, int band,
+                                                          std::string type, std::map<std::string, std::string> rinfo);
+
 
         void ExportRaster(te::rst::Raster* rasterIn, std::string fileName);
 
@@ -74,6 +98,15 @@ namespace te
 
         void ExtractCentroids(std::vector<te::gm::Geometry*>& geomVec, std::vector<CentroidInfo*>& centroids, int parcelId);
 
+        /*!
+          \brief Appends a centroid for each blob (4-connected foreground pixels) of the mask, without building polygons.
+
+          The centroid is the mean of the blob pixel centers and the area is the number of pixels
+          times the pixel area, the mask pixels are the grid cells. See ConnectedComponents.
+        */
+        void ExtractCentroids(const BinaryMask& mask, const te::rst::Grid* grid, std::vector<CentroidInfo*>& centroids, int parcelId,
+                              std::size_t nThreads = 1);
+
         void AssociateObjects(te::map::AbstractLayer* layer, std::vector<te::qt::plugins::tv5plugins::CentroidInfo*>& points, int srid);
 
         void ExportVector(std::vector<te::qt::plugins::tv5plugins::CentroidInfo*>& ciVec, std::string dataSetName, std::string dsType, std::map<std::string, std::string> connInfo, int srid);
@@ -24,21 +24,41 @@
 
 
 //TerraLib Includes
+#include <terralib/common/Exception.h>
+#include <terralib/dataaccess/dataset/ObjectId.h>
+#include <terralib/dataaccess/dataset/ObjectIdSet.h>
+#include <terralib/dataaccess/datasource/DataSourceTransactor.h>
 #include <terralib/dataaccess/utils/Utils.h>
+#include <terralib/datatype/SimpleData.h>
 #include <terralib/datatype/SimpleProperty.h>
 #include <terralib/geometry/GeometryProperty.h>
-#include <terralib/memory/DataSet.h>
 #include "ForestMonitorService.h"
 #include "ForestMonitor.h"
+#include "TrackCache.h"
+#include "TrackWriter.h"
 
 //STL Includes
 #include <cassert>
+#include <cstdlib>
 #include <exception>
 
+// Boost
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+//default number of tracks saved by each output transaction
+#define TRACK_CHUNK_SIZE 10000
+
+//suffix of the data set with the parcel hashes used by the incremental execution
+#define TRACK_CACHE_SUFFIX "_cache"
+
 te::qt::plugins::tv5plugins::ForestMonitorService::ForestMonitorService() :
   m_angleTol(0.),
   m_centroidDist(0.),
   m_distTol(0.),
+  m_nThreads(0),
+  m_indexType(GRID_POINT_INDEX),
+  m_chunkSize(TRACK_CHUNK_SIZE),
+  m_incremental(false),
   m_outputDataSetName("")
 {
 }
@@ -65,6 +85,27 @@ void te::qt::plugins::tv5plugins::ForestMonitorService::setInputParameters(te::m
   m_distTol = distanceTol;
 }
 
+void te::qt::plugins::tv5plugins::ForestMonitorService::setInputParameters(te::da::DataSourcePtr centroidDs, const std::string& centroidDataSetName,
+                                                                           te::da::DataSourcePtr parcelDs, const std::string& parcelDataSetName,
+                                                                           te::da::DataSourcePtr angleDs, const std::string& angleDataSetName,
+                                                                           double angleTol, double centroidDist, double distanceTol)
+{
+  m_centroidDs = centroidDs;
+  m_centroidDataSetName = centroidDataSetName;
+
+  m_parcelDs = parcelDs;
+  m_parcelDataSetName = parcelDataSetName;
+
+  m_angleDs = angleDs;
+  m_angleDataSetName = angleDataSetName;
+
+  m_angleTol = angleTol;
+
+  m_centroidDist = centroidDist;
+
+  m_distTol = distanceTol;
+}
+
 void te::qt::plugins::tv5plugins::ForestMonitorService::setOutputParameters(te::da::DataSourcePtr ds, std::string outputDataSetName)
 {
   m_ds = ds;
@@ -72,62 +113,152 @@ void te::qt::plugins::tv5plugins::ForestMonitorService::setOutputParameters(te::
   m_outputDataSetName = outputDataSetName;
 }
 
+void te::qt::plugins::tv5plugins::ForestMonitorService::setNumberOfThreads(std::size_t nThreads)
+{
+  m_nThreads = nThreads;
+}
+
+void te::qt::plugins::tv5plugins::ForestMonitorService::setPointIndexType(PointIndexType type)
+{
+  m_indexType = type;
+}
+
+void te::qt::plugins::tv5plugins::ForestMonitorService::setChunkSize(std::size_t chunkSize)
+{
+  m_chunkSize = chunkSize;
+}
+
+void te::qt::plugins::tv5plugins::ForestMonitorService::setIncremental(bool incremental)
+{
+  m_incremental = incremental;
+}
+
 void te::qt::plugins::tv5plugins::ForestMonitorService::runService()
 {
   //check input parameters
   checkParameters();
 
+  m_stageTimes.clear();
+
+  boost::posix_time::ptime start = boost::posix_time::microsec_clock::local_time();
+
   //get input data
-  std::auto_ptr<te::da::DataSet> parcelDataSet = m_parcelLayer->getData();
-  std::auto_ptr<te::da::DataSetType> parcelDsType = m_parcelLayer->getSchema();
+  std::auto_ptr<te::da::DataSet> parcelDataSet;
+  std::auto_ptr<te::da::DataSetType> parcelDsType;
+  getInputData(m_parcelLayer, m_parcelDs, m_parcelDataSetName, parcelDataSet, parcelDsType);
   int parcelIdIdx, parcelGeomIdx;
   getDataSetTypeInfo(parcelDsType.get(), parcelIdIdx, parcelGeomIdx);
 
-  std::auto_ptr<te::da::DataSet> angleDataSet = m_angleLayer->getData();
-  std::auto_ptr<te::da::DataSetType> angleDsType = m_angleLayer->getSchema();
+  std::auto_ptr<te::da::DataSet> angleDataSet;
+  std::auto_ptr<te::da::DataSetType> angleDsType;
+  getInputData(m_angleLayer, m_angleDs, m_angleDataSetName, angleDataSet, angleDsType);
   int angleIdIdx, angleGeomIdx;
   getDataSetTypeInfo(angleDsType.get(), angleIdIdx, angleGeomIdx);
 
-  std::auto_ptr<te::da::DataSet> centroidDataSet = m_centroidLayer->getData();
-  std::auto_ptr<te::da::DataSetType> centroidDsType = m_centroidLayer->getSchema();
+  std::auto_ptr<te::da::DataSet> centroidDataSet;
+  std::auto_ptr<te::da::DataSetType> centroidDsType;
+  getInputData(m_centroidLayer, m_centroidDs, m_centroidDataSetName, centroidDataSet, centroidDsType);
   int centroidIdIdx, centroidGeomIdx;
   getDataSetTypeInfo(centroidDsType.get(), centroidIdIdx, centroidGeomIdx);
 
   //get srid
-  int srid = getParcelSRID();
+  int srid = getParcelSRID(parcelDsType.get());
+
+  //incremental execution, keep the tracks of the parcels that did not change
+  std::string cacheName = m_outputDataSetName + TRACK_CACHE_SUFFIX;
+
+  bool append = m_incremental && m_ds->dataSetExists(m_outputDataSetName) && m_ds->dataSetExists(cacheName);
 
-  //create output dataset
-  std::auto_ptr<te::da::DataSetType> dsType = createDataSetType(srid);
+  TrackCache cache;
+  std::map<int, std::vector<int> > parcelTracks;
+  int nextTrackId = 0;
 
-  std::auto_ptr<te::mem::DataSet> ds(new te::mem::DataSet(dsType.get()));
+  if(append)
+  {
+    cache.load(m_ds, cacheName);
+
+    getOutputTracks(parcelTracks, nextTrackId);
+  }
+
+  //create output dataset, the tracks are saved in chunks while they are created
+  std::auto_ptr<TrackWriter> writer(new TrackWriter(m_ds, createDataSetType(srid), m_chunkSize, append));
+
+  boost::posix_time::ptime inputDone = boost::posix_time::microsec_clock::local_time();
+
+  m_stageTimes.push_back(std::make_pair(std::string("Input"), (inputDone - start).total_milliseconds() / 1000.));
 
   //generate tracks
-  te::qt::plugins::tv5plugins::ForestMonitor fm(m_angleTol, m_centroidDist, m_distTol,ds.get());
+  te::qt::plugins::tv5plugins::ForestMonitor fm(m_angleTol, m_centroidDist, m_distTol, 0);
+
+  fm.setTrackWriter(writer.get());
+
+  if(m_incremental)
+    fm.setTrackCache(&cache, nextTrackId);
+
+  fm.setNumberOfThreads(m_nThreads);
+
+  fm.setPointIndexType(m_indexType);
+
+  boost::posix_time::ptime tracksDone;
+
+  try
+  {
+    //a canceled run throws before the cache is saved, the parcels it did not finish stay changed for the next run
+    fm.execute(parcelDataSet, parcelGeomIdx, parcelIdIdx, 
+               angleDataSet, angleGeomIdx, angleIdIdx, 
+               centroidDataSet, centroidGeomIdx, centroidIdIdx);
+
+    m_stageTimes.insert(m_stageTimes.end(), fm.getStageTimes().begin(), fm.getStageTimes().end());
+
+    tracksDone = boost::posix_time::microsec_clock::local_time();
+
+    //save the last chunk and wait for the pending ones
+    writer->finish();
+  }
+  catch(...)
+  {
+    //a new output left partial is removed, without the cache the next run could not append to it
+    writer.reset();
+
+    if(!append && m_ds->dataSetExists(m_outputDataSetName))
+      m_ds->dropDataSet(m_outputDataSetName);
+
+    throw;
+  }
+
+  //remove the old tracks of the changed parcels and save the new hashes
+  if(append)
+    removeTracks(cache.getStaleParcels(), parcelTracks);
 
-  fm.execute(parcelDataSet, parcelGeomIdx, parcelIdIdx, 
-             angleDataSet, angleGeomIdx, angleIdIdx, 
-             centroidDataSet, centroidGeomIdx, centroidIdIdx);
+  if(m_incremental)
+    cache.save(m_ds, cacheName);
 
-  //save output information
-  saveDataSet(ds.get(), dsType.get());
+  boost::posix_time::ptime outputDone = boost::posix_time::microsec_clock::local_time();
+
+  m_stageTimes.push_back(std::make_pair(std::string("Output"), (outputDone - tracksDone).total_milliseconds() / 1000.));
+}
+
+const std::vector<std::pair<std::string, double> >& te::qt::plugins::tv5plugins::ForestMonitorService::getStageTimes() const
+{
+  return m_stageTimes;
 }
 
 void te::qt::plugins::tv5plugins::ForestMonitorService::checkParameters()
 {
-  if(!m_centroidLayer.get())
-    throw std::exception("Centroid Layer not defined.");
+  if(!m_centroidLayer.get() && (!m_centroidDs.get() || m_centroidDataSetName.empty()))
+    throw te::common::Exception("Centroid Layer not defined.");
 
-  if(!m_parcelLayer.get())
-    throw std::exception("Parcel Layer not defined.");
+  if(!m_parcelLayer.get() && (!m_parcelDs.get() || m_parcelDataSetName.empty()))
+    throw te::common::Exception("Parcel Layer not defined.");
 
-  if(!m_angleLayer.get())
-    throw std::exception("Angle Layer not defined.");
+  if(!m_angleLayer.get() && (!m_angleDs.get() || m_angleDataSetName.empty()))
+    throw te::common::Exception("Angle Layer not defined.");
 
   if(!m_ds.get())
-    throw std::exception("Data Source not defined.");
+    throw te::common::Exception("Data Source not defined.");
 
   if(m_outputDataSetName.empty())
-    throw std::exception("Data Source name not defined.");
+    throw te::common::Exception("Data Source name not defined.");
 }
 
 std::auto_ptr<te::da::DataSetType> te::qt::plugins::tv5plugins::ForestMonitorService::createDataSetType(int srid)
@@ -154,21 +285,6 @@ std::auto_ptr<te::da::DataSetType> te::qt::plugins::tv5plugins::ForestMonitorSer
   return dsType;
 }
 
-void te::qt::plugins::tv5plugins::ForestMonitorService::saveDataSet(te::mem::DataSet* dataSet, te::da::DataSetType* dsType)
-{
-  assert(dataSet);
-  assert(dsType);
-
-  //save dataset
-  dataSet->moveBeforeFirst();
-
-  std::map<std::string, std::string> options;
-
-  m_ds->createDataSet(dsType, options);
-
-  m_ds->add(m_outputDataSetName, dataSet, options);
-}
-
 void te::qt::plugins::tv5plugins::ForestMonitorService::getDataSetTypeInfo(te::da::DataSetType* dsType, int& idIdx, int& geomIdx)
 {
   //geom property info
@@ -188,13 +304,29 @@ void te::qt::plugins::tv5plugins::ForestMonitorService::getDataSetTypeInfo(te::d
   }
 }
 
-int te::qt::plugins::tv5plugins::ForestMonitorService::getParcelSRID()
+void te::qt::plugins::tv5plugins::ForestMonitorService::getInputData(te::map::AbstractLayerPtr layer, te::da::DataSourcePtr ds, const std::string& dataSetName,
+                                                                     std::auto_ptr<te::da::DataSet>& dataSet, std::auto_ptr<te::da::DataSetType>& dsType)
 {
-  assert(m_parcelLayer);
+  if(layer.get())
+  {
+    dataSet = layer->getData();
+    dsType = layer->getSchema();
+  }
+  else
+  {
+    dataSet = ds->getDataSet(dataSetName, te::common::RANDOM);
+    dsType = ds->getDataSetType(dataSetName);
+  }
 
-  std::auto_ptr<te::da::DataSetType> parcelDsType = m_parcelLayer->getSchema();
+  if(!dataSet.get() || !dsType.get())
+    throw te::common::Exception("Error reading input data: " + dataSetName);
+}
 
-  te::gm::GeometryProperty* gmProp = te::da::GetFirstGeomProperty(parcelDsType.get());
+int te::qt::plugins::tv5plugins::ForestMonitorService::getParcelSRID(te::da::DataSetType* parcelDsType)
+{
+  assert(parcelDsType);
+
+  te::gm::GeometryProperty* gmProp = te::da::GetFirstGeomProperty(parcelDsType);
 
   int srid = 0;
 
@@ -205,3 +337,83 @@ int te::qt::plugins::tv5plugins::ForestMonitorService::getParcelSRID()
 
   return srid;
 }
+
+void te::qt::plugins::tv5plugins::ForestMonitorService::getOutputTracks(std::map<int, std::vector<int> >& parcelTracks, int& nextTrackId)
+{
+  std::auto_ptr<te::da::DataSet> dataSet = m_ds->getDataSet(m_outputDataSetName, te::common::FORWARDONLY);
+
+  if(!dataSet.get())
+    throw te::common::Exception("Error reading output data: " + m_outputDataSetName);
+
+  nextTrackId = 0;
+
+  dataSet->moveBeforeFirst();
+
+  while(dataSet->moveNext())
+  {
+    int trackId = atoi(dataSet->getAsString("trackId").c_str());
+    int parcelId = atoi(dataSet->getAsString("parcelId").c_str());
+
+    parcelTracks[parcelId].push_back(trackId);
+
+    if(trackId >= nextTrackId)
+      nextTrackId = trackId + 1;
+  }
+}
+
+void te::qt::plugins::tv5plugins::ForestMonitorService::removeTracks(const std::vector<int>& parcels, const std::map<int, std::vector<int> >& parcelTracks)
+{
+  std::auto_ptr<te::da::DataSetType> dsType = m_ds->getDataSetType(m_outputDataSetName);
+
+  std::size_t idPos = te::da::GetPropertyPos(dsType.get(), "trackId");
+
+  std::auto_ptr<te::da::DataSourceTransactor> transactor = m_ds->getTransactor();
+
+  transactor->begin();
+
+  try
+  {
+    //the tracks are removed in chunks to keep each restriction small
+    std::auto_ptr<te::da::ObjectIdSet> oids;
+
+    for(std::size_t p = 0; p < parcels.size(); ++p)
+    {
+      std::map<int, std::vector<int> >::const_iterator it = parcelTracks.find(parcels[p]);
+
+      if(it == parcelTracks.end())
+        continue;
+
+      for(std::size_t t = 0; t < it->second.size(); ++t)
+      {
+        if(!oids.get())
+        {
+          oids.reset(new te::da::ObjectIdSet);
+          oids->addProperty("trackId", idPos, te::dt::INT32_TYPE);
+        }
+
+        te::da::ObjectId* oid = new te::da::ObjectId;
+        oid->addValue(new te::dt::Int32(it->second[t]));
+
+        oids->add(oid);
+
+        if(oids->size() >= m_chunkSize)
+        {
+          transactor->remove(m_outputDataSetName, oids.get());
+
+          oids.reset();
+        }
+      }
+    }
+
+    if(oids.get())
+      transactor->remove(m_outputDataSetName, oids.get());
+
+    transactor->commit();
+  }
+  catch(...)
+  {
+    transactor->rollBack();
+
+    throw;
+  }
+}
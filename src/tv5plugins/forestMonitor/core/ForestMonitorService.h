@@ -40,12 +40,18 @@
 #include <terralib/dataaccess/datasource/DataSource.h>
 #include <terralib/maptools/AbstractLayer.h>
 #include "../../Config.h"
+#include "PointIndex.h"
+
+//STL Includes
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace te
 {
   //forward declarations
   namespace da  { class DataSetType; }
-  namespace mem { class DataSet; }
 
   namespace qt
   {
@@ -71,10 +77,36 @@ namespace te
                                     te::map::AbstractLayerPtr angleLayer,
                                     double angleTol, double centroidDist, double distanceTol);
 
+            /*! \brief Defines the inputs as data sets of data sources, used when there are no layers (batch execution). */
+            void setInputParameters(te::da::DataSourcePtr centroidDs, const std::string& centroidDataSetName,
+                                    te::da::DataSourcePtr parcelDs, const std::string& parcelDataSetName,
+                                    te::da::DataSourcePtr angleDs, const std::string& angleDataSetName,
+                                    double angleTol, double centroidDist, double distanceTol);
+
             void setOutputParameters(te::da::DataSourcePtr ds, std::string outputDataSetName);
 
+            /*! \brief Number of threads used to create the tracks (0 uses all hardware threads). */
+            void setNumberOfThreads(std::size_t nThreads);
+
+            /*! \brief Spatial index used for the centroid neighbor queries (grid by default). */
+            void setPointIndexType(PointIndexType type);
+
+            /*! \brief Number of tracks saved by each output transaction. */
+            void setChunkSize(std::size_t chunkSize);
+
+            /*!
+              \brief Creates again only the tracks of the parcels edited since the last execution.
+
+              The hash of each parcel is kept in the data set <output>_cache. If the output and the
+              cache exist, the tracks of the changed parcels are replaced and the others are kept.
+            */
+            void setIncremental(bool incremental);
+
             void runService();
 
+            /*! \brief Name and duration in seconds of each stage of the last execution. */
+            const std::vector<std::pair<std::string, double> >& getStageTimes() const;
+
           protected:
 
             void checkParameters();
@@ -82,12 +114,19 @@ namespace te
             /*! Function used to create the output dataset type */
             std::auto_ptr<te::da::DataSetType> createDataSetType(int srid);
 
-            /*! Function used to save the output dataset */
-            void saveDataSet(te::mem::DataSet* dataSet, te::da::DataSetType* dsType);
-
             void getDataSetTypeInfo(te::da::DataSetType* dsType, int& idIdx, int& geomIdx);
 
-            int getParcelSRID();
+            /*! Function used to get an input from its layer or, if the layer is not defined, from its data source */
+            void getInputData(te::map::AbstractLayerPtr layer, te::da::DataSourcePtr ds, const std::string& dataSetName,
+                              std::auto_ptr<te::da::DataSet>& dataSet, std::auto_ptr<te::da::DataSetType>& dsType);
+
+            int getParcelSRID(te::da::DataSetType* parcelDsType);
+
+            /*! Function used to get the track ids of each parcel from the existing output and the next free track id */
+            void getOutputTracks(std::map<int, std::vector<int> >& parcelTracks, int& nextTrackId);
+
+            /*! Function used to remove from the output the tracks of the given parcels */
+            void removeTracks(const std::vector<int>& parcels, const std::map<int, std::vector<int> >& parcelTracks);
 
           protected:
 
@@ -97,15 +136,37 @@ namespace te
 
             te::map::AbstractLayerPtr m_angleLayer;
 
+            te::da::DataSourcePtr m_centroidDs;               //!< Centroid data source, used when there is no centroid layer.
+
+            std::string m_centroidDataSetName;
+
+            te::da::DataSourcePtr m_parcelDs;                 //!< Parcel data source, used when there is no parcel layer.
+
+            std::string m_parcelDataSetName;
+
+            te::da::DataSourcePtr m_angleDs;                  //!< Angle data source, used when there is no angle layer.
+
+            std::string m_angleDataSetName;
+
             double m_angleTol;
 
             double m_centroidDist;
 
             double m_distTol;
 
+            std::size_t m_nThreads;                           //!< Number of threads used to create the tracks.
+
+            PointIndexType m_indexType;                       //!< Centroid spatial index type.
+
+            std::size_t m_chunkSize;                          //!< Number of tracks saved by each output transaction.
+
+            bool m_incremental;                               //!< If true only the tracks of the edited parcels are created.
+
             te::da::DataSourcePtr m_ds;                       //!< Pointer to the output datasource.
 
             std::string m_outputDataSetName;                  //!< Attribute that defines the output dataset name
+
+            std::vector<std::pair<std::string, double> > m_stageTimes;
         };
       } // end namespace thirdParty
     }   // end namespace plugins
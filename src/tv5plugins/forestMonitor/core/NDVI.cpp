@@ -29,155 +29,1317 @@
 #include <terralib/memory/ExpansibleRaster.h>
 #include <terralib/raster/BandProperty.h>
 #include <terralib/raster/Grid.h>
+#include <terralib/raster/Enums.h>
 #include <terralib/raster/Raster.h>
 #include <terralib/raster/RasterFactory.h>
 #include <terralib/raster/RasterIterator.h>
 #include "NDVI.h"
+#include "RasterBlock.h"
 
 //STL Includes
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <functional>
+#include <limits>
 #include <numeric>
+#include <sstream>
 
-std::auto_ptr<te::rst::Raster> te::qt::plugins::tv5plugins::GenerateNDVIRaster(te::rst::Raster* rasterNIR, int bandNIR, 
-                                                                               te::rst::Raster* rasterVIS, int bandVIS, 
-                                                                               double gain, double offset, bool normalize, 
-                                                                               std::map<std::string, std::string> rInfo,
-                                                                               std::string type, bool invert)
+// Boost
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+
+//maximum number of blocks read by the sampled range pre-pass
+#define NDVI_SAMPLE_BLOCKS 64
+
+//bytes of the buffers of a worker for each pixel of its window (nir, vis, band and output values)
+#define NDVI_BYTES_PER_PIXEL 32
+
+//bytes of the overview buffers for each pixel of the window (reduced, next and output level values, a quarter of the window each)
+#define NDVI_OVERVIEW_BYTES_PER_PIXEL 6
+
+//maximum number of overview levels, the NDVI windows are aligned to 2^levels pixels
+#define NDVI_MAX_OVERVIEWS 10
+
+//difference allowed between an overview value written by the NDVI pass and the value read back
+#define NDVI_OVERVIEW_TOLERANCE 1e-9
+
+//no data value of the DOUBLE output pixels out of the VIS raster, the normalized output uses 0
+#define NDVI_NO_DATA -9999.
+
+//tolerance, in pixels, used to compare the NIR and VIS grids
+#define NDVI_GRID_TOLERANCE 0.000001
+
+//maximum number of 8 bit visible bands of the table path, the table has 256 x (255 * bands + 1) entries
+#define NDVI_TABLE_MAX_VIS_BANDS 4
+
+namespace
 {
-  //check input parameters
-  if(!rasterNIR || ! rasterVIS)
+  /*! \brief Window of the VIS raster read for an output window, with the source position of each output column and row. */
+  struct SourceWindow
   {
-    throw te::common::Exception("Invalid input rasters.");
+    unsigned int m_col;
+    unsigned int m_row;
+    unsigned int m_width;
+    unsigned int m_height;
+    std::vector<unsigned int> m_col0;     //!< Source column of each output column, the left one if bilinear, relative to m_col.
+    std::vector<unsigned int> m_col1;     //!< Right source column if bilinear.
+    std::vector<double> m_wx;             //!< Weight of m_col1.
+    std::vector<unsigned int> m_row0;
+    std::vector<unsigned int> m_row1;
+    std::vector<double> m_wy;
+    std::vector<unsigned char> m_colInside;   //!< 1 if the output column is inside the VIS raster.
+    std::vector<unsigned char> m_rowInside;
+  };
+
+  /*! \brief True if the nearest pixel of the position is inside [0, n - 1]. */
+  bool IsInside(double position, unsigned int n)
+  {
+    double index = std::floor(position + 0.5);
+
+    return index >= 0. && index <= (double)(n - 1);
   }
 
-  if(rasterNIR->getNumberOfColumns() != rasterVIS->getNumberOfColumns() ||
-     rasterNIR->getNumberOfRows() != rasterVIS->getNumberOfRows())
+  /*! \brief Index of the pixel, clamped to [0, n - 1]. */
+  unsigned int ClampIndex(double index, unsigned int n)
   {
-    throw te::common::Exception("Incompatible rasters.");
+    if(index <= 0.)
+      return 0;
+
+    if(index >= (double)(n - 1))
+      return n - 1;
+
+    return (unsigned int)index;
   }
 
-  std::string typeNDVI = type;
+  /*!
+    \brief Source indices of count positions starting at first, the positions out of [0, n - 1] are clamped.
 
-  if(normalize)
-    typeNDVI = "MEM";
+    The indices are relative to start, the first source index, and size is the number of source indices used.
+    inside is 0 for the positions whose nearest pixel is out of [0, n - 1], their indices are only kept valid.
+  */
+  void GetSourceIndices(const std::vector<double>& positions, unsigned int first, unsigned int count, unsigned int n, bool bilinear,
+                        unsigned int& start, unsigned int& size, std::vector<unsigned int>& i0, std::vector<unsigned int>& i1, std::vector<double>& w,
+                        std::vector<unsigned char>& inside)
+  {
+    i0.resize(count);
+    i1.resize(count);
+    w.resize(count);
+    inside.resize(count);
 
-  //create raster out
-  std::vector<te::rst::BandProperty*> bandsProperties;
-  te::rst::BandProperty* bandProp = new te::rst::BandProperty(0, te::dt::DOUBLE_TYPE);
-  bandProp->m_nblocksx = rasterNIR->getBand(bandNIR)->getProperty()->m_nblocksx;
-  bandProp->m_nblocksy = rasterNIR->getBand(bandNIR)->getProperty()->m_nblocksy;
-  bandProp->m_blkh = rasterNIR->getBand(bandNIR)->getProperty()->m_blkh;
-  bandProp->m_blkw = rasterNIR->getBand(bandNIR)->getProperty()->m_blkw;
-  bandsProperties.push_back(bandProp);
+    unsigned int minIndex = n;
+    unsigned int maxIndex = 0;
 
-  te::rst::Grid* grid = new te::rst::Grid(*(rasterNIR->getGrid()));
+    for(unsigned int t = 0; t < count; ++t)
+    {
+      double position = positions[first + t];
 
-  te::rst::Raster* rasterNDVI = 0;
+      inside[t] = IsInside(position, n) ? 1 : 0;
 
-  if(normalize)
+      if(bilinear)
+      {
+        double f = std::floor(position);
+
+        i0[t] = ClampIndex(f, n);
+        i1[t] = ClampIndex(f + 1., n);
+        w[t] = position - f;
+      }
+      else
+      {
+        i0[t] = ClampIndex(std::floor(position + 0.5), n);
+        i1[t] = i0[t];
+        w[t] = 0.;
+      }
+
+      minIndex = std::min(minIndex, i0[t]);
+      maxIndex = std::max(maxIndex, i1[t]);
+    }
+
+    start = minIndex;
+    size = maxIndex - minIndex + 1;
+
+    for(unsigned int t = 0; t < count; ++t)
+    {
+      i0[t] -= start;
+      i1[t] -= start;
+    }
+  }
+
+  /*! \brief Samples the source window at the output positions, nearest or bilinear. */
+  template<class T, class V> void SampleSource(const T* src, const SourceWindow& sw, bool bilinear, unsigned int width, unsigned int height, V* out)
   {
-    rasterNDVI = new te::mem::ExpansibleRaster(10, grid, bandsProperties);
+    for(unsigned int r = 0; r < height; ++r)
+    {
+      const T* line0 = src + (std::size_t)sw.m_row0[r] * sw.m_width;
+      const T* line1 = src + (std::size_t)sw.m_row1[r] * sw.m_width;
+
+      V* outLine = out + (std::size_t)r * width;
+
+      if(!bilinear)
+      {
+        for(unsigned int c = 0; c < width; ++c)
+          outLine[c] = (V)line0[sw.m_col0[c]];
+
+        continue;
+      }
+
+      double wy = sw.m_wy[r];
+
+      for(unsigned int c = 0; c < width; ++c)
+      {
+        double wx = sw.m_wx[c];
+
+        double top = (double)line0[sw.m_col0[c]] + ((double)line0[sw.m_col1[c]] - (double)line0[sw.m_col0[c]]) * wx;
+        double bottom = (double)line1[sw.m_col0[c]] + ((double)line1[sw.m_col1[c]] - (double)line1[sw.m_col0[c]]) * wx;
 
+        outLine[c] = (V)(top + (bottom - top) * wy);
+      }
+    }
   }
-  else
+
+  /*!
+    \brief Position of the VIS pixels on the NIR grid, computed once for each NIR column and row.
+
+    The grids must have the same SRID and no rotation. The NIR pixels whose nearest VIS pixel is out of
+    the VIS raster are flagged by the source windows, they get no data.
+  */
+  class VISSampler
+  {
+    public:
+
+      VISSampler(const te::rst::Raster* rasterNIR, const te::rst::Raster* rasterVIS, bool bilinear) :
+        m_visCols(rasterVIS->getNumberOfColumns()), m_visRows(rasterVIS->getNumberOfRows()), m_bilinear(bilinear), m_identity(true), m_outside(false)
+      {
+        if(rasterNIR->getSRID() != rasterVIS->getSRID())
+        {
+          throw te::common::Exception("Incompatible rasters.");
+        }
+
+        const te::rst::Grid* nirGrid = rasterNIR->getGrid();
+        const te::rst::Grid* visGrid = rasterVIS->getGrid();
+
+        m_cols.resize(rasterNIR->getNumberOfColumns());
+        m_rows.resize(rasterNIR->getNumberOfRows());
+
+        double x = 0.;
+        double y = 0.;
+        double col = 0.;
+        double row = 0.;
+
+        for(std::size_t c = 0; c < m_cols.size(); ++c)
+        {
+          nirGrid->gridToGeo((double)c, 0., x, y);
+          visGrid->geoToGrid(x, y, m_cols[c], row);
+        }
+
+        for(std::size_t r = 0; r < m_rows.size(); ++r)
+        {
+          nirGrid->gridToGeo(0., (double)r, x, y);
+          visGrid->geoToGrid(x, y, col, m_rows[r]);
+        }
+
+        //the column must not depend on the row, and the row on the column
+        nirGrid->gridToGeo(0., 1., x, y);
+        visGrid->geoToGrid(x, y, col, row);
+
+        bool rotated = std::fabs(col - m_cols[0]) > NDVI_GRID_TOLERANCE;
+
+        nirGrid->gridToGeo(1., 0., x, y);
+        visGrid->geoToGrid(x, y, col, row);
+
+        rotated = rotated || std::fabs(row - m_rows[0]) > NDVI_GRID_TOLERANCE;
+
+        if(rotated)
+        {
+          throw te::common::Exception("Rotated rasters are not supported.");
+        }
+
+        m_identity = m_visCols == m_cols.size() && m_visRows == m_rows.size();
+
+        for(std::size_t c = 0; m_identity && c < m_cols.size(); ++c)
+          m_identity = std::fabs(m_cols[c] - (double)c) <= NDVI_GRID_TOLERANCE;
+
+        for(std::size_t r = 0; m_identity && r < m_rows.size(); ++r)
+          m_identity = std::fabs(m_rows[r] - (double)r) <= NDVI_GRID_TOLERANCE;
+
+        for(std::size_t c = 0; !m_identity && !m_outside && c < m_cols.size(); ++c)
+          m_outside = !IsInside(m_cols[c], m_visCols);
+
+        for(std::size_t r = 0; !m_identity && !m_outside && r < m_rows.size(); ++r)
+          m_outside = !IsInside(m_rows[r], m_visRows);
+      }
+
+      /*! \brief True if the VIS grid is the NIR grid, the VIS windows are read directly. */
+      bool isIdentity() const
+      {
+        return m_identity;
+      }
+
+      bool isBilinear() const
+      {
+        return m_bilinear && !m_identity;
+      }
+
+      /*! \brief True if some NIR pixels are out of the VIS raster. */
+      bool hasOutside() const
+      {
+        return m_outside;
+      }
+
+      /*! \brief Number of VIS pixels in the source window of each NIR pixel. */
+      double getPixelRatio() const
+      {
+        double colRatio = m_cols.size() > 1 ? std::fabs(m_cols.back() - m_cols.front()) / (double)(m_cols.size() - 1) : 1.;
+        double rowRatio = m_rows.size() > 1 ? std::fabs(m_rows.back() - m_rows.front()) / (double)(m_rows.size() - 1) : 1.;
+
+        return colRatio * rowRatio;
+      }
+
+      void getSourceWindow(const te::qt::plugins::tv5plugins::RasterBlock& window, SourceWindow& sw) const
+      {
+        GetSourceIndices(m_cols, window.m_col, window.m_width, m_visCols, m_bilinear, sw.m_col, sw.m_width, sw.m_col0, sw.m_col1, sw.m_wx, sw.m_colInside);
+        GetSourceIndices(m_rows, window.m_row, window.m_height, m_visRows, m_bilinear, sw.m_row, sw.m_height, sw.m_row0, sw.m_row1, sw.m_wy, sw.m_rowInside);
+      }
+
+    protected:
+
+      unsigned int m_visCols;
+      unsigned int m_visRows;
+      bool m_bilinear;
+      bool m_identity;
+      bool m_outside;
+      std::vector<double> m_cols;       //!< VIS column of each NIR column.
+      std::vector<double> m_rows;       //!< VIS row of each NIR row.
+  };
+
+  /*! \brief Buffers and partial results of a worker thread. */
+  struct BlockBuffers
   {
-    rasterNDVI = te::rst::RasterFactory::make(typeNDVI, grid, bandsProperties, rInfo);
+    std::vector<double> m_nir;
+    std::vector<double> m_vis;
+    std::vector<double> m_band;
+    std::vector<double> m_out;
+    std::vector<double> m_blockValues;
+    std::vector<unsigned char> m_raw;
+    std::vector<unsigned char> m_nirBytes;
+    std::vector<unsigned char> m_bandBytes;
+    std::vector<unsigned char> m_outBytes;
+    std::vector<unsigned char> m_blockBytes;
+    std::vector<unsigned int> m_visSum;
+    std::vector<double> m_source;
+    std::vector<unsigned char> m_sourceBytes;
+    std::vector<unsigned char> m_inside;      //!< 1 if the pixel of the window is inside the VIS raster, empty if all are.
+    SourceWindow m_sourceWindow;
+    std::vector<double> m_reduced;
+    std::vector<double> m_reducedNext;
+    std::vector<double> m_levelOut;
+    double m_min;
+    double m_max;
+  };
+
+  /*! \brief out[i] = table[nir[i] * stride + vis[i]]. */
+  template<class S, class T> void GatherTable(const unsigned char* nir, const S* vis, std::size_t size, std::size_t stride, const T* table, T* out)
+  {
+    for(std::size_t i = 0; i < size; ++i)
+      out[i] = table[nir[i] * stride + vis[i]];
   }
 
-  /*if(invert)
+  /*!
+    \brief 2x2 mean of a width x height buffer, the last column and row are repeated if the size is odd.
+
+    If hasNoData is true the noData values are left out of the mean, 4 noData values give noData.
+  */
+  template<class T> void ReduceHalf(const T* in, unsigned int width, unsigned int height, double* out, bool hasNoData, double noData)
   {
-    rasterNIR = InvertRaster(rasterNIR, bandNIR);
-    bandNIR = 0;
-  }*/
+    unsigned int outWidth = (width + 1) / 2;
+    unsigned int outHeight = (height + 1) / 2;
+
+    for(unsigned int r = 0; r < outHeight; ++r)
+    {
+      const T* line0 = in + (std::size_t)(2 * r) * width;
+      const T* line1 = in + (std::size_t)std::min(2 * r + 1, height - 1) * width;
+
+      double* outLine = out + (std::size_t)r * outWidth;
+
+      for(unsigned int c = 0; c < outWidth; ++c)
+      {
+        unsigned int c0 = 2 * c;
+        unsigned int c1 = std::min(c0 + 1, width - 1);
+
+        if(!hasNoData)
+        {
+          outLine[c] = ((double)line0[c0] + (double)line0[c1] + (double)line1[c0] + (double)line1[c1]) * 0.25;
+          continue;
+        }
+
+        double values[4] = { (double)line0[c0], (double)line0[c1], (double)line1[c0], (double)line1[c1] };
 
-  //start NDVI operation
-  std::size_t nRows = rasterNDVI->getNumberOfRows();
-  std::size_t nCols = rasterNDVI->getNumberOfColumns();
+        double sum = 0.;
+        int count = 0;
 
-  double nirValue = 0.;
-  double visValue = 0.;
+        for(int i = 0; i < 4; ++i)
+        {
+          if(values[i] != noData)
+          {
+            sum += values[i];
+            ++count;
+          }
+        }
 
-  double minValue = std::numeric_limits<double>::max();
-  double maxValue = -std::numeric_limits<double>::max();
+        outLine[c] = count > 0 ? sum / (double)count : noData;
+      }
+    }
+  }
 
+  /*! \brief True if the NDVI of the bands can be taken from the table of the 8 bit values. */
+  bool UseNDVITable(const te::rst::Band* nirBand, const te::rst::Raster* rasterVIS, const std::vector<std::size_t>& visBands, const VISSampler& sampler)
   {
-    te::common::TaskProgress task("Calculating NDVI.");
-    task.setTotalSteps(nRows);
+    if(nirBand->getProperty()->m_type != te::dt::UCHAR_TYPE || visBands.size() > NDVI_TABLE_MAX_VIS_BANDS || sampler.isBilinear())
+      return false;
 
-    for(std::size_t t = 0; t < nRows; ++t)
+    for(std::size_t v = 0; v < visBands.size(); ++v)
     {
-      if(task.isActive() == false)
-        throw te::common::Exception("Operation Canceled.");
+      if(rasterVIS->getBand(visBands[v])->getProperty()->m_type != te::dt::UCHAR_TYPE)
+        return false;
+    }
+
+    return true;
+  }
 
-      for(std::size_t q = 0; q < nCols; ++q)
+  /*! \brief Overview pixel as written, read back to check the levels. */
+  struct OverviewSample
+  {
+    unsigned int m_col;
+    unsigned int m_row;
+    double m_value;
+  };
+
+  /*!
+    \brief Writes the 2x2 mean reductions of each window into the overview levels (2x, 4x, ...).
+
+    The windows must be aligned to the coarsest level. The top left, center and bottom right
+    pixels of each window of each level are kept as written, to be read back after the pass.
+  */
+  class OverviewWriter
+  {
+    public:
+
+      OverviewWriter() :
+        m_round(false), m_hasNoData(false), m_noData(0.)
+      {
+      }
+
+      /*! \brief The level values are rounded if round is true, the noData values are left out of the means if hasNoData is true. */
+      void setLevels(const std::vector<te::rst::Raster*>& levels, bool round, bool hasNoData, double noData)
+      {
+        m_levels = levels;
+        m_round = round;
+        m_hasNoData = hasNoData;
+        m_noData = noData;
+        m_samples.assign(levels.size(), std::vector<OverviewSample>());
+      }
+
+      const std::vector<std::vector<OverviewSample> >& getSamples() const
+      {
+        return m_samples;
+      }
+
+      /*! \brief Reduces the window values into each level, the levels are written with ioMutex locked. */
+      template<class T> void write(BlockBuffers& b, const te::qt::plugins::tv5plugins::RasterBlock& window, const T* values, boost::mutex& ioMutex)
       {
-        try
+        unsigned int col = window.m_col;
+        unsigned int row = window.m_row;
+        unsigned int width = window.m_width;
+        unsigned int height = window.m_height;
+
+        for(std::size_t l = 0; l < m_levels.size(); ++l)
         {
-          rasterNIR->getValue(q, t, nirValue, bandNIR);
+          //each level is reduced from the previous one
+          std::size_t size = (std::size_t)((width + 1) / 2) * ((height + 1) / 2);
+
+          b.m_reducedNext.resize(size);
+
+          if(l == 0)
+            ReduceHalf(values, width, height, &b.m_reducedNext[0], m_hasNoData, m_noData);
+          else
+            ReduceHalf(&b.m_reduced[0], width, height, &b.m_reducedNext[0], m_hasNoData, m_noData);
+
+          b.m_reduced.swap(b.m_reducedNext);
+
+          col /= 2;
+          row /= 2;
+          width = (width + 1) / 2;
+          height = (height + 1) / 2;
+
+          b.m_levelOut.assign(b.m_reduced.begin(), b.m_reduced.begin() + size);
+
+          if(m_round)
+          {
+            for(std::size_t i = 0; i < size; ++i)
+              b.m_levelOut[i] = std::floor(b.m_levelOut[i] + 0.5);
+          }
+
+          boost::mutex::scoped_lock lock(ioMutex);
+
+          te::qt::plugins::tv5plugins::WriteWindow(m_levels[l]->getBand(0), col, row, width, height, b.m_raw, b.m_blockValues, &b.m_levelOut[0]);
+
+          addSample(l, b.m_levelOut, col, row, width, 0, 0);
+          addSample(l, b.m_levelOut, col, row, width, width / 2, height / 2);
+          addSample(l, b.m_levelOut, col, row, width, width - 1, height - 1);
+        }
+      }
+
+    protected:
+
+      /*! \brief Keeps the value at (c, r) of the level window at (col, row), the samples are added with the io mutex locked. */
+      void addSample(std::size_t level, const std::vector<double>& values, unsigned int col, unsigned int row, unsigned int width, unsigned int c, unsigned int r)
+      {
+        OverviewSample sample;
+        sample.m_col = col + c;
+        sample.m_row = row + r;
+        sample.m_value = values[(std::size_t)r * width + c];
+
+        m_samples[level].push_back(sample);
+      }
+
+    protected:
 
-          if (invert)
-            nirValue = (nirValue * (-1.)) + 255.;
+      std::vector<te::rst::Raster*> m_levels; //!< Overview levels, 2x, 4x, ...
+      bool m_round;
+      bool m_hasNoData;
+      double m_noData;
+      std::vector<std::vector<OverviewSample> > m_samples;  //!< Values read back to check the levels after the pass, by level.
+  };
 
-          std::vector<double> visValueVec;
+  /*!
+    \brief Computes the NDVI of a window of whole output blocks, the bands are read and written one window at a time.
 
-          rasterVIS->getValues(q, t, visValueVec);
+    If the bands are UCHAR the NDVI of each (nir, sum of the visible values) pair is computed once into a table,
+    with the invert applied, and each pixel is a table lookup. The normalized output has its own 8 bit table.
 
-          for (std::size_t a = 0; a < visValueVec.size() - 1; ++a)
+    The pixels out of the VIS raster are written as noData and left out of the range and of the overviews.
+  */
+  class NDVIKernel
+  {
+    public:
+
+      NDVIKernel(te::rst::Band* nirBand, te::rst::Raster* rasterVIS, const std::vector<std::size_t>& visBands, const VISSampler& sampler,
+                 te::rst::Band* ndviBand, double gain, double offset, bool invert, double noData, std::size_t windowSize, std::size_t nThreads) :
+        m_nirBand(nirBand), m_rasterVIS(rasterVIS), m_visBands(visBands), m_sampler(sampler), m_ndviBand(ndviBand),
+        m_gain(gain), m_offset(offset), m_invert(invert), m_noData(noData), m_normalize(false), m_normGain(1.), m_normOffset(0.), m_normMin(0.),
+        m_tableStride(0), m_buffers(nThreads)
+      {
+        bool useTable = UseNDVITable(nirBand, rasterVIS, visBands, sampler);
+
+        for(std::size_t t = 0; t < m_buffers.size(); ++t)
+        {
+          BlockBuffers& b = m_buffers[t];
+
+          if(useTable)
+          {
+            b.m_nirBytes.assign(windowSize, 0);
+            b.m_bandBytes.assign(windowSize, 0);
+
+            if(visBands.size() > 1)
+              b.m_visSum.assign(windowSize, 0);
+          }
+          else
           {
-            visValue += visValueVec[a];
+            b.m_nir.assign(windowSize, 0.);
+            b.m_vis.assign(windowSize, 0.);
+            b.m_band.assign(windowSize, 0.);
+            b.m_out.assign(windowSize, 0.);
           }
 
-          if (visValue != 0.)
-            visValue = visValue / (double)rasterVIS->getNumberOfBands() - 1;
-          
-          double value = 0.;
+          b.m_min = std::numeric_limits<double>::max();
+          b.m_max = -std::numeric_limits<double>::max();
+        }
+
+        if(useTable)
+          buildTable();
+      }
+
+      /*! \brief The output values are scaled by gain and offset and clamped to [nmin, 255], noData must be out of the range. */
+      void setNormalization(double gain, double offset, double nmin)
+      {
+        m_normalize = true;
+        m_normGain = gain;
+        m_normOffset = offset;
+        m_normMin = nmin;
+
+        //same clamp and conversion as the UCHAR band write
+        m_normTable.resize(m_table.size());
+
+        for(std::size_t i = 0; i < m_table.size(); ++i)
+          m_normTable[i] = (unsigned char)std::max(m_normMin, std::min(255., m_table[i] * m_normGain + m_normOffset));
+      }
+
+      /*!
+        \brief The 2x2 mean reductions of each window are written into the overview levels (2x, 4x, ...).
+
+        The windows must be aligned to the coarsest level, each worker reduces its own windows.
+        The level values are rounded if round is true.
+      */
+      void setOverviews(const std::vector<te::rst::Raster*>& levels, bool round)
+      {
+        m_overviews.setLevels(levels, round, m_sampler.hasOutside(), m_noData);
+      }
+
+      /*! \brief Overview pixels of each level as written, see OverviewWriter. */
+      const std::vector<std::vector<OverviewSample> >& getOverviewSamples() const
+      {
+        return m_overviews.getSamples();
+      }
+
+      void process(std::size_t worker, const te::qt::plugins::tv5plugins::RasterBlock& window)
+      {
+        if(!m_table.empty())
+        {
+          processTable(worker, window);
+          return;
+        }
+
+        BlockBuffers& b = m_buffers[worker];
+
+        std::size_t windowSize = (std::size_t)window.m_width * window.m_height;
+
+        {
+          boost::mutex::scoped_lock lock(m_ioMutex);
+
+          te::qt::plugins::tv5plugins::ReadWindow(m_nirBand, window.m_col, window.m_row, window.m_width, window.m_height,
+                                                  b.m_raw, b.m_blockValues, &b.m_nir[0]);
 
-          if(nirValue + visValue != 0.)
+          if(!m_sampler.isIdentity())
+          {
+            readSource(b, window, b.m_blockValues, b.m_source);
+          }
+          else if(m_visBands.size() == 1)
+          {
+            te::qt::plugins::tv5plugins::ReadWindow(m_rasterVIS->getBand(m_visBands[0]), window.m_col, window.m_row, window.m_width, window.m_height,
+                                                    b.m_raw, b.m_blockValues, &b.m_vis[0]);
+          }
+          else
           {
-            value = (gain *((nirValue - visValue) / (nirValue + visValue))) + offset;
+            std::fill(b.m_vis.begin(), b.m_vis.begin() + windowSize, 0.);
+
+            for(std::size_t v = 0; v < m_visBands.size(); ++v)
+            {
+              te::qt::plugins::tv5plugins::ReadWindow(m_rasterVIS->getBand(m_visBands[v]), window.m_col, window.m_row, window.m_width, window.m_height,
+                                                      b.m_raw, b.m_blockValues, &b.m_band[0]);
+
+              for(std::size_t i = 0; i < windowSize; ++i)
+                b.m_vis[i] += b.m_band[i];
+            }
           }
+        }
 
-          rasterNDVI->setValue(q, t, value, 0);
+        //co-registration, the visible bands are sampled on the NIR grid
+        if(!m_sampler.isIdentity())
+        {
+          std::size_t sourceSize = (std::size_t)b.m_sourceWindow.m_width * b.m_sourceWindow.m_height;
+
+          std::fill(b.m_vis.begin(), b.m_vis.begin() + windowSize, 0.);
 
-          if(value > maxValue)
+          for(std::size_t v = 0; v < m_visBands.size(); ++v)
           {
-            maxValue = value;
+            SampleSource(&b.m_source[v * sourceSize], b.m_sourceWindow, m_sampler.isBilinear(), window.m_width, window.m_height, &b.m_band[0]);
+
+            for(std::size_t i = 0; i < windowSize; ++i)
+              b.m_vis[i] += b.m_band[i];
           }
+        }
+
+        if(m_visBands.size() > 1)
+        {
+          for(std::size_t i = 0; i < windowSize; ++i)
+            b.m_vis[i] /= (double)m_visBands.size();
+        }
+
+        getInside(b, window);
 
-          if(value < minValue)
+        bool masked = !b.m_inside.empty();
+
+        for(std::size_t i = 0; i < windowSize; ++i)
+        {
+          if(masked && !b.m_inside[i])
           {
-            minValue = value;
+            b.m_out[i] = m_noData;
+            continue;
           }
+
+          double value = te::qt::plugins::tv5plugins::NDVIValue(b.m_nir[i], b.m_vis[i], m_gain, m_offset, m_invert);
+
+          if(value > b.m_max)
+            b.m_max = value;
+
+          if(value < b.m_min)
+            b.m_min = value;
+
+          if(m_normalize)
+            value = std::max(m_normMin, std::min(255., value * m_normGain + m_normOffset));
+
+          b.m_out[i] = value;
         }
-        catch (...)
+
+        //range only pass
+        if(!m_ndviBand)
+          return;
+
         {
-          continue;
+          boost::mutex::scoped_lock lock(m_ioMutex);
+
+          te::qt::plugins::tv5plugins::WriteWindow(m_ndviBand, window.m_col, window.m_row, window.m_width, window.m_height,
+                                                   b.m_raw, b.m_blockValues, &b.m_out[0]);
+        }
+
+        writeOverviews(b, window, &b.m_out[0]);
+      }
+
+      /*! \brief Merges the min and max values found by each worker. */
+      void getRange(double& minValue, double& maxValue) const
+      {
+        minValue = std::numeric_limits<double>::max();
+        maxValue = -std::numeric_limits<double>::max();
+
+        for(std::size_t t = 0; t < m_buffers.size(); ++t)
+        {
+          minValue = std::min(minValue, m_buffers[t].m_min);
+          maxValue = std::max(maxValue, m_buffers[t].m_max);
+        }
+      }
+
+    protected:
+
+      /*! \brief NDVI of each (nir, sum of the visible values) pair, the visible value is the mean as in process. */
+      void buildTable()
+      {
+        std::size_t nVis = m_visBands.size();
+
+        m_tableStride = 255 * nVis + 1;
+        m_table.resize(256 * m_tableStride);
+
+        for(std::size_t nir = 0; nir < 256; ++nir)
+        {
+          for(std::size_t sum = 0; sum < m_tableStride; ++sum)
+          {
+            double vis = nVis > 1 ? (double)sum / (double)nVis : (double)sum;
+
+            m_table[nir * m_tableStride + sum] = te::qt::plugins::tv5plugins::NDVIValue((double)nir, vis, m_gain, m_offset, m_invert);
+          }
         }
       }
 
-      task.pulse();
+      void processTable(std::size_t worker, const te::qt::plugins::tv5plugins::RasterBlock& window)
+      {
+        BlockBuffers& b = m_buffers[worker];
+
+        std::size_t windowSize = (std::size_t)window.m_width * window.m_height;
+
+        {
+          boost::mutex::scoped_lock lock(m_ioMutex);
+
+          te::qt::plugins::tv5plugins::ReadWindow(m_nirBand, window.m_col, window.m_row, window.m_width, window.m_height,
+                                                  b.m_raw, b.m_blockBytes, &b.m_nirBytes[0]);
+
+          if(!m_sampler.isIdentity())
+            readSource(b, window, b.m_blockBytes, b.m_sourceBytes);
+
+          for(std::size_t v = 0; m_sampler.isIdentity() && v < m_visBands.size(); ++v)
+          {
+            te::qt::plugins::tv5plugins::ReadWindow(m_rasterVIS->getBand(m_visBands[v]), window.m_col, window.m_row, window.m_width, window.m_height,
+                                                    b.m_raw, b.m_blockBytes, &b.m_bandBytes[0]);
+
+            addVISBytes(b, v, windowSize);
+          }
+        }
+
+        //co-registration, the visible bands are sampled on the NIR grid (nearest)
+        if(!m_sampler.isIdentity())
+        {
+          std::size_t sourceSize = (std::size_t)b.m_sourceWindow.m_width * b.m_sourceWindow.m_height;
+
+          for(std::size_t v = 0; v < m_visBands.size(); ++v)
+          {
+            SampleSource(&b.m_sourceBytes[v * sourceSize], b.m_sourceWindow, false, window.m_width, window.m_height, &b.m_bandBytes[0]);
+
+            addVISBytes(b, v, windowSize);
+          }
+        }
+
+        getInside(b, window);
+
+        //normalized output, written as UCHAR
+        if(m_ndviBand && m_normalize)
+        {
+          b.m_outBytes.resize(windowSize);
+
+          if(m_visBands.size() == 1)
+            GatherTable(&b.m_nirBytes[0], &b.m_bandBytes[0], windowSize, m_tableStride, &m_normTable[0], &b.m_outBytes[0]);
+          else
+            GatherTable(&b.m_nirBytes[0], &b.m_visSum[0], windowSize, m_tableStride, &m_normTable[0], &b.m_outBytes[0]);
+
+          setNoData(b, &b.m_outBytes[0]);
+
+          {
+            boost::mutex::scoped_lock lock(m_ioMutex);
+
+            te::qt::plugins::tv5plugins::WriteWindow(m_ndviBand, window.m_col, window.m_row, window.m_width, window.m_height,
+                                                     b.m_raw, b.m_blockBytes, &b.m_outBytes[0]);
+          }
+
+          writeOverviews(b, window, &b.m_outBytes[0]);
+          return;
+        }
+
+        b.m_out.resize(windowSize);
+
+        if(m_visBands.size() == 1)
+          GatherTable(&b.m_nirBytes[0], &b.m_bandBytes[0], windowSize, m_tableStride, &m_table[0], &b.m_out[0]);
+        else
+          GatherTable(&b.m_nirBytes[0], &b.m_visSum[0], windowSize, m_tableStride, &m_table[0], &b.m_out[0]);
+
+        setNoData(b, &b.m_out[0]);
+
+        //range only pass
+        if(!m_ndviBand)
+        {
+          bool masked = !b.m_inside.empty();
+
+          for(std::size_t i = 0; i < windowSize; ++i)
+          {
+            if(masked && !b.m_inside[i])
+              continue;
+
+            b.m_min = std::min(b.m_min, b.m_out[i]);
+            b.m_max = std::max(b.m_max, b.m_out[i]);
+          }
+
+          return;
+        }
+
+        {
+          boost::mutex::scoped_lock lock(m_ioMutex);
+
+          te::qt::plugins::tv5plugins::WriteWindow(m_ndviBand, window.m_col, window.m_row, window.m_width, window.m_height,
+                                                   b.m_raw, b.m_blockValues, &b.m_out[0]);
+        }
+
+        writeOverviews(b, window, &b.m_out[0]);
+      }
+
+      /*! \brief Adds the 8 bit visible band v in m_bandBytes to the sum of the visible values, one band stays in m_bandBytes. */
+      void addVISBytes(BlockBuffers& b, std::size_t v, std::size_t windowSize)
+      {
+        if(m_visBands.size() == 1)
+          return;
+
+        if(v == 0)
+          std::copy(b.m_bandBytes.begin(), b.m_bandBytes.begin() + windowSize, b.m_visSum.begin());
+        else
+          std::transform(b.m_bandBytes.begin(), b.m_bandBytes.begin() + windowSize, b.m_visSum.begin(), b.m_visSum.begin(), std::plus<unsigned int>());
+      }
+
+      /*! \brief Fills m_inside from the source window, left empty if the VIS raster covers the NIR raster. */
+      void getInside(BlockBuffers& b, const te::qt::plugins::tv5plugins::RasterBlock& window) const
+      {
+        b.m_inside.clear();
+
+        if(!m_sampler.hasOutside())
+          return;
+
+        const SourceWindow& sw = b.m_sourceWindow;
+
+        b.m_inside.resize((std::size_t)window.m_width * window.m_height);
+
+        for(unsigned int r = 0; r < window.m_height; ++r)
+        {
+          for(unsigned int c = 0; c < window.m_width; ++c)
+            b.m_inside[(std::size_t)r * window.m_width + c] = sw.m_rowInside[r] & sw.m_colInside[c];
+        }
+      }
+
+      /*! \brief The pixels out of the VIS raster get noData. */
+      template<class T> void setNoData(const BlockBuffers& b, T* values) const
+      {
+        for(std::size_t i = 0; i < b.m_inside.size(); ++i)
+        {
+          if(!b.m_inside[i])
+            values[i] = (T)m_noData;
+        }
+      }
+
+      /*! \brief Reads the VIS window that covers the output window, one after the other for each visible band. */
+      template<class T> void readSource(BlockBuffers& b, const te::qt::plugins::tv5plugins::RasterBlock& window, std::vector<T>& blockValues, std::vector<T>& source)
+      {
+        m_sampler.getSourceWindow(window, b.m_sourceWindow);
+
+        const SourceWindow& sw = b.m_sourceWindow;
+
+        std::size_t sourceSize = (std::size_t)sw.m_width * sw.m_height;
+
+        source.resize(sourceSize * m_visBands.size());
+
+        for(std::size_t v = 0; v < m_visBands.size(); ++v)
+          te::qt::plugins::tv5plugins::ReadWindow(m_rasterVIS->getBand(m_visBands[v]), sw.m_col, sw.m_row, sw.m_width, sw.m_height,
+                                                  b.m_raw, blockValues, &source[v * sourceSize]);
+      }
+
+      template<class T> void writeOverviews(BlockBuffers& b, const te::qt::plugins::tv5plugins::RasterBlock& window, const T* values)
+      {
+        m_overviews.write(b, window, values, m_ioMutex);
+      }
+
+    protected:
+
+      te::rst::Band* m_nirBand;
+      te::rst::Raster* m_rasterVIS;
+      std::vector<std::size_t> m_visBands;
+      const VISSampler& m_sampler;
+      te::rst::Band* m_ndviBand;
+      double m_gain;
+      double m_offset;
+      bool m_invert;
+      double m_noData;                        //!< Value of the pixels out of the VIS raster.
+      bool m_normalize;
+      double m_normGain;
+      double m_normOffset;
+      double m_normMin;
+      std::vector<double> m_table;            //!< NDVI by nir * m_tableStride + sum of the visible values, empty if the bands are not UCHAR.
+      std::vector<unsigned char> m_normTable; //!< Normalized m_table.
+      std::size_t m_tableStride;
+      OverviewWriter m_overviews;
+      std::vector<BlockBuffers> m_buffers;    //!< Indexed by the worker.
+      boost::mutex m_ioMutex;                 //!< The raster bands are read and written by one worker at a time.
+  };
+
+  /*! \brief Applies a linear transformation to a block. */
+  class NormalizeKernel
+  {
+    public:
+
+      NormalizeKernel(te::rst::Band* inBand, te::rst::Band* outBand, double gain, double offset, std::size_t blockSize, std::size_t nThreads) :
+        m_inBand(inBand), m_outBand(outBand), m_gain(gain), m_offset(offset), m_buffers(nThreads)
+      {
+        for(std::size_t t = 0; t < m_buffers.size(); ++t)
+          m_buffers[t].m_out.assign(blockSize, 0.);
+      }
+
+      void process(std::size_t worker, const te::qt::plugins::tv5plugins::RasterBlock& block)
+      {
+        BlockBuffers& b = m_buffers[worker];
+
+        {
+          boost::mutex::scoped_lock lock(m_ioMutex);
+
+          te::qt::plugins::tv5plugins::ReadBlock(m_inBand, block, b.m_raw, &b.m_out[0]);
+        }
+
+        for(std::size_t i = 0; i < b.m_out.size(); ++i)
+          b.m_out[i] = b.m_out[i] * m_gain + m_offset;
+
+        boost::mutex::scoped_lock lock(m_ioMutex);
+
+        te::qt::plugins::tv5plugins::WriteBlock(m_outBand, block, b.m_raw, &b.m_out[0]);
+      }
+
+    protected:
+
+      te::rst::Band* m_inBand;
+      te::rst::Band* m_outBand;
+      double m_gain;
+      double m_offset;
+      std::vector<BlockBuffers> m_buffers;
+      boost::mutex m_ioMutex;
+  };
+
+  /*! \brief Reduces the windows of a full resolution band into its overview levels, as the NDVI pass. */
+  class OverviewKernel
+  {
+    public:
+
+      OverviewKernel(te::rst::Band* band, const std::vector<te::rst::Raster*>& levels, bool round, bool hasNoData, double noData,
+                     std::size_t windowSize, std::size_t nThreads) :
+        m_band(band), m_buffers(nThreads)
+      {
+        m_overviews.setLevels(levels, round, hasNoData, noData);
+
+        for(std::size_t t = 0; t < m_buffers.size(); ++t)
+          m_buffers[t].m_out.assign(windowSize, 0.);
+      }
+
+      void process(std::size_t worker, const te::qt::plugins::tv5plugins::RasterBlock& window)
+      {
+        BlockBuffers& b = m_buffers[worker];
+
+        {
+          boost::mutex::scoped_lock lock(m_ioMutex);
+
+          te::qt::plugins::tv5plugins::ReadWindow(m_band, window.m_col, window.m_row, window.m_width, window.m_height,
+                                                  b.m_raw, b.m_blockValues, &b.m_out[0]);
+        }
+
+        m_overviews.write(b, window, &b.m_out[0], m_ioMutex);
+      }
+
+      const std::vector<std::vector<OverviewSample> >& getSamples() const
+      {
+        return m_overviews.getSamples();
+      }
+
+    protected:
+
+      te::rst::Band* m_band;
+      OverviewWriter m_overviews;
+      std::vector<BlockBuffers> m_buffers;
+      boost::mutex m_ioMutex;
+  };
+
+  /*! \brief Gain and offset that scale [min, max] to [nmin, nmax]. */
+  void GetNormalization(double min, double max, double nmin, double nmax, double& gain, double& offset)
+  {
+    if(max > min)
+      gain = (nmax - nmin) / (max - min);
+    else
+      gain = 0.;
+
+    offset = -1 * gain * min + nmin;
+  }
+
+  /*! \brief Bytes of the buffers of a worker for each output pixel, with the VIS source windows and the overview buffers. */
+  std::size_t GetBytesPerPixel(const VISSampler& sampler, std::size_t nVisBands, bool overviews)
+  {
+    double bytes = NDVI_BYTES_PER_PIXEL;
+
+    //co-registration, the VIS window that covers the output window is kept for each visible band
+    if(!sampler.isIdentity())
+      bytes += sampler.getPixelRatio() * (double)nVisBands * sizeof(double);
+
+    //flag of the pixels out of the VIS raster
+    if(sampler.hasOutside())
+      bytes += sizeof(unsigned char);
+
+    if(overviews)
+      bytes += NDVI_OVERVIEW_BYTES_PER_PIXEL;
+
+    return (std::size_t)std::ceil(bytes);
+  }
+
+  /*! \brief True if each overview level has the sample values, as written. */
+  bool CheckOverviews(const te::rst::Raster* raster, const std::vector<std::vector<OverviewSample> >& samples)
+  {
+    for(std::size_t l = 0; l < samples.size(); ++l)
+    {
+      std::auto_ptr<te::rst::Raster> level(raster->getMultiResolutionLevel((unsigned int)l + 1));
+
+      if(!level.get() || samples[l].empty())
+        return false;
+
+      const te::rst::Band* band = level->getBand(0);
+
+      for(std::size_t t = 0; t < samples[l].size(); ++t)
+      {
+        const OverviewSample& sample = samples[l][t];
+
+        if(sample.m_col >= level->getNumberOfColumns() || sample.m_row >= level->getNumberOfRows())
+          return false;
+
+        double value = 0.;
+
+        band->getValue(sample.m_col, sample.m_row, value);
+
+        if(std::fabs(value - sample.m_value) > NDVI_OVERVIEW_TOLERANCE)
+          return false;
+      }
     }
+
+    return true;
   }
 
-  if (invert)
+  /*! \brief Opens the raster again with write access. */
+  std::auto_ptr<te::rst::Raster> OpenRaster(const std::string& type, const std::string& uri)
   {
-    delete rasterNIR;
+    std::map<std::string, std::string> openInfo;
+    openInfo["URI"] = uri;
+
+    std::auto_ptr<te::rst::Raster> raster(te::rst::RasterFactory::open(type, openInfo, te::common::RWAccess));
+
+    if(!raster.get())
+    {
+      throw te::common::Exception("Error opening the NDVI raster.");
+    }
+
+    return raster;
   }
 
-  std::auto_ptr<te::rst::Raster> rasterOut;
+  /*!
+    \brief Writes the overview levels again with the 2x2 means of the full resolution band, as the NDVI pass, and returns the samples written.
+
+    The driver allocates the levels if they are missing, their values are then replaced.
+  */
+  std::vector<std::vector<OverviewSample> > RebuildOverviews(te::rst::Raster* raster, unsigned int nLevels, bool round, bool hasNoData, double noData,
+                                                             std::size_t memoryBudget, std::size_t nThreads)
+  {
+    std::auto_ptr<te::rst::Raster> first(raster->getMultiResolutionLevel(1));
+
+    if(!first.get())
+      raster->createMultiResolution(nLevels + 1, te::rst::NearestNeighbor);
+
+    first.reset();
+
+    std::vector<te::rst::Raster*> levels;
+
+    for(unsigned int l = 1; l <= nLevels; ++l)
+    {
+      te::rst::Raster* level = raster->getMultiResolutionLevel(l);
+
+      if(!level)
+      {
+        te::common::FreeContents(levels);
+        throw te::common::Exception("Error creating the NDVI overviews.");
+      }
+
+      levels.push_back(level);
+    }
+
+    te::rst::Band* band = raster->getBand(0);
+
+    std::vector<te::qt::plugins::tv5plugins::RasterBlock> windows = te::qt::plugins::tv5plugins::GetBudgetWindows(band, raster->getNumberOfColumns(), raster->getNumberOfRows(),
+                                                                                                                  memoryBudget, sizeof(double) + NDVI_OVERVIEW_BYTES_PER_PIXEL,
+                                                                                                                  nThreads, 1u << nLevels);
+
+    std::vector<std::vector<OverviewSample> > samples;
+
+    try
+    {
+      OverviewKernel kernel(band, levels, round, hasNoData, noData, te::qt::plugins::tv5plugins::GetMaxWindowSize(windows), nThreads);
+
+      te::qt::plugins::tv5plugins::ProcessRasterBlocks(windows, boost::bind(&OverviewKernel::process, &kernel, _1, _2), nThreads, "Calculating NDVI overviews.");
+
+      samples = kernel.getSamples();
+    }
+    catch(...)
+    {
+      te::common::FreeContents(levels);
+      throw;
+    }
+
+    te::common::FreeContents(levels);
+
+    return samples;
+  }
+
+  /*! \brief Evenly spaced subset of the blocks, with at most maxBlocks blocks. */
+  std::vector<te::qt::plugins::tv5plugins::RasterBlock> GetSampleBlocks(const std::vector<te::qt::plugins::tv5plugins::RasterBlock>& blocks, std::size_t maxBlocks)
+  {
+    if(blocks.size() <= maxBlocks)
+      return blocks;
+
+    std::vector<te::qt::plugins::tv5plugins::RasterBlock> samples;
+
+    for(std::size_t t = 0; t < maxBlocks; ++t)
+      samples.push_back(blocks[t * blocks.size() / maxBlocks]);
+
+    return samples;
+  }
+}
+
+std::auto_ptr<te::rst::Raster> te::qt::plugins::tv5plugins::GenerateNDVIRaster(te::rst::Raster* rasterNIR, int bandNIR, 
+                                                                               te::rst::Raster* rasterVIS, int bandVIS, 
+                                                                               double gain, double offset, bool normalize, 
+                                                                               std::map<std::string, std::string> rInfo,
+                                                                               std::string type, bool invert, std::size_t nThreads,
+                                                                               NDVIRangeMode rangeMode, std::size_t memoryBudget,
+                                                                               unsigned int overviewLevels, NDVIResampling resampling)
+{
+  //check input parameters
+  if(!rasterNIR || ! rasterVIS)
+  {
+    throw te::common::Exception("Invalid input rasters.");
+  }
+
+  //the VIS raster is sampled on the NIR grid if the grids differ
+  VISSampler sampler(rasterNIR, rasterVIS, resampling == NDVI_RESAMPLE_BILINEAR);
+
+  //create raster out, the normalized NDVI is written directly as UCHAR
+  std::vector<te::rst::BandProperty*> bandsProperties;
+  te::rst::BandProperty* bandProp = new te::rst::BandProperty(0, normalize ? te::dt::UCHAR_TYPE : te::dt::DOUBLE_TYPE);
+  bandProp->m_nblocksx = rasterNIR->getBand(bandNIR)->getProperty()->m_nblocksx;
+  bandProp->m_nblocksy = rasterNIR->getBand(bandNIR)->getProperty()->m_nblocksy;
+  bandProp->m_blkh = rasterNIR->getBand(bandNIR)->getProperty()->m_blkh;
+  bandProp->m_blkw = rasterNIR->getBand(bandNIR)->getProperty()->m_blkw;
+  bandsProperties.push_back(bandProp);
+
+  //the pixels out of the VIS raster are no data, the normalized values are then scaled to [1, 255]
+  double noData = normalize ? 0. : NDVI_NO_DATA;
+  double normMin = sampler.hasOutside() ? 1. : 0.;
+
+  if(sampler.hasOutside())
+    bandProp->m_noDataValue = noData;
+
+  te::rst::Grid* grid = new te::rst::Grid(*(rasterNIR->getGrid()));
+
+  std::auto_ptr<te::rst::Raster> rasterNDVI(te::rst::RasterFactory::make(type, grid, bandsProperties, rInfo));
+
+  std::vector<std::size_t> visBands = GetVisibleBands(rasterVIS, bandVIS);
+
+  //start NDVI operation, window by window of whole blocks in the output band layout (the driver may change the requested layout)
+  te::rst::Band* nirBand = rasterNIR->getBand(bandNIR);
+  te::rst::Band* ndviBand = rasterNDVI->getBand(0);
+
+  unsigned int nCols = rasterNDVI->getNumberOfColumns();
+  unsigned int nRows = rasterNDVI->getNumberOfRows();
+
+  //overview levels are allocated by the driver and filled by the NDVI pass, the windows are aligned to the coarsest level
+  std::vector<te::rst::Raster*> levels;
+
+  if(overviewLevels > 0 && rasterNDVI->createMultiResolution(overviewLevels + 1, te::rst::NearestNeighbor))
+  {
+    for(unsigned int l = 1; l <= overviewLevels; ++l)
+    {
+      te::rst::Raster* level = rasterNDVI->getMultiResolutionLevel(l);
+
+      if(!level)
+        break;
+
+      levels.push_back(level);
+    }
+  }
+
+  std::size_t bytesPerPixel = GetBytesPerPixel(sampler, visBands.size(), !levels.empty());
+
+  std::vector<RasterBlock> windows = GetBudgetWindows(ndviBand, nCols, nRows, memoryBudget, bytesPerPixel, nThreads, 1u << levels.size());
+
+  if(windows.empty())
+  {
+    te::common::FreeContents(levels);
+    return rasterNDVI;
+  }
+
+  double normGain = 1.;
+  double normOffset = 0.;
 
   if(normalize)
   {
-    rasterOut = NormalizeRaster(rasterNDVI, minValue, maxValue, 0., 255., rInfo, type);
+    double minValue = 0.;
+    double maxValue = 0.;
+
+    if(rangeMode == NDVI_RANGE_ANALYTIC)
+    {
+      //the ratio (nir - vis) / (nir + vis) is inside [-1, 1]
+      minValue = offset - std::fabs(gain);
+      maxValue = offset + std::fabs(gain);
+    }
+    else
+    {
+      //pre-pass without output, over all windows or a subset of single blocks
+      std::vector<RasterBlock> rangeBlocks = windows;
+
+      if(rangeMode == NDVI_RANGE_SAMPLED)
+        rangeBlocks = GetSampleBlocks(GetRasterWindows(ndviBand, nCols, nRows, 0), NDVI_SAMPLE_BLOCKS);
+
+      std::size_t rangeThreads = std::min(nThreads, rangeBlocks.size());
+
+      NDVIKernel rangeKernel(nirBand, rasterVIS, visBands, sampler, 0, gain, offset, invert, noData, GetMaxWindowSize(rangeBlocks), rangeThreads);
 
-    delete rasterNDVI;
+      ProcessRasterBlocks(rangeBlocks, boost::bind(&NDVIKernel::process, &rangeKernel, _1, _2), rangeThreads, "Calculating NDVI range.");
+
+      rangeKernel.getRange(minValue, maxValue);
+    }
+
+    GetNormalization(minValue, maxValue, normMin, 255., normGain, normOffset);
   }
-  else
+
+  std::vector<std::vector<OverviewSample> > samples;
+
   {
-    rasterOut.reset(rasterNDVI);
+    //the output kernel is created after the range kernel is released, only one of them holds the memory budget
+    NDVIKernel kernel(nirBand, rasterVIS, visBands, sampler, ndviBand, gain, offset, invert, noData, GetMaxWindowSize(windows), nThreads);
+
+    if(normalize)
+      kernel.setNormalization(normGain, normOffset, normMin);
+
+    kernel.setOverviews(levels, normalize);
+
+    try
+    {
+      ProcessRasterBlocks(windows, boost::bind(&NDVIKernel::process, &kernel, _1, _2), nThreads, "Calculating NDVI.");
+    }
+    catch(...)
+    {
+      te::common::FreeContents(levels);
+      throw;
+    }
+
+    samples = kernel.getOverviewSamples();
   }
 
-  return rasterOut;
+  unsigned int nLevels = (unsigned int)levels.size();
+
+  te::common::FreeContents(levels);
+
+  //the levels were written by their own handles, the output is opened again to check that the full resolution
+  //handle kept them, otherwise they are written again from the output band with the same 2x2 means
+  if(nLevels > 0 && rInfo.count("URI"))
+  {
+    rasterNDVI.reset();
+    rasterNDVI = OpenRaster(type, rInfo["URI"]);
+
+    if(!CheckOverviews(rasterNDVI.get(), samples))
+    {
+      samples = RebuildOverviews(rasterNDVI.get(), nLevels, normalize, sampler.hasOutside(), noData, memoryBudget, nThreads);
+
+      rasterNDVI.reset();
+      rasterNDVI = OpenRaster(type, rInfo["URI"]);
+
+      if(!CheckOverviews(rasterNDVI.get(), samples))
+      {
+        throw te::common::Exception("Error writing the NDVI overviews.");
+      }
+    }
+  }
+
+  return rasterNDVI;
+}
+
+unsigned int te::qt::plugins::tv5plugins::GetOverviewLevels(unsigned int nCols, unsigned int nRows, unsigned int minSize)
+{
+  unsigned int levels = 0;
+
+  for(unsigned int size = std::max(nCols, nRows); size > minSize && levels < NDVI_MAX_OVERVIEWS; size = (size + 1) / 2)
+    ++levels;
+
+  return levels;
+}
+
+std::map<std::string, std::string> te::qt::plugins::tv5plugins::GetTiledGeoTiffInfo(const std::string& fileName, int tileSize, const std::string& compress)
+{
+  std::ostringstream oss;
+  oss << tileSize;
+
+  //the options other than the URI are given to the GDAL driver as creation options
+  std::map<std::string, std::string> rInfo;
+  rInfo["URI"] = fileName;
+  rInfo["TILED"] = "YES";
+  rInfo["BLOCKXSIZE"] = oss.str();
+  rInfo["BLOCKYSIZE"] = oss.str();
+  rInfo["COMPRESS"] = compress;
+  rInfo["BIGTIFF"] = "IF_SAFER";
+
+  return rInfo;
+}
+
+std::vector<std::size_t> te::qt::plugins::tv5plugins::GetVisibleBands(const te::rst::Raster* rasterVIS, int bandVIS)
+{
+  //visible value is the mean of the bands without the last one (alpha), or the given band if there is only one band
+  std::vector<std::size_t> visBands;
+
+  for(std::size_t b = 0; b + 1 < rasterVIS->getNumberOfBands(); ++b)
+    visBands.push_back(b);
+
+  if(visBands.empty())
+    visBands.push_back((std::size_t)bandVIS);
+
+  return visBands;
 }
 
 te::rst::Raster* te::qt::plugins::tv5plugins::InvertRaster(te::rst::Raster* rasterNIR, int bandNIR)
@@ -227,54 +1389,39 @@ te::rst::Raster* te::qt::plugins::tv5plugins::InvertRaster(te::rst::Raster* rast
 }
 
 std::auto_ptr<te::rst::Raster> te::qt::plugins::tv5plugins::NormalizeRaster(te::rst::Raster* inraster, double min, double max, double nmin, double nmax, 
-                                                                            std::map<std::string, std::string> rInfo, std::string type)
+                                                                            std::map<std::string, std::string> rInfo, std::string type, std::size_t nThreads)
 {
-//create raster out
+//create raster out, with the block layout of the input raster
+  te::rst::Band* inBand = inraster->getBand(0);
+
   std::vector<te::rst::BandProperty*> bandsProperties;
   te::rst::BandProperty* bandProp = new te::rst::BandProperty(0, te::dt::UCHAR_TYPE);
+  bandProp->m_nblocksx = inBand->getProperty()->m_nblocksx;
+  bandProp->m_nblocksy = inBand->getProperty()->m_nblocksy;
+  bandProp->m_blkh = inBand->getProperty()->m_blkh;
+  bandProp->m_blkw = inBand->getProperty()->m_blkw;
   bandsProperties.push_back(bandProp);
 
   te::rst::Grid* grid = new te::rst::Grid(*(inraster->getGrid()));
 
-  te::rst::Raster* rasterNormalized = te::rst::RasterFactory::make(type, grid, bandsProperties, rInfo);
+  std::auto_ptr<te::rst::Raster> rasterNormalized(te::rst::RasterFactory::make(type, grid, bandsProperties, rInfo));
 
   //start Normalize operation
-  std::size_t nRows = inraster->getNumberOfRows();
-  std::size_t nCols = inraster->getNumberOfColumns();
+  double gain = 1.;
+  double offset = 0.;
 
-  te::common::TaskProgress task("Normalize NDVI.");
-  task.setTotalSteps(nRows);
+  GetNormalization(min, max, nmin, nmax, gain, offset);
 
-  double gain = (double)(nmax-nmin)/(max-min);
-  double offset = -1*gain*min+nmin;
+  std::vector<RasterBlock> blocks = GetRasterBlocks(inBand, inraster->getNumberOfColumns(), inraster->getNumberOfRows());
 
-  double value;
-
-  for(std::size_t t = 0; t < nRows; ++t)
+  if(!blocks.empty())
   {
-    if(task.isActive() == false)
-      throw te::common::Exception("Operation Canceled.");
-
-    for(std::size_t q = 0; q < nCols; ++q)
-    {
-      try
-      {
-        inraster->getValue(q, t, value, 0);
+    nThreads = std::min(GetNumberOfThreads(nThreads), blocks.size());
 
-        double normalizeValue = (value * gain + offset);
+    NormalizeKernel kernel(inBand, rasterNormalized->getBand(0), gain, offset, (std::size_t)blocks[0].m_width * blocks[0].m_height, nThreads);
 
-        rasterNormalized->setValue(q, t, normalizeValue, 0);
-      }
-      catch (...)
-      {
-        continue;
-      }
-    }
-
-    task.pulse();
+    ProcessRasterBlocks(blocks, boost::bind(&NormalizeKernel::process, &kernel, _1, _2), nThreads, "Normalize NDVI.");
   }
 
-  std::auto_ptr<te::rst::Raster> rOut(rasterNormalized);
-
-  return rOut;
+  return rasterNormalized;
 }
@@ -31,6 +31,8 @@
 //STL Includes
 #include <map>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace te
 {
@@ -42,17 +44,77 @@ namespace te
     {
       namespace tv5plugins
       {
-
+        /*! \brief NDVI of a pixel, the NIR value is inverted (255 - nir) if invert is true. */
+        inline double NDVIValue(double nir, double vis, double gain, double offset, bool invert)
+        {
+          if(invert)
+            nir = 255. - nir;
+
+          if(nir + vis == 0.)
+            return 0.;
+
+          return (gain * ((nir - vis) / (nir + vis))) + offset;
+        }
+
+        /*! \brief Bands averaged as the visible value: all bands but the last one (alpha), or bandVIS if the raster has one band. */
+        std::vector<std::size_t> GetVisibleBands(const te::rst::Raster* rasterVIS, int bandVIS);
+
+        /*! \brief How the NDVI range used by the normalization is found. */
+        enum NDVIRangeMode
+        {
+          NDVI_RANGE_EXACT,       //!< Pre-pass over all blocks, without output.
+          NDVI_RANGE_SAMPLED,     //!< Pre-pass over a subset of evenly spaced blocks, values out of the range are clamped.
+          NDVI_RANGE_ANALYTIC     //!< Bounds given by gain and offset, [offset - |gain|, offset + |gain|], without pre-pass.
+        };
+
+        /*! \brief How the VIS raster is sampled on the NIR grid when the grids differ. */
+        enum NDVIResampling
+        {
+          NDVI_RESAMPLE_NEAREST,
+          NDVI_RESAMPLE_BILINEAR
+        };
+
+        /*!
+          \brief Creates the NDVI raster, the blocks are processed by nThreads threads (0 uses all hardware threads).
+
+          If normalize is true the NDVI is scaled to [0, 255] and written directly into a UCHAR raster,
+          the range is found as defined by rangeMode.
+
+          The raster is processed in windows of whole output blocks, the buffers of all threads take at
+          most memoryBudget bytes (0 uses a default of 256 MB) whatever the raster size.
+
+          If the bands are UCHAR the NDVI is taken from a table of the 8 bit values, with the same results.
+
+          If overviewLevels is not 0 the output gets the internal overviews 2x, 4x, ... 2^overviewLevels,
+          reduced from each window in the same pass (skipped if the driver does not support overviews).
+          The output is then opened again and three pixels of each window of each level are read back. If the
+          levels were not kept they are written again with the same 2x2 means from the output band, an exception
+          is thrown if they are still not kept.
+
+          The output has the NIR grid. If the VIS grid differs (same SRID, no rotation) the VIS position of each
+          NIR column and row is computed once and the VIS bands are sampled as defined by resampling. The NIR
+          pixels whose nearest VIS pixel is out of the VIS raster are no data (-9999, or 0 if normalized, the other
+          values are then scaled to [1, 255]), they are left out of the range and of the overviews.
+        */
         std::auto_ptr<te::rst::Raster> GenerateNDVIRaster(te::rst::Raster* rasterNIR, int bandNIR, 
                                                           te::rst::Raster* rasterVIS, int bandVIS, 
                                                           double gain, double offset, bool normalize, 
                                                           std::map<std::string, std::string> rInfo,
-                                                          std::string type, bool invert);
+                                                          std::string type, bool invert, std::size_t nThreads = 0,
+                                                          NDVIRangeMode rangeMode = NDVI_RANGE_EXACT, std::size_t memoryBudget = 0,
+                                                          unsigned int overviewLevels = 0, NDVIResampling resampling = NDVI_RESAMPLE_NEAREST);
+
+        /*! \brief Number of overview levels until the largest side of the raster has at most minSize pixels. */
+        unsigned int GetOverviewLevels(unsigned int nCols, unsigned int nRows, unsigned int minSize = 256);
+
+        /*! \brief Raster info to create a tiled and compressed GeoTIFF with the GDAL driver. */
+        std::map<std::string, std::string> GetTiledGeoTiffInfo(const std::string& fileName, int tileSize = 256, const std::string& compress = "DEFLATE");
 
         te::rst::Raster* InvertRaster(te::rst::Raster* rasterNIR, int bandNIR);
 
+        /*! \brief Scales the first band of the raster from [min, max] to [nmin, nmax] into a UCHAR raster. */
         std::auto_ptr<te::rst::Raster> NormalizeRaster(te::rst::Raster* inraster, double min, double max, double nmin, double nmax, 
-                                                       std::map<std::string, std::string> rInfo, std::string type);
+                                                       std::map<std::string, std::string> rInfo, std::string type, std::size_t nThreads = 0);
 
       } // end namespace thirdParty
     }   // end namespace plugins
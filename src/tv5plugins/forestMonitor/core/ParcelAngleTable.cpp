@@ -0,0 +1,228 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*! \file terralib/qt/plugins/thirdParty/forestMonitor/core/ParcelAngleTable.cpp
+
+    \brief This file contains the join between the parcels and the lines with the planting direction.
+*/
+
+//TerraLib Includes
+#include <terralib/geometry/LineString.h>
+#include <terralib/geometry/MultiLineString.h>
+#include <terralib/geometry/Point.h>
+#include <terralib/srs/Config.h>
+#include "../../PackedRTree.h"
+#include "ParcelAngleTable.h"
+
+//STL Includes
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+// Boost
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace
+{
+  bool ParcelAngleLess(const te::qt::plugins::tv5plugins::ParcelAngle& a, const te::qt::plugins::tv5plugins::ParcelAngle& b)
+  {
+    return a.m_parcelId < b.m_parcelId;
+  }
+}
+
+te::qt::plugins::tv5plugins::ParcelAngleTable::ParcelAngleTable()
+{
+}
+
+te::qt::plugins::tv5plugins::ParcelAngleTable::~ParcelAngleTable()
+{
+}
+
+void te::qt::plugins::tv5plugins::ParcelAngleTable::build(const std::vector<std::pair<int, te::gm::Geometry*> >& parcels,
+                                                          const std::map<int, te::gm::Geometry*>& lines, int srid, std::size_t nThreads)
+{
+  m_table.clear();
+
+  if(parcels.empty() || lines.empty())
+    return;
+
+  if(nThreads == 0)
+    nThreads = boost::thread::hardware_concurrency();
+
+  if(nThreads == 0)
+    nThreads = 1;
+
+  nThreads = std::min(nThreads, parcels.size());
+
+  //index the lines
+  PackedRTree tree;
+
+  for(std::map<int, te::gm::Geometry*>::const_iterator it = lines.begin(); it != lines.end(); ++it)
+    tree.insert(*it->second->getMBR(), it->first);
+
+  tree.build(nThreads);
+
+  //each thread joins a contiguous range of parcels
+  std::vector<ParcelAngle> result(parcels.size());
+  std::vector<char> found(parcels.size(), 0);
+
+  std::size_t step = (parcels.size() + nThreads - 1) / nThreads;
+
+  if(nThreads == 1)
+  {
+    join(parcels, lines, tree, srid, 0, parcels.size(), result, found);
+  }
+  else
+  {
+    boost::thread_group threads;
+
+    for(std::size_t begin = 0; begin < parcels.size(); begin += step)
+    {
+      std::size_t end = std::min(begin + step, parcels.size());
+
+      threads.create_thread(boost::bind(&ParcelAngleTable::join, this, boost::cref(parcels), boost::cref(lines), boost::cref(tree),
+                                        srid, begin, end, boost::ref(result), boost::ref(found)));
+    }
+
+    threads.join_all();
+  }
+
+  //keep only the parcels with direction, sorted by id
+  for(std::size_t t = 0; t < result.size(); ++t)
+  {
+    if(found[t])
+      m_table.push_back(result[t]);
+  }
+
+  std::stable_sort(m_table.begin(), m_table.end(), ParcelAngleLess);
+}
+
+const te::qt::plugins::tv5plugins::ParcelAngle* te::qt::plugins::tv5plugins::ParcelAngleTable::find(int parcelId) const
+{
+  ParcelAngle key;
+  key.m_parcelId = parcelId;
+
+  std::vector<ParcelAngle>::const_iterator it = std::lower_bound(m_table.begin(), m_table.end(), key, ParcelAngleLess);
+
+  if(it == m_table.end() || it->m_parcelId != parcelId)
+    return 0;
+
+  return &(*it);
+}
+
+void te::qt::plugins::tv5plugins::ParcelAngleTable::clear()
+{
+  m_table.clear();
+}
+
+std::size_t te::qt::plugins::tv5plugins::ParcelAngleTable::size() const
+{
+  return m_table.size();
+}
+
+void te::qt::plugins::tv5plugins::ParcelAngleTable::join(const std::vector<std::pair<int, te::gm::Geometry*> >& parcels, const std::map<int, te::gm::Geometry*>& lines,
+                                                         const PackedRTree& tree, int srid, std::size_t begin, std::size_t end,
+                                                         std::vector<ParcelAngle>& result, std::vector<char>& found) const
+{
+  std::vector<int> results;
+
+  for(std::size_t p = begin; p < end; ++p)
+  {
+    te::gm::Geometry* geom = parcels[p].second;
+
+    if(!geom)
+      continue;
+
+    results.clear();
+
+    tree.search(*geom->getMBR(), results);
+
+    //the first line (lowest id) inside the parcel gives the direction
+    std::sort(results.begin(), results.end());
+
+    for(std::size_t t = 0; t < results.size(); ++t)
+    {
+      std::map<int, te::gm::Geometry*>::const_iterator it = lines.find(results[t]);
+
+      if(it == lines.end() || !geom->contains(it->second))
+        continue;
+
+      te::gm::MultiLineString* mLine = dynamic_cast<te::gm::MultiLineString*>(it->second);
+
+      if(!mLine || mLine->getNumGeometries() == 0)
+        continue;
+
+      te::gm::LineString* line = dynamic_cast<te::gm::LineString*>(mLine->getGeometryN(0));
+
+      if(!line || line->size() < 2)
+        continue;
+
+      std::auto_ptr<te::gm::Point> first(line->getPointN(0));
+      std::auto_ptr<te::gm::Point> last(line->getPointN(1));
+
+      if(srid != TE_UNKNOWN_SRS && first->getSRID() != srid)
+      {
+        first->transform(srid);
+        last->transform(srid);
+      }
+
+      double dx = last->getX() - first->getX();
+      double dy = last->getY() - first->getY();
+      double length = std::sqrt(dx * dx + dy * dy);
+
+      if(length == 0.)
+        continue;
+
+      ParcelAngle& pa = result[p];
+      pa.m_parcelId = parcels[p].first;
+      pa.m_angle = GetDirectionAngle(first->getX(), first->getY(), last->getX(), last->getY());
+      pa.m_dx = dx / length;
+      pa.m_dy = dy / length;
+
+      found[p] = 1;
+
+      break;
+    }
+  }
+}
+
+double te::qt::plugins::tv5plugins::GetDirectionAngle(double x0, double y0, double x1, double y1)
+{
+  double dx = x1 - x0;
+  double ax = fabs(dx);
+  double dy = y1 - y0;
+  double ay = fabs(dy);
+
+  double t = 0.0;
+
+  if((dx == 0.0) && (dy == 0.0))
+    t = 0.0;
+  else
+    t = dy / (ax + ay);
+
+  if(dx < 0.0)
+    t = 2 - t;
+  else if(dy < 0.0)
+    t = 4.0 + t;
+
+  double angle = t * 90.0;
+
+  return angle;
+}
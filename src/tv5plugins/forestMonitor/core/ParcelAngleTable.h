@@ -0,0 +1,112 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*! \file terralib/qt/plugins/thirdParty/forestMonitor/core/ParcelAngleTable.h
+
+    \brief This file contains the join between the parcels and the lines with the planting direction.
+*/
+
+#ifndef __TE_QT_PLUGINS_THIRDPARTY_INTERNAL_PARCELANGLETABLE_H
+#define __TE_QT_PLUGINS_THIRDPARTY_INTERNAL_PARCELANGLETABLE_H
+
+// TerraLib
+#include "../../Config.h"
+
+//STL Includes
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace te
+{
+  namespace gm { class Geometry; }
+
+  namespace qt
+  {
+    namespace plugins
+    {
+      namespace tv5plugins
+      {
+        class PackedRTree;
+
+        /*! \brief Row direction of a parcel. */
+        struct ParcelAngle
+        {
+          int m_parcelId;
+          double m_angle;     //!< Direction angle in degrees, see GetDirectionAngle.
+          double m_dx;        //!< X component of the unit direction vector.
+          double m_dy;        //!< Y component of the unit direction vector.
+        };
+
+        /*!
+          \class ParcelAngleTable
+
+          \brief Table with the row direction of each parcel.
+
+          The direction of a parcel is given by the first segment of the first direction line
+          contained by the parcel. The table is built once, with a single spatial join for
+          all parcels, and then read by parcel id.
+        */
+        class ParcelAngleTable
+        {
+          public:
+
+            ParcelAngleTable();
+
+            ~ParcelAngleTable();
+
+            /*!
+              \brief Joins the parcels with the direction lines.
+
+              \param parcels  Id and geometry of each parcel, in the same SRID of the lines.
+              \param lines    Direction lines indexed by id (MultiLineString geometries).
+              \param srid     SRID of the direction vectors, TE_UNKNOWN_SRS keeps the line coordinates.
+              \param nThreads Number of threads, 0 uses the number of hardware threads.
+            */
+            void build(const std::vector<std::pair<int, te::gm::Geometry*> >& parcels,
+                       const std::map<int, te::gm::Geometry*>& lines, int srid, std::size_t nThreads);
+
+            /*! \brief Returns the direction of the parcel or 0 if no line was found for it. */
+            const ParcelAngle* find(int parcelId) const;
+
+            void clear();
+
+            std::size_t size() const;
+
+          protected:
+
+            /*! \brief Finds the direction of the parcels in [begin, end). */
+            void join(const std::vector<std::pair<int, te::gm::Geometry*> >& parcels, const std::map<int, te::gm::Geometry*>& lines,
+                      const PackedRTree& tree, int srid, std::size_t begin, std::size_t end,
+                      std::vector<ParcelAngle>& result, std::vector<char>& found) const;
+
+          protected:
+
+            std::vector<ParcelAngle> m_table;      //!< Sorted by parcel id.
+        };
+
+        /*! \brief Pseudo angle (0 to 360 degrees) of the direction from (x0, y0) to (x1, y1), monotonic with the real angle. */
+        double GetDirectionAngle(double x0, double y0, double x1, double y1);
+
+      } // end namespace thirdParty
+    }   // end namespace plugins
+  }     // end namespace qt
+}       // end namespace te
+
+#endif //__TE_QT_PLUGINS_THIRDPARTY_INTERNAL_PARCELANGLETABLE_H
@@ -0,0 +1,353 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*! \file terralib/qt/plugins/thirdParty/forestMonitor/core/ParcelClassification.cpp
+
+    \brief This file contains the service that classifies the parcels in parallel.
+*/
+
+//TerraLib Includes
+#include <terralib/common/progress/TaskProgress.h>
+#include <terralib/common/Exception.h>
+#include <terralib/common/STLUtils.h>
+#include <terralib/common/StringUtils.h>
+#include <terralib/datatype/Enums.h>
+#include <terralib/geometry/Envelope.h>
+#include <terralib/geometry/Geometry.h>
+#include <terralib/geometry/Point.h>
+#include <terralib/raster/Grid.h>
+#include <terralib/raster/Raster.h>
+#include "ClassificationPipeline.h"
+#include "ParcelClassification.h"
+
+//STL Includes
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+// Boost
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+//memory of the parcels processed at the same time used by default
+#define DEFAULT_CLASSIFICATION_MEMORY 268435456
+
+//maximum number of parcels of a batch for each thread
+#define PARCELS_PER_THREAD 8
+
+//estimated bytes for each pixel of the parcel window, when only the centroids are kept
+#define CENTROID_BYTES_PER_PIXEL 1
+
+//estimated bytes for each pixel of the parcel window, when the mask raster is created (mask and crown polygons)
+#define MASK_BYTES_PER_PIXEL 16
+
+te::qt::plugins::tv5plugins::ParcelClassification::ParcelClassification(te::rst::Raster* ndviRaster, int ndviBand, double threshold, int dilation, int erosion) :
+  m_ndviRaster(ndviRaster),
+  m_ndviBand(ndviBand),
+  m_threshold(threshold),
+  m_dilation(dilation),
+  m_erosion(erosion),
+  m_nThreads(0),
+  m_memoryBudget(0),
+  m_exportPolygons(false)
+{
+  if(!m_ndviRaster)
+    throw te::common::Exception("Invalid input raster.");
+}
+
+te::qt::plugins::tv5plugins::ParcelClassification::~ParcelClassification()
+{
+  for(std::size_t t = 0; t < m_parcels.size(); ++t)
+    delete m_parcels[t].m_geom;
+
+  te::common::FreeContents(m_pipelines);
+}
+
+void te::qt::plugins::tv5plugins::ParcelClassification::setNumberOfThreads(std::size_t nThreads)
+{
+  m_nThreads = nThreads;
+}
+
+void te::qt::plugins::tv5plugins::ParcelClassification::setMemoryBudget(std::size_t memoryBudget)
+{
+  m_memoryBudget = memoryBudget;
+}
+
+void te::qt::plugins::tv5plugins::ParcelClassification::setMaskOutput(const std::string& fileName)
+{
+  m_maskFileName = fileName;
+}
+
+void te::qt::plugins::tv5plugins::ParcelClassification::setExportPolygons(bool exportPolygons)
+{
+  m_exportPolygons = exportPolygons;
+}
+
+void te::qt::plugins::tv5plugins::ParcelClassification::setDebugOutput(const std::string& fileName)
+{
+  m_debugFileName = fileName;
+}
+
+void te::qt::plugins::tv5plugins::ParcelClassification::addParcel(int parcelId, te::gm::Geometry* geom)
+{
+  assert(geom);
+
+  ParcelInfo pi;
+  pi.m_id = parcelId;
+  pi.m_geom = geom;
+  pi.m_memory = 0;
+
+  m_parcels.push_back(pi);
+}
+
+void te::qt::plugins::tv5plugins::ParcelClassification::execute(std::vector<CentroidInfo*>& centroids, std::vector<te::gm::Geometry*>& polygons)
+{
+  std::size_t nThreads = m_nThreads;
+
+  if(nThreads == 0)
+    nThreads = boost::thread::hardware_concurrency();
+
+  if(nThreads == 0)
+    nThreads = 1;
+
+  std::size_t memoryBudget = m_memoryBudget ? m_memoryBudget : DEFAULT_CLASSIFICATION_MEMORY;
+
+  for(std::size_t t = 0; t < m_parcels.size(); ++t)
+    m_parcels[t].m_memory = getParcelMemory(m_parcels[t].m_geom);
+
+  //each worker has its own buffers, reused by all its parcels
+  while(m_pipelines.size() < nThreads)
+  {
+    ClassificationPipeline* pipeline = new ClassificationPipeline(m_threshold, m_dilation, m_erosion);
+    pipeline->setInputNDVI(m_ndviRaster, m_ndviBand);
+    pipeline->setIOMutex(&m_ioMutex);
+
+    m_pipelines.push_back(pipeline);
+  }
+
+  te::common::TaskProgress task("Classifying Parcels");
+  task.setTotalSteps(m_parcels.size());
+
+  std::string errorMessage;
+
+  std::size_t begin = 0;
+
+  while(begin < m_parcels.size())
+  {
+    if(!task.isActive())
+      break;
+
+    //the parcels of the batch, at least one, fit in the memory budget
+    std::size_t end = begin;
+    std::size_t memory = 0;
+
+    while(end < m_parcels.size() && end - begin < nThreads * PARCELS_PER_THREAD &&
+          (end == begin || memory + m_parcels[end].m_memory <= memoryBudget))
+    {
+      memory += m_parcels[end].m_memory;
+      ++end;
+    }
+
+    std::vector<ParcelResult> results(end - begin);
+
+    ParcelQueue queue;
+    queue.m_next = begin;
+    queue.m_end = end;
+
+    std::size_t batchThreads = std::min(nThreads, end - begin);
+
+    if(batchThreads == 1)
+    {
+      processParcels(0, results, begin, queue);
+    }
+    else
+    {
+      boost::thread_group threads;
+
+      for(std::size_t t = 0; t < batchThreads; ++t)
+        threads.create_thread(boost::bind(&ParcelClassification::processParcels, this, t, boost::ref(results), begin, boost::ref(queue)));
+
+      threads.join_all();
+    }
+
+    //merge results
+    for(std::size_t t = 0; t < results.size(); ++t)
+    {
+      if(queue.m_errorMessage.empty())
+      {
+        centroids.insert(centroids.end(), results[t].m_centroids.begin(), results[t].m_centroids.end());
+        polygons.insert(polygons.end(), results[t].m_polygons.begin(), results[t].m_polygons.end());
+
+        task.pulse();
+      }
+      else
+      {
+        te::common::FreeContents(results[t].m_centroids);
+        te::common::FreeContents(results[t].m_polygons);
+      }
+    }
+
+    if(!queue.m_errorMessage.empty())
+    {
+      errorMessage = queue.m_errorMessage;
+      break;
+    }
+
+    begin = end;
+  }
+
+  if(!errorMessage.empty())
+    throw te::common::Exception(errorMessage);
+}
+
+void te::qt::plugins::tv5plugins::ParcelClassification::processParcels(std::size_t worker, std::vector<ParcelResult>& results, std::size_t begin, ParcelQueue& queue)
+{
+  ClassificationPipeline& pipeline = *m_pipelines[worker];
+
+  while(true)
+  {
+    std::size_t idx;
+
+    {
+      boost::mutex::scoped_lock lock(queue.m_mutex);
+
+      if(queue.m_next >= queue.m_end || !queue.m_errorMessage.empty())
+        return;
+
+      idx = queue.m_next++;
+    }
+
+    try
+    {
+      processParcel(pipeline, m_parcels[idx], results[idx - begin]);
+    }
+    catch(const std::exception& e)
+    {
+      boost::mutex::scoped_lock lock(queue.m_mutex);
+
+      queue.m_errorMessage = e.what();
+    }
+    catch(...)
+    {
+      boost::mutex::scoped_lock lock(queue.m_mutex);
+
+      queue.m_errorMessage = "Error classifying parcel.";
+    }
+  }
+}
+
+void te::qt::plugins::tv5plugins::ParcelClassification::processParcel(ClassificationPipeline& pipeline, const ParcelInfo& parcel, ParcelResult& result)
+{
+  //the final mask is created only if it is exported
+  std::auto_ptr<te::rst::Raster> maskRaster;
+
+  if(!m_maskFileName.empty() || m_exportPolygons)
+  {
+    std::map<std::string, std::string> maskInfo;
+    maskInfo["FORCE_MEM_DRIVER"] = "TRUE";
+
+    boost::mutex::scoped_lock lock(m_rasterMutex);
+
+    maskRaster = pipeline.createMaskRaster(parcel.m_geom, maskInfo, "MEM");
+  }
+
+  //get centroids
+  if(m_debugFileName.empty())
+    pipeline.classify(parcel.m_geom, parcel.m_id, result.m_centroids, maskRaster.get());
+  else
+    processDebugParcel(pipeline, parcel, result, maskRaster.get());
+
+  if(!maskRaster.get())
+    return;
+
+  //export image
+  if(!m_maskFileName.empty())
+  {
+    std::string rasterFileName = m_maskFileName + "_" + te::common::Convert2String(parcel.m_id) + ".tif";
+
+    boost::mutex::scoped_lock lock(m_rasterMutex);
+
+    ExportRaster(maskRaster.get(), rasterFileName);
+  }
+
+  //create geometries, the first one is the background
+  if(m_exportPolygons)
+  {
+    std::vector<te::gm::Geometry*> geomVec = Raster2Vector(maskRaster.get(), 0);
+
+    if(geomVec.size() > 2)
+    {
+      result.m_polygons.insert(result.m_polygons.end(), geomVec.begin() + 1, geomVec.end());
+
+      geomVec.resize(1);
+    }
+
+    te::common::FreeContents(geomVec);
+  }
+}
+
+void te::qt::plugins::tv5plugins::ParcelClassification::processDebugParcel(ClassificationPipeline& pipeline, const ParcelInfo& parcel, ParcelResult& result, te::rst::Raster* mask)
+{
+  std::map<std::string, std::string> rInfo;
+  rInfo["FORCE_MEM_DRIVER"] = "TRUE";
+
+  std::auto_ptr<te::rst::Raster> ndvi;
+  std::auto_ptr<te::rst::Raster> threshold;
+  std::auto_ptr<te::rst::Raster> dilation;
+  std::auto_ptr<te::rst::Raster> erosion;
+
+  {
+    boost::mutex::scoped_lock lock(m_rasterMutex);
+
+    ndvi = pipeline.createWindowRaster(parcel.m_geom, te::dt::DOUBLE_TYPE, rInfo, "MEM");
+    threshold = pipeline.createWindowRaster(parcel.m_geom, te::dt::UCHAR_TYPE, rInfo, "MEM");
+    dilation = pipeline.createWindowRaster(parcel.m_geom, te::dt::UCHAR_TYPE, rInfo, "MEM");
+    erosion = pipeline.createWindowRaster(parcel.m_geom, te::dt::UCHAR_TYPE, rInfo, "MEM");
+  }
+
+  pipeline.setDebugRasters(ndvi.get(), threshold.get(), dilation.get(), erosion.get());
+
+  pipeline.classify(parcel.m_geom, parcel.m_id, result.m_centroids, mask);
+
+  //parcel out of the raster
+  if(!ndvi.get())
+    return;
+
+  std::string id = te::common::Convert2String(parcel.m_id) + ".tif";
+
+  boost::mutex::scoped_lock lock(m_rasterMutex);
+
+  ExportRaster(ndvi.get(), m_debugFileName + "_parcel_" + id);
+  ExportRaster(threshold.get(), m_debugFileName + "_threshold_" + id);
+  ExportRaster(dilation.get(), m_debugFileName + "_dilation_" + id);
+  ExportRaster(erosion.get(), m_debugFileName + "_erosion_" + id);
+}
+
+std::size_t te::qt::plugins::tv5plugins::ParcelClassification::getParcelMemory(const te::gm::Geometry* geom) const
+{
+  const te::gm::Envelope* env = geom->getMBR();
+  const te::rst::Grid* grid = m_ndviRaster->getGrid();
+
+  double width = std::ceil((env->m_urx - env->m_llx) / grid->getResolutionX()) + 1.;
+  double height = std::ceil((env->m_ury - env->m_lly) / grid->getResolutionY()) + 1.;
+
+  double bytesPerPixel = (!m_maskFileName.empty() || m_exportPolygons) ? MASK_BYTES_PER_PIXEL : CENTROID_BYTES_PER_PIXEL;
+
+  return (std::size_t)(width * height * bytesPerPixel);
+}
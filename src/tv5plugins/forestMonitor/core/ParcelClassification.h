@@ -0,0 +1,163 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*! \file terralib/qt/plugins/thirdParty/forestMonitor/core/ParcelClassification.h
+
+    \brief This file contains the service that classifies the parcels in parallel.
+*/
+
+#ifndef __TE_QT_PLUGINS_THIRDPARTY_INTERNAL_PARCELCLASSIFICATION_H
+#define __TE_QT_PLUGINS_THIRDPARTY_INTERNAL_PARCELCLASSIFICATION_H
+
+// TerraLib
+#include "../../Config.h"
+#include "ForestMonitorClassification.h"
+
+//STL Includes
+#include <string>
+#include <vector>
+
+// Boost
+#include <boost/thread/mutex.hpp>
+
+namespace te
+{
+  namespace gm { class Geometry; }
+  namespace rst { class Raster; }
+
+  namespace qt
+  {
+    namespace plugins
+    {
+      namespace tv5plugins
+      {
+        class ClassificationPipeline;
+
+        /*!
+          \class ParcelClassification
+
+          \brief Detects the trees of all parcels using a pool of workers.
+
+          Each worker has its own ClassificationPipeline, whose buffers are reused by
+          all parcels of the worker, and takes the parcels from a queue. The parcels
+          are processed in batches whose estimated memory (the parcel windows and
+          their results) fits in the memory budget, the results of each batch are
+          appended in parcel order, so the output is the same for any number of threads.
+        */
+        class ParcelClassification
+        {
+          protected:
+
+            struct ParcelInfo
+            {
+              int m_id;
+              te::gm::Geometry* m_geom;
+              std::size_t m_memory;                         //!< Estimated bytes used by the parcel.
+            };
+
+            struct ParcelResult
+            {
+              std::vector<CentroidInfo*> m_centroids;
+              std::vector<te::gm::Geometry*> m_polygons;
+            };
+
+            struct ParcelQueue
+            {
+              boost::mutex m_mutex;
+              std::size_t m_next;
+              std::size_t m_end;
+              std::string m_errorMessage;
+            };
+
+          public:
+
+            ParcelClassification(te::rst::Raster* ndviRaster, int ndviBand, double threshold, int dilation, int erosion);
+
+            ~ParcelClassification();
+
+          public:
+
+            /*! \brief Number of worker threads, 0 (default) uses the number of hardware threads and 1 processes the parcels sequentially. */
+            void setNumberOfThreads(std::size_t nThreads);
+
+            /*! \brief Bytes of the parcels processed at the same time, 0 (default) uses 256 MB. A parcel is always processed, even if it does not fit. */
+            void setMemoryBudget(std::size_t memoryBudget);
+
+            /*! \brief The tree mask of each parcel is saved as <fileName>_<parcel id>.tif. */
+            void setMaskOutput(const std::string& fileName);
+
+            /*! \brief The tree crowns of each parcel are vectorized. */
+            void setExportPolygons(bool exportPolygons);
+
+            /*!
+              \brief Debug option, the intermediate rasters of each parcel are saved as <fileName>_parcel_<parcel id>.tif (NDVI),
+                     <fileName>_threshold_<parcel id>.tif, <fileName>_dilation_<parcel id>.tif and <fileName>_erosion_<parcel id>.tif.
+            */
+            void setDebugOutput(const std::string& fileName);
+
+            /*! \brief Adds a parcel, the geometry must be in the raster SRID and its ownership is taken. */
+            void addParcel(int parcelId, te::gm::Geometry* geom);
+
+            /*!
+              \brief Classifies all parcels.
+
+              \param centroids The tree centroids are appended in parcel order, the caller takes their ownership.
+              \param polygons  The tree crowns are appended in parcel order if setExportPolygons was called, the caller takes their ownership.
+            */
+            void execute(std::vector<CentroidInfo*>& centroids, std::vector<te::gm::Geometry*>& polygons);
+
+          protected:
+
+            /*! \brief Worker function, gets parcels from the queue until it is empty. */
+            void processParcels(std::size_t worker, std::vector<ParcelResult>& results, std::size_t begin, ParcelQueue& queue);
+
+            void processParcel(ClassificationPipeline& pipeline, const ParcelInfo& parcel, ParcelResult& result);
+
+            /*! \brief Classifies the parcel saving the intermediate rasters, see setDebugOutput. */
+            void processDebugParcel(ClassificationPipeline& pipeline, const ParcelInfo& parcel, ParcelResult& result, te::rst::Raster* mask);
+
+            std::size_t getParcelMemory(const te::gm::Geometry* geom) const;
+
+          protected:
+
+            te::rst::Raster* m_ndviRaster;
+            int m_ndviBand;
+            double m_threshold;
+            int m_dilation;
+            int m_erosion;
+
+            std::size_t m_nThreads;
+            std::size_t m_memoryBudget;
+            std::string m_maskFileName;
+            bool m_exportPolygons;
+            std::string m_debugFileName;
+
+            std::vector<ParcelInfo> m_parcels;
+            std::vector<ClassificationPipeline*> m_pipelines;   //!< One for each worker, kept between batches.
+
+            boost::mutex m_ioMutex;                         //!< Serializes the NDVI raster reads.
+            boost::mutex m_rasterMutex;                     //!< Serializes the mask raster creation and export.
+        };
+
+      } // end namespace thirdParty
+    }   // end namespace plugins
+  }     // end namespace qt
+}       // end namespace te
+
+#endif //__TE_QT_PLUGINS_THIRDPARTY_INTERNAL_PARCELCLASSIFICATION_H
@@ -33,6 +33,7 @@ TerraLib Team at <terralib-team@terralib.org>.
 #include <terralib/geometry/Polygon.h>
 #include <terralib/raster/Utils.h>
 
+#include "BinaryMorphology.h"
 #include "ForestMonitorClassification.h"
 #include "ParcelSet.h"
 
@@ -65,6 +66,9 @@ void te::qt::plugins::tv5plugins::ParcelSet::classify(te::rst::Raster* ndviRaste
   rInfo["FORCE_MEM_DRIVER"] = "TRUE";
   std::string type = "MEM";
 
+  //the morphology buffers are reused by all parcels
+  BinaryMorphology morphology;
+
   //create task
   std::size_t size = parcelDataSet->size();
   te::common::TaskProgress task("Creating Trees");
@@ -105,34 +109,32 @@ void te::qt::plugins::tv5plugins::ParcelSet::classify(te::rst::Raster* ndviRaste
     //create raster crop from parcel
     te::rst::RasterPtr parcelRaster(te::rst::CropRaster(*ndviRaster, *poly, rInfo, type));
 
-    std::auto_ptr<te::rst::Raster> thresholdRaster = GenerateThresholdRaster(parcelRaster.get(), ndviBand, threshold, type, rInfo);
-
-    //create erosion raster
-    std::auto_ptr<te::rst::Raster> erosionRaster = GenerateFilterRaster(thresholdRaster.get(), 0, nErosion, te::rp::Filter::InputParameters::DilationFilterT, type, rInfo);
+    std::auto_ptr<BinaryMask> mask = GenerateThresholdMask(parcelRaster.get(), ndviBand, threshold);
 
-    thresholdRaster.reset(0);
+    //erosion mask (dilation filter) and dilation mask (erosion filter), in place
+    morphology.dilate(*mask, nErosion);
 
-    //create dilation raster
-    std::auto_ptr<te::rst::Raster> dilationRaster = GenerateFilterRaster(erosionRaster.get(), 0, nDilation, te::rp::Filter::InputParameters::ErosionFilterT, type, rInfo);
-
-    erosionRaster.reset(0);
+    morphology.erode(*mask, nDilation);
 
+    //the mask raster is only created to be exported
     if (exportRaster)
     {
+      std::auto_ptr<te::rst::Raster> dilationRaster = GenerateMaskRaster(*mask, parcelRaster.get(), ndviBand, type, rInfo);
+
       te::qt::plugins::tv5plugins::ExportRaster(dilationRaster.get(), rasterPath);
     }
 
-    //create geometries
-    std::vector<te::gm::Geometry*> geomVec = te::qt::plugins::tv5plugins::Raster2Vector(dilationRaster.get(), 0);
+    //get centroids, labeling the mask
+    std::vector<te::qt::plugins::tv5plugins::CentroidInfo*> centroidsVec;
 
-    dilationRaster.reset(0);
+    te::qt::plugins::tv5plugins::ExtractCentroids(*mask, parcelRaster->getGrid(), centroidsVec, id);
 
-    //get centroids
-   // std::vector<te::qt::plugins::tv5plugins::CentroidInfo*> centroidsVec = te::qt::plugins::tv5plugins::ExtractCentroids(geomVec);
+    mask.reset(0);
 
-    te::common::FreeContents(geomVec);
+    for (std::size_t t = 0; t < centroidsVec.size(); ++t)
+      delete centroidsVec[t]->m_point;
 
-    geomVec.clear();
+    te::common::FreeContents(centroidsVec);
 
     task.pulse();
   }
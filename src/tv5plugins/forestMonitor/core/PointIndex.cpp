@@ -0,0 +1,214 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*! \file terralib/qt/plugins/thirdParty/forestMonitor/core/PointIndex.cpp
+
+    \brief This file contains spatial indexes for point (centroid) data.
+*/
+
+//TerraLib Includes
+#include "CentroidStore.h"
+#include "PointIndex.h"
+
+//STL Includes
+#include <cmath>
+
+// Boost
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+te::qt::plugins::tv5plugins::PointIndex::~PointIndex()
+{
+}
+
+te::qt::plugins::tv5plugins::RTreePointIndex::RTreePointIndex()
+{
+}
+
+te::qt::plugins::tv5plugins::RTreePointIndex::~RTreePointIndex()
+{
+  m_rtree.clear();
+}
+
+void te::qt::plugins::tv5plugins::RTreePointIndex::insert(double x, double y, int id)
+{
+  m_rtree.insert(te::gm::Envelope(x, y, x, y), id);
+}
+
+void te::qt::plugins::tv5plugins::RTreePointIndex::build(std::size_t nThreads)
+{
+  m_rtree.build(nThreads);
+}
+
+void te::qt::plugins::tv5plugins::RTreePointIndex::search(const te::gm::Envelope& ext, std::vector<int>& report) const
+{
+  m_rtree.search(ext, report);
+}
+
+void te::qt::plugins::tv5plugins::RTreePointIndex::clear()
+{
+  m_rtree.clear();
+}
+
+std::size_t te::qt::plugins::tv5plugins::RTreePointIndex::size() const
+{
+  return m_rtree.size();
+}
+
+te::qt::plugins::tv5plugins::GridPointIndex::GridPointIndex(double cellSize) :
+  m_cellSize(cellSize > 0. ? cellSize : 1.), m_size(0)
+{
+}
+
+te::qt::plugins::tv5plugins::GridPointIndex::~GridPointIndex()
+{
+}
+
+void te::qt::plugins::tv5plugins::GridPointIndex::insert(double x, double y, int id)
+{
+  Entry e;
+  e.m_x = x;
+  e.m_y = y;
+  e.m_id = id;
+
+  m_cells[getKey(getCell(x), getCell(y))].push_back(e);
+
+  ++m_size;
+}
+
+void te::qt::plugins::tv5plugins::GridPointIndex::build(std::size_t /*nThreads*/)
+{
+  //the cells are filled by insert
+}
+
+void te::qt::plugins::tv5plugins::GridPointIndex::search(const te::gm::Envelope& ext, std::vector<int>& report) const
+{
+  if(m_cells.empty())
+    return;
+
+  boost::int64_t col0 = getCell(ext.m_llx);
+  boost::int64_t col1 = getCell(ext.m_urx);
+  boost::int64_t row0 = getCell(ext.m_lly);
+  boost::int64_t row1 = getCell(ext.m_ury);
+
+  double nCells = (double)(col1 - col0 + 1) * (double)(row1 - row0 + 1);
+
+  //large envelopes (a parcel box) cover more cells than the index has, visit the non empty cells instead
+  if(nCells > (double)m_cells.size())
+  {
+    for(CellMap::const_iterator it = m_cells.begin(); it != m_cells.end(); ++it)
+      searchCell(it->second, ext, report);
+
+    return;
+  }
+
+  for(boost::int64_t row = row0; row <= row1; ++row)
+  {
+    for(boost::int64_t col = col0; col <= col1; ++col)
+    {
+      CellMap::const_iterator it = m_cells.find(getKey(col, row));
+
+      if(it != m_cells.end())
+        searchCell(it->second, ext, report);
+    }
+  }
+}
+
+void te::qt::plugins::tv5plugins::GridPointIndex::clear()
+{
+  m_cells.clear();
+
+  m_size = 0;
+}
+
+std::size_t te::qt::plugins::tv5plugins::GridPointIndex::size() const
+{
+  return m_size;
+}
+
+double te::qt::plugins::tv5plugins::GridPointIndex::getCellSize() const
+{
+  return m_cellSize;
+}
+
+boost::int64_t te::qt::plugins::tv5plugins::GridPointIndex::getCell(double v) const
+{
+  return (boost::int64_t)std::floor(v / m_cellSize);
+}
+
+boost::uint64_t te::qt::plugins::tv5plugins::GridPointIndex::getKey(boost::int64_t col, boost::int64_t row)
+{
+  return ((boost::uint64_t)(boost::uint32_t)col << 32) | (boost::uint64_t)(boost::uint32_t)row;
+}
+
+void te::qt::plugins::tv5plugins::GridPointIndex::searchCell(const std::vector<Entry>& cell, const te::gm::Envelope& ext, std::vector<int>& report) const
+{
+  for(std::size_t t = 0; t < cell.size(); ++t)
+  {
+    const Entry& e = cell[t];
+
+    if(e.m_x >= ext.m_llx && e.m_x <= ext.m_urx && e.m_y >= ext.m_lly && e.m_y <= ext.m_ury)
+      report.push_back(e.m_id);
+  }
+}
+
+std::auto_ptr<te::qt::plugins::tv5plugins::PointIndex> te::qt::plugins::tv5plugins::CreatePointIndex(PointIndexType type, double cellSize)
+{
+  if(type == GRID_POINT_INDEX)
+    return std::auto_ptr<PointIndex>(new GridPointIndex(cellSize));
+
+  return std::auto_ptr<PointIndex>(new RTreePointIndex());
+}
+
+te::qt::plugins::tv5plugins::PointIndexBenchmark te::qt::plugins::tv5plugins::BenchmarkPointIndex(PointIndexType type, const CentroidStore& centroids, double cellSize, double queryDist)
+{
+  PointIndexBenchmark result;
+  result.m_nResults = 0;
+
+  std::auto_ptr<PointIndex> index = CreatePointIndex(type, cellSize);
+
+  boost::posix_time::ptime start = boost::posix_time::microsec_clock::local_time();
+
+  for(std::size_t t = 0; t < centroids.size(); ++t)
+    index->insert(centroids.getX(t), centroids.getY(t), (int)t);
+
+  index->build(0);
+
+  boost::posix_time::ptime built = boost::posix_time::microsec_clock::local_time();
+
+  std::vector<int> report;
+
+  for(std::size_t t = 0; t < centroids.size(); ++t)
+  {
+    double x = centroids.getX(t);
+    double y = centroids.getY(t);
+
+    report.clear();
+
+    index->search(te::gm::Envelope(x - queryDist, y - queryDist, x + queryDist, y + queryDist), report);
+
+    result.m_nResults += report.size();
+  }
+
+  boost::posix_time::ptime end = boost::posix_time::microsec_clock::local_time();
+
+  result.m_buildTime = (built - start).total_microseconds() / 1000000.;
+  result.m_searchTime = (end - built).total_microseconds() / 1000000.;
+
+  return result;
+}
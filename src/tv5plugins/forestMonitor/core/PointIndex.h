@@ -0,0 +1,195 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*! \file terralib/qt/plugins/thirdParty/forestMonitor/core/PointIndex.h
+
+    \brief This file contains spatial indexes for point (centroid) data.
+*/
+
+#ifndef __TE_QT_PLUGINS_THIRDPARTY_INTERNAL_POINTINDEX_H
+#define __TE_QT_PLUGINS_THIRDPARTY_INTERNAL_POINTINDEX_H
+
+// TerraLib
+#include <terralib/geometry/Envelope.h>
+#include "../../Config.h"
+#include "../../PackedRTree.h"
+
+//STL Includes
+#include <memory>
+#include <vector>
+
+// Boost
+#include <boost/cstdint.hpp>
+#include <boost/unordered_map.hpp>
+
+namespace te
+{
+  namespace qt
+  {
+    namespace plugins
+    {
+      namespace tv5plugins
+      {
+        class CentroidStore;
+
+        /*! \brief Spatial index implementations available for point data. */
+        enum PointIndexType
+        {
+          RTREE_POINT_INDEX,    //!< R-tree packed with Sort-Tile-Recursive.
+          GRID_POINT_INDEX      //!< Uniform grid hashed by cell.
+        };
+
+        /*!
+          \class PointIndex
+
+          \brief Interface of a spatial index over points, each point is identified by an int.
+
+          The points are found by search only after build is called. Searching is read
+          only, so concurrent searches on the same index are allowed.
+        */
+        class PointIndex
+        {
+          public:
+
+            virtual ~PointIndex();
+
+            virtual void insert(double x, double y, int id) = 0;
+
+            /*! \brief Finishes the index after all points are inserted, 0 threads uses the number of hardware threads. */
+            virtual void build(std::size_t nThreads) = 0;
+
+            /*! \brief Appends to report the id of each point inside the envelope. */
+            virtual void search(const te::gm::Envelope& ext, std::vector<int>& report) const = 0;
+
+            virtual void clear() = 0;
+
+            virtual std::size_t size() const = 0;
+        };
+
+        /*!
+          \class RTreePointIndex
+
+          \brief Point index backed by a bulk loaded R-tree.
+        */
+        class RTreePointIndex : public PointIndex
+        {
+          public:
+
+            RTreePointIndex();
+
+            ~RTreePointIndex();
+
+            void insert(double x, double y, int id);
+
+            void build(std::size_t nThreads);
+
+            void search(const te::gm::Envelope& ext, std::vector<int>& report) const;
+
+            void clear();
+
+            std::size_t size() const;
+
+          protected:
+
+            PackedRTree m_rtree;
+        };
+
+        /*!
+          \class GridPointIndex
+
+          \brief Point index with a fixed cell size, cells are kept in a hash map.
+
+          The cell of a point is found in constant time, so a search only visits the cells
+          covered by the envelope. Plantation centroids are almost uniformly spaced, using
+          the planting distance as cell size gives a few points per cell.
+        */
+        class GridPointIndex : public PointIndex
+        {
+          public:
+
+            struct Entry
+            {
+              double m_x;
+              double m_y;
+              int m_id;
+            };
+
+            GridPointIndex(double cellSize);
+
+            ~GridPointIndex();
+
+            void insert(double x, double y, int id);
+
+            void build(std::size_t nThreads);
+
+            void search(const te::gm::Envelope& ext, std::vector<int>& report) const;
+
+            void clear();
+
+            std::size_t size() const;
+
+            double getCellSize() const;
+
+          protected:
+
+            boost::int64_t getCell(double v) const;
+
+            static boost::uint64_t getKey(boost::int64_t col, boost::int64_t row);
+
+            void searchCell(const std::vector<Entry>& cell, const te::gm::Envelope& ext, std::vector<int>& report) const;
+
+          protected:
+
+            typedef boost::unordered_map<boost::uint64_t, std::vector<Entry> > CellMap;
+
+            double m_cellSize;
+            CellMap m_cells;        //!< Points of each non empty cell.
+            std::size_t m_size;
+        };
+
+        /*!
+          \brief Creates a point index.
+
+          \param type     The index implementation.
+          \param cellSize The cell size used by the grid index, usually the planting distance.
+        */
+        std::auto_ptr<PointIndex> CreatePointIndex(PointIndexType type, double cellSize);
+
+        /*! \brief Timing of a point index benchmark, in seconds. */
+        struct PointIndexBenchmark
+        {
+          double m_buildTime;
+          double m_searchTime;
+          std::size_t m_nResults;   //!< Total number of points found, should match between index types.
+        };
+
+        /*!
+          \brief Measures the time to index the centroids and to run one neighbor query per centroid.
+
+          Each query is a box of size queryDist around the centroid, the same shape used
+          by the track detection.
+        */
+        PointIndexBenchmark BenchmarkPointIndex(PointIndexType type, const CentroidStore& centroids, double cellSize, double queryDist);
+
+      } // end namespace thirdParty
+    }   // end namespace plugins
+  }     // end namespace qt
+}       // end namespace te
+
+#endif //__TE_QT_PLUGINS_THIRDPARTY_INTERNAL_POINTINDEX_H
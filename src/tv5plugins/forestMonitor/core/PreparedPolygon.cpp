@@ -0,0 +1,196 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*! \file terralib/qt/plugins/thirdParty/forestMonitor/core/PreparedPolygon.cpp
+
+    \brief This file contains a polygon prepared for fast point in polygon tests.
+*/
+
+//TerraLib Includes
+#include <terralib/geometry/LinearRing.h>
+#include <terralib/geometry/MultiPolygon.h>
+#include <terralib/geometry/Polygon.h>
+#include "PreparedPolygon.h"
+
+//STL Includes
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+te::qt::plugins::tv5plugins::PreparedPolygon::PreparedPolygon(const te::gm::Geometry* geom) :
+  m_nBands(0),
+  m_bandHeight(0.)
+{
+  assert(geom);
+
+  m_mbr = *geom->getMBR();
+
+  if(geom->getGeomTypeId() == te::gm::MultiPolygonType)
+  {
+    const te::gm::MultiPolygon* mPoly = dynamic_cast<const te::gm::MultiPolygon*>(geom);
+
+    for(std::size_t t = 0; t < mPoly->getNumGeometries(); ++t)
+      addPolygon(dynamic_cast<const te::gm::Polygon*>(mPoly->getGeometryN(t)));
+  }
+  else if(geom->getGeomTypeId() == te::gm::PolygonType)
+  {
+    addPolygon(dynamic_cast<const te::gm::Polygon*>(geom));
+  }
+
+  buildIndex();
+}
+
+te::qt::plugins::tv5plugins::PreparedPolygon::~PreparedPolygon()
+{
+}
+
+bool te::qt::plugins::tv5plugins::PreparedPolygon::contains(double x, double y) const
+{
+  if(m_nBands == 0 || x < m_mbr.m_llx || x > m_mbr.m_urx || y < m_mbr.m_lly || y > m_mbr.m_ury)
+    return false;
+
+  std::size_t band = (std::size_t)((y - m_mbr.m_lly) / m_bandHeight);
+
+  if(band >= m_nBands)
+    band = m_nBands - 1;
+
+  bool inside = false;
+
+  for(std::size_t t = m_bandOffsets[band]; t < m_bandOffsets[band + 1]; ++t)
+  {
+    const Edge& e = m_edges[m_bandEdges[t]];
+
+    //half open rule, a vertex is counted only once
+    if((e.m_y0 > y) != (e.m_y1 > y))
+    {
+      double xCross = e.m_x0 + (y - e.m_y0) * (e.m_x1 - e.m_x0) / (e.m_y1 - e.m_y0);
+
+      if(x < xCross)
+        inside = !inside;
+    }
+  }
+
+  return inside;
+}
+
+void te::qt::plugins::tv5plugins::PreparedPolygon::getCrossings(double y, std::vector<double>& xs) const
+{
+  xs.clear();
+
+  if(m_nBands == 0 || y < m_mbr.m_lly || y > m_mbr.m_ury)
+    return;
+
+  std::size_t band = (std::size_t)((y - m_mbr.m_lly) / m_bandHeight);
+
+  if(band >= m_nBands)
+    band = m_nBands - 1;
+
+  for(std::size_t t = m_bandOffsets[band]; t < m_bandOffsets[band + 1]; ++t)
+  {
+    const Edge& e = m_edges[m_bandEdges[t]];
+
+    //same half open rule used by contains
+    if((e.m_y0 > y) != (e.m_y1 > y))
+      xs.push_back(e.m_x0 + (y - e.m_y0) * (e.m_x1 - e.m_x0) / (e.m_y1 - e.m_y0));
+  }
+
+  std::sort(xs.begin(), xs.end());
+}
+
+const te::gm::Envelope& te::qt::plugins::tv5plugins::PreparedPolygon::getMBR() const
+{
+  return m_mbr;
+}
+
+void te::qt::plugins::tv5plugins::PreparedPolygon::addPolygon(const te::gm::Polygon* poly)
+{
+  if(!poly)
+    return;
+
+  for(std::size_t t = 0; t < poly->getNumRings(); ++t)
+    addRing(dynamic_cast<const te::gm::LineString*>(poly->getRingN(t)));
+}
+
+void te::qt::plugins::tv5plugins::PreparedPolygon::addRing(const te::gm::LineString* ring)
+{
+  if(!ring || ring->size() < 2)
+    return;
+
+  for(std::size_t t = 0; t + 1 < ring->size(); ++t)
+  {
+    Edge e;
+    e.m_x0 = ring->getX(t);
+    e.m_y0 = ring->getY(t);
+    e.m_x1 = ring->getX(t + 1);
+    e.m_y1 = ring->getY(t + 1);
+
+    //horizontal edges never cross a row
+    if(e.m_y0 != e.m_y1)
+      m_edges.push_back(e);
+  }
+}
+
+void te::qt::plugins::tv5plugins::PreparedPolygon::buildIndex()
+{
+  if(m_edges.empty())
+    return;
+
+  //a few edges per band
+  m_nBands = std::max<std::size_t>(1, (std::size_t)std::sqrt((double)m_edges.size()));
+
+  m_bandHeight = (m_mbr.m_ury - m_mbr.m_lly) / (double)m_nBands;
+
+  if(m_bandHeight <= 0.)
+  {
+    m_nBands = 1;
+    m_bandHeight = 1.;
+  }
+
+  //count the edges of each band
+  std::vector<std::size_t> first(m_edges.size());
+  std::vector<std::size_t> last(m_edges.size());
+
+  m_bandOffsets.assign(m_nBands + 1, 0);
+
+  for(std::size_t t = 0; t < m_edges.size(); ++t)
+  {
+    double minY = std::min(m_edges[t].m_y0, m_edges[t].m_y1);
+    double maxY = std::max(m_edges[t].m_y0, m_edges[t].m_y1);
+
+    first[t] = std::min(m_nBands - 1, (std::size_t)std::max(0., (minY - m_mbr.m_lly) / m_bandHeight));
+    last[t] = std::min(m_nBands - 1, (std::size_t)std::max(0., (maxY - m_mbr.m_lly) / m_bandHeight));
+
+    for(std::size_t b = first[t]; b <= last[t]; ++b)
+      ++m_bandOffsets[b + 1];
+  }
+
+  for(std::size_t b = 0; b < m_nBands; ++b)
+    m_bandOffsets[b + 1] += m_bandOffsets[b];
+
+  //fill bands
+  std::vector<std::size_t> pos(m_bandOffsets.begin(), m_bandOffsets.end() - 1);
+
+  m_bandEdges.resize(m_bandOffsets[m_nBands]);
+
+  for(std::size_t t = 0; t < m_edges.size(); ++t)
+  {
+    for(std::size_t b = first[t]; b <= last[t]; ++b)
+      m_bandEdges[pos[b]++] = t;
+  }
+}
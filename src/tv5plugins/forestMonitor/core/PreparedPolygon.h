@@ -0,0 +1,107 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*! \file terralib/qt/plugins/thirdParty/forestMonitor/core/PreparedPolygon.h
+
+    \brief This file contains a polygon prepared for fast point in polygon tests.
+*/
+
+#ifndef __TE_QT_PLUGINS_THIRDPARTY_INTERNAL_PREPAREDPOLYGON_H
+#define __TE_QT_PLUGINS_THIRDPARTY_INTERNAL_PREPAREDPOLYGON_H
+
+// TerraLib
+#include <terralib/geometry/Envelope.h>
+#include "../../Config.h"
+
+//STL Includes
+#include <vector>
+
+namespace te
+{
+  namespace gm
+  {
+    class Geometry;
+    class LineString;
+    class Polygon;
+  }
+
+  namespace qt
+  {
+    namespace plugins
+    {
+      namespace tv5plugins
+      {
+        /*!
+          \class PreparedPolygon
+
+          \brief Polygon (or multi polygon) prepared for point in polygon tests.
+
+          The ring edges are copied and indexed by horizontal bands, so a test
+          only checks the edges that cross the point row (crossing number rule).
+          Points exactly over the boundary may be reported as inside or outside.
+        */
+        class PreparedPolygon
+        {
+          public:
+
+            PreparedPolygon(const te::gm::Geometry* geom);
+
+            ~PreparedPolygon();
+
+          public:
+
+            bool contains(double x, double y) const;
+
+            /*! \brief Sorted x coordinates where the horizontal line y crosses the rings, inside spans are [xs[0], xs[1]), [xs[2], xs[3]), ... */
+            void getCrossings(double y, std::vector<double>& xs) const;
+
+            const te::gm::Envelope& getMBR() const;
+
+          protected:
+
+            void addPolygon(const te::gm::Polygon* poly);
+
+            void addRing(const te::gm::LineString* ring);
+
+            void buildIndex();
+
+          protected:
+
+            struct Edge
+            {
+              double m_x0;
+              double m_y0;
+              double m_x1;
+              double m_y1;
+            };
+
+            std::vector<Edge> m_edges;                  //!< Edges from all rings.
+            std::vector<std::size_t> m_bandOffsets;     //!< Edges of band i are in [m_bandOffsets[i], m_bandOffsets[i + 1]).
+            std::vector<std::size_t> m_bandEdges;       //!< Edge indexes ordered by band.
+            std::size_t m_nBands;
+            double m_bandHeight;
+            te::gm::Envelope m_mbr;
+        };
+
+      } // end namespace thirdParty
+    }   // end namespace plugins
+  }     // end namespace qt
+}       // end namespace te
+
+#endif //__TE_QT_PLUGINS_THIRDPARTY_INTERNAL_PREPAREDPOLYGON_H
@@ -0,0 +1,642 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*! \file terralib/qt/plugins/thirdParty/forestMonitor/core/RasterBlock.cpp
+
+    \brief This file contains functions to read and write whole blocks of a raster band.
+*/
+
+//TerraLib Includes
+#include <terralib/common/progress/TaskProgress.h>
+#include <terralib/common/Exception.h>
+#include <terralib/datatype/Enums.h>
+#include <terralib/raster/Band.h>
+#include <terralib/raster/BandProperty.h>
+#include <terralib/raster/Raster.h>
+#include "RasterBlock.h"
+
+//STL Includes
+#include <algorithm>
+
+// Boost
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+//interval used by the calling thread to check the cancel while the workers run
+#define PROGRESS_INTERVAL_MS 100
+
+//default memory budget of the window buffers, in bytes
+#define DEFAULT_MEMORY_BUDGET 268435456
+
+namespace
+{
+  template<class T, class V> void ToValues(const unsigned char* raw, V* values, std::size_t size)
+  {
+    const T* in = reinterpret_cast<const T*>(raw);
+
+    for(std::size_t t = 0; t < size; ++t)
+      values[t] = (V)in[t];
+  }
+
+  template<class T, class V> void FromValues(const V* values, unsigned char* raw, std::size_t size)
+  {
+    T* out = reinterpret_cast<T*>(raw);
+
+    for(std::size_t t = 0; t < size; ++t)
+      out[t] = (T)values[t];
+  }
+
+  /*! \brief Data type of the band that holds values of type V. */
+  template<class V> int GetDataType();
+
+  template<> int GetDataType<unsigned char>() { return te::dt::UCHAR_TYPE; }
+
+  template<> int GetDataType<boost::uint16_t>() { return te::dt::UINT16_TYPE; }
+
+  template<> int GetDataType<float>() { return te::dt::FLOAT_TYPE; }
+
+  template<> int GetDataType<double>() { return te::dt::DOUBLE_TYPE; }
+
+  /*! \brief Shared cursor used by the worker threads to get the next block. */
+  struct BlockQueue
+  {
+    boost::mutex m_mutex;
+    boost::condition_variable m_condition;
+    std::size_t m_next;
+    std::size_t m_done;
+    std::size_t m_running;
+    bool m_canceled;
+    std::string m_errorMessage;
+  };
+
+  void ProcessBlocks(const std::vector<te::qt::plugins::tv5plugins::RasterBlock>& blocks,
+                     const boost::function<void (std::size_t, const te::qt::plugins::tv5plugins::RasterBlock&)>& func,
+                     std::size_t worker, BlockQueue& queue)
+  {
+    while(true)
+    {
+      std::size_t idx = 0;
+
+      {
+        boost::mutex::scoped_lock lock(queue.m_mutex);
+
+        if(queue.m_canceled || !queue.m_errorMessage.empty() || queue.m_next >= blocks.size())
+          break;
+
+        idx = queue.m_next++;
+      }
+
+      std::string errorMessage;
+
+      try
+      {
+        func(worker, blocks[idx]);
+      }
+      catch(const std::exception& e)
+      {
+        errorMessage = e.what();
+      }
+      catch(...)
+      {
+        errorMessage = "Error processing raster block.";
+      }
+
+      boost::mutex::scoped_lock lock(queue.m_mutex);
+
+      if(!errorMessage.empty() && queue.m_errorMessage.empty())
+        queue.m_errorMessage = errorMessage;
+
+      ++queue.m_done;
+
+      queue.m_condition.notify_all();
+    }
+
+    boost::mutex::scoped_lock lock(queue.m_mutex);
+
+    --queue.m_running;
+
+    queue.m_condition.notify_all();
+  }
+
+  /*! \brief Smallest number of blocks of blockSize pixels whose size is a multiple of align. */
+  std::size_t GetAlignStep(std::size_t blockSize, std::size_t align)
+  {
+    std::size_t a = blockSize;
+    std::size_t b = std::max<std::size_t>(1, align);
+
+    while(b != 0)
+    {
+      std::size_t r = a % b;
+      a = b;
+      b = r;
+    }
+
+    return std::max<std::size_t>(1, align) / a;
+  }
+
+  bool IsBlockType(int type)
+  {
+    switch(type)
+    {
+      case te::dt::CHAR_TYPE:
+      case te::dt::UCHAR_TYPE:
+      case te::dt::INT16_TYPE:
+      case te::dt::UINT16_TYPE:
+      case te::dt::INT32_TYPE:
+      case te::dt::UINT32_TYPE:
+      case te::dt::FLOAT_TYPE:
+      case te::dt::DOUBLE_TYPE:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  /*! \brief Reads a block as values of type V, the bands of type V are read without conversion. */
+  template<class V> void ReadBlockValues(const te::rst::Band* band, const te::qt::plugins::tv5plugins::RasterBlock& block,
+                                         std::vector<unsigned char>& raw, V* values)
+  {
+    if(!te::qt::plugins::tv5plugins::HasBlockLayout(band, block))
+    {
+      double value = 0.;
+
+      for(unsigned int r = 0; r < block.m_validRows; ++r)
+      {
+        V* line = values + r * block.m_width;
+
+        for(unsigned int c = 0; c < block.m_validCols; ++c)
+        {
+          band->getValue(block.m_col + c, block.m_row + r, value);
+
+          line[c] = (V)value;
+        }
+      }
+
+      return;
+    }
+
+    if(band->getProperty()->m_type == GetDataType<V>())
+    {
+      band->read(block.m_blockX, block.m_blockY, values);
+
+      return;
+    }
+
+    std::size_t size = (std::size_t)block.m_width * block.m_height;
+
+    raw.resize(band->getBlockSize());
+
+    band->read(block.m_blockX, block.m_blockY, &raw[0]);
+
+    switch(band->getProperty()->m_type)
+    {
+      case te::dt::CHAR_TYPE:   ToValues<char>(&raw[0], values, size); break;
+      case te::dt::UCHAR_TYPE:  ToValues<unsigned char>(&raw[0], values, size); break;
+      case te::dt::INT16_TYPE:  ToValues<boost::int16_t>(&raw[0], values, size); break;
+      case te::dt::UINT16_TYPE: ToValues<boost::uint16_t>(&raw[0], values, size); break;
+      case te::dt::INT32_TYPE:  ToValues<boost::int32_t>(&raw[0], values, size); break;
+      case te::dt::UINT32_TYPE: ToValues<boost::uint32_t>(&raw[0], values, size); break;
+      case te::dt::FLOAT_TYPE:  ToValues<float>(&raw[0], values, size); break;
+      case te::dt::DOUBLE_TYPE: ToValues<double>(&raw[0], values, size); break;
+    }
+  }
+
+  /*! \brief Writes a block of values of type V, see ReadBlockValues. */
+  template<class V> void WriteBlockValues(te::rst::Band* band, const te::qt::plugins::tv5plugins::RasterBlock& block,
+                                          std::vector<unsigned char>& raw, const V* values)
+  {
+    if(!te::qt::plugins::tv5plugins::HasBlockLayout(band, block))
+    {
+      for(unsigned int r = 0; r < block.m_validRows; ++r)
+      {
+        const V* line = values + r * block.m_width;
+
+        for(unsigned int c = 0; c < block.m_validCols; ++c)
+          band->setValue(block.m_col + c, block.m_row + r, (double)line[c]);
+      }
+
+      return;
+    }
+
+    std::size_t size = (std::size_t)block.m_width * block.m_height;
+
+    raw.resize(band->getBlockSize());
+
+    switch(band->getProperty()->m_type)
+    {
+      case te::dt::CHAR_TYPE:   FromValues<char>(values, &raw[0], size); break;
+      case te::dt::UCHAR_TYPE:  FromValues<unsigned char>(values, &raw[0], size); break;
+      case te::dt::INT16_TYPE:  FromValues<boost::int16_t>(values, &raw[0], size); break;
+      case te::dt::UINT16_TYPE: FromValues<boost::uint16_t>(values, &raw[0], size); break;
+      case te::dt::INT32_TYPE:  FromValues<boost::int32_t>(values, &raw[0], size); break;
+      case te::dt::UINT32_TYPE: FromValues<boost::uint32_t>(values, &raw[0], size); break;
+      case te::dt::FLOAT_TYPE:  FromValues<float>(values, &raw[0], size); break;
+      case te::dt::DOUBLE_TYPE: FromValues<double>(values, &raw[0], size); break;
+    }
+
+    band->write(block.m_blockX, block.m_blockY, &raw[0]);
+  }
+
+  /*! \brief Band block that contains the pixel (bx * blkw, by * blkh), clipped by the raster. */
+  te::qt::plugins::tv5plugins::RasterBlock GetBandBlock(const te::rst::Band* band, unsigned int bx, unsigned int by)
+  {
+    const te::rst::BandProperty* prop = band->getProperty();
+    const te::rst::Raster* raster = band->getRaster();
+
+    unsigned int blkw = (unsigned int)prop->m_blkw;
+    unsigned int blkh = (unsigned int)prop->m_blkh;
+
+    te::qt::plugins::tv5plugins::RasterBlock block;
+    block.m_blockX = (int)bx;
+    block.m_blockY = (int)by;
+    block.m_col = bx * blkw;
+    block.m_row = by * blkh;
+    block.m_width = blkw;
+    block.m_height = blkh;
+    block.m_validCols = std::min(blkw, raster->getNumberOfColumns() - block.m_col);
+    block.m_validRows = std::min(blkh, raster->getNumberOfRows() - block.m_row);
+
+    return block;
+  }
+
+  template<class V> void ReadWindowValues(const te::rst::Band* band, unsigned int col, unsigned int row, unsigned int width, unsigned int height,
+                                          std::vector<unsigned char>& raw, std::vector<V>& blockValues, V* values)
+  {
+    const te::rst::BandProperty* prop = band->getProperty();
+
+    if(prop->m_blkw <= 0 || prop->m_blkh <= 0)
+    {
+      double value = 0.;
+
+      for(unsigned int r = 0; r < height; ++r)
+      {
+        for(unsigned int c = 0; c < width; ++c)
+        {
+          band->getValue(col + c, row + r, value);
+
+          values[(std::size_t)r * width + c] = (V)value;
+        }
+      }
+
+      return;
+    }
+
+    unsigned int blkw = (unsigned int)prop->m_blkw;
+    unsigned int blkh = (unsigned int)prop->m_blkh;
+
+    blockValues.resize((std::size_t)blkw * blkh);
+
+    for(unsigned int by = row / blkh; by * blkh < row + height; ++by)
+    {
+      for(unsigned int bx = col / blkw; bx * blkw < col + width; ++bx)
+      {
+        te::qt::plugins::tv5plugins::RasterBlock block = GetBandBlock(band, bx, by);
+
+        ReadBlockValues(band, block, raw, &blockValues[0]);
+
+        //copy the part of the block inside the window
+        unsigned int c0 = std::max(col, block.m_col);
+        unsigned int c1 = std::min(col + width, block.m_col + block.m_validCols);
+        unsigned int r0 = std::max(row, block.m_row);
+        unsigned int r1 = std::min(row + height, block.m_row + block.m_validRows);
+
+        for(unsigned int r = r0; r < r1; ++r)
+        {
+          const V* in = &blockValues[(std::size_t)(r - block.m_row) * blkw + (c0 - block.m_col)];
+
+          std::copy(in, in + (c1 - c0), values + (std::size_t)(r - row) * width + (c0 - col));
+        }
+      }
+    }
+  }
+
+  template<class V> void WriteWindowValues(te::rst::Band* band, unsigned int col, unsigned int row, unsigned int width, unsigned int height,
+                                           std::vector<unsigned char>& raw, std::vector<V>& blockValues, const V* values)
+  {
+    const te::rst::BandProperty* prop = band->getProperty();
+
+    if(prop->m_blkw <= 0 || prop->m_blkh <= 0)
+    {
+      for(unsigned int r = 0; r < height; ++r)
+      {
+        for(unsigned int c = 0; c < width; ++c)
+          band->setValue(col + c, row + r, (double)values[(std::size_t)r * width + c]);
+      }
+
+      return;
+    }
+
+    unsigned int blkw = (unsigned int)prop->m_blkw;
+    unsigned int blkh = (unsigned int)prop->m_blkh;
+
+    blockValues.resize((std::size_t)blkw * blkh);
+
+    for(unsigned int by = row / blkh; by * blkh < row + height; ++by)
+    {
+      for(unsigned int bx = col / blkw; bx * blkw < col + width; ++bx)
+      {
+        te::qt::plugins::tv5plugins::RasterBlock block = GetBandBlock(band, bx, by);
+
+        unsigned int c0 = std::max(col, block.m_col);
+        unsigned int c1 = std::min(col + width, block.m_col + block.m_validCols);
+        unsigned int r0 = std::max(row, block.m_row);
+        unsigned int r1 = std::min(row + height, block.m_row + block.m_validRows);
+
+        //blocks partially inside the window are written pixel by pixel, so the pixels outside it are kept
+        if(c0 != block.m_col || c1 != block.m_col + block.m_validCols || r0 != block.m_row || r1 != block.m_row + block.m_validRows)
+        {
+          for(unsigned int r = r0; r < r1; ++r)
+          {
+            for(unsigned int c = c0; c < c1; ++c)
+              band->setValue(c, r, (double)values[(std::size_t)(r - row) * width + (c - col)]);
+          }
+
+          continue;
+        }
+
+        if(block.m_validCols != blkw || block.m_validRows != blkh)
+          std::fill(blockValues.begin(), blockValues.end(), V());
+
+        for(unsigned int r = r0; r < r1; ++r)
+        {
+          const V* in = values + (std::size_t)(r - row) * width + (c0 - col);
+
+          std::copy(in, in + (c1 - c0), &blockValues[(std::size_t)(r - block.m_row) * blkw]);
+        }
+
+        WriteBlockValues(band, block, raw, &blockValues[0]);
+      }
+    }
+  }
+}
+
+std::vector<te::qt::plugins::tv5plugins::RasterBlock> te::qt::plugins::tv5plugins::GetRasterBlocks(const te::rst::Band* band, unsigned int nCols, unsigned int nRows)
+{
+  const te::rst::BandProperty* prop = band->getProperty();
+
+  unsigned int blkw = prop->m_blkw > 0 ? (unsigned int)prop->m_blkw : nCols;
+  unsigned int blkh = prop->m_blkh > 0 ? (unsigned int)prop->m_blkh : 1;
+
+  std::vector<RasterBlock> blocks;
+
+  for(unsigned int row = 0, by = 0; row < nRows; row += blkh, ++by)
+  {
+    for(unsigned int col = 0, bx = 0; col < nCols; col += blkw, ++bx)
+    {
+      RasterBlock block;
+      block.m_blockX = (int)bx;
+      block.m_blockY = (int)by;
+      block.m_col = col;
+      block.m_row = row;
+      block.m_width = blkw;
+      block.m_height = blkh;
+      block.m_validCols = std::min(blkw, nCols - col);
+      block.m_validRows = std::min(blkh, nRows - row);
+
+      blocks.push_back(block);
+    }
+  }
+
+  return blocks;
+}
+
+std::vector<te::qt::plugins::tv5plugins::RasterBlock> te::qt::plugins::tv5plugins::GetRasterWindows(const te::rst::Band* band, unsigned int nCols, unsigned int nRows,
+                                                                                                   std::size_t maxPixels, unsigned int align)
+{
+  const te::rst::BandProperty* prop = band->getProperty();
+
+  unsigned int blkw = prop->m_blkw > 0 ? (unsigned int)prop->m_blkw : nCols;
+  unsigned int blkh = prop->m_blkh > 0 ? (unsigned int)prop->m_blkh : 1;
+
+  std::vector<RasterBlock> windows;
+
+  if(nCols == 0 || nRows == 0)
+    return windows;
+
+  std::size_t blockPixels = (std::size_t)blkw * blkh;
+  std::size_t nBlocksX = (nCols + blkw - 1) / blkw;
+  std::size_t rowPixels = blockPixels * nBlocksX;
+
+  //number of blocks whose size is a multiple of align
+  std::size_t stepX = GetAlignStep(blkw, align);
+  std::size_t stepY = GetAlignStep(blkh, align);
+
+  std::size_t windowBlocksX = nBlocksX;
+  std::size_t windowBlocksY = stepY;
+
+  if(rowPixels * stepY <= maxPixels)
+    windowBlocksY = std::max(stepY, maxPixels / rowPixels / stepY * stepY);
+  else
+    windowBlocksX = std::max(stepX, maxPixels / (blockPixels * stepY) / stepX * stepX);
+
+  for(std::size_t by = 0; by * blkh < nRows; by += windowBlocksY)
+  {
+    for(std::size_t bx = 0; bx * blkw < nCols; bx += windowBlocksX)
+    {
+      RasterBlock window;
+      window.m_blockX = (int)bx;
+      window.m_blockY = (int)by;
+      window.m_col = (unsigned int)(bx * blkw);
+      window.m_row = (unsigned int)(by * blkh);
+      window.m_validCols = (unsigned int)std::min<std::size_t>(windowBlocksX * blkw, nCols - window.m_col);
+      window.m_validRows = (unsigned int)std::min<std::size_t>(windowBlocksY * blkh, nRows - window.m_row);
+      window.m_width = window.m_validCols;
+      window.m_height = window.m_validRows;
+
+      windows.push_back(window);
+    }
+  }
+
+  return windows;
+}
+
+std::vector<te::qt::plugins::tv5plugins::RasterBlock> te::qt::plugins::tv5plugins::GetBudgetWindows(const te::rst::Band* band, unsigned int nCols, unsigned int nRows,
+                                                                                                   std::size_t memoryBudget, std::size_t bytesPerPixel,
+                                                                                                   std::size_t& nThreads, unsigned int align)
+{
+  if(memoryBudget == 0)
+    memoryBudget = DEFAULT_MEMORY_BUDGET;
+
+  //the memory budget is split between the workers, each one needs at least the smallest aligned window
+  const te::rst::BandProperty* prop = band->getProperty();
+
+  std::size_t blkw = prop->m_blkw > 0 ? (std::size_t)prop->m_blkw : nCols;
+  std::size_t blkh = prop->m_blkh > 0 ? (std::size_t)prop->m_blkh : 1;
+
+  std::size_t budgetPixels = std::max<std::size_t>(1, memoryBudget / std::max<std::size_t>(1, bytesPerPixel));
+  std::size_t minPixels = std::min<std::size_t>(blkw * GetAlignStep(blkw, align), nCols) * blkh * GetAlignStep(blkh, align);
+
+  nThreads = std::max<std::size_t>(1, std::min(GetNumberOfThreads(nThreads), budgetPixels / std::max<std::size_t>(1, minPixels)));
+
+  std::vector<RasterBlock> windows = GetRasterWindows(band, nCols, nRows, budgetPixels / nThreads, align);
+
+  nThreads = std::max<std::size_t>(1, std::min(nThreads, windows.size()));
+
+  return windows;
+}
+
+std::size_t te::qt::plugins::tv5plugins::GetMaxWindowSize(const std::vector<RasterBlock>& windows)
+{
+  std::size_t size = 0;
+
+  for(std::size_t t = 0; t < windows.size(); ++t)
+    size = std::max(size, (std::size_t)windows[t].m_width * windows[t].m_height);
+
+  return size;
+}
+
+bool te::qt::plugins::tv5plugins::HasBlockLayout(const te::rst::Band* band, const RasterBlock& block)
+{
+  const te::rst::BandProperty* prop = band->getProperty();
+
+  return prop->m_blkw == (int)block.m_width && prop->m_blkh == (int)block.m_height && IsBlockType(prop->m_type);
+}
+
+void te::qt::plugins::tv5plugins::ReadBlock(const te::rst::Band* band, const RasterBlock& block, std::vector<unsigned char>& raw, double* values)
+{
+  ReadBlockValues(band, block, raw, values);
+}
+
+void te::qt::plugins::tv5plugins::WriteBlock(te::rst::Band* band, const RasterBlock& block, std::vector<unsigned char>& raw, const double* values)
+{
+  WriteBlockValues(band, block, raw, values);
+}
+
+void te::qt::plugins::tv5plugins::ReadWindow(const te::rst::Band* band, unsigned int col, unsigned int row, unsigned int width, unsigned int height,
+                                             std::vector<unsigned char>& raw, std::vector<double>& blockValues, double* values)
+{
+  ReadWindowValues(band, col, row, width, height, raw, blockValues, values);
+}
+
+void te::qt::plugins::tv5plugins::ReadWindow(const te::rst::Band* band, unsigned int col, unsigned int row, unsigned int width, unsigned int height,
+                                             std::vector<unsigned char>& raw, std::vector<unsigned char>& blockValues, unsigned char* values)
+{
+  ReadWindowValues(band, col, row, width, height, raw, blockValues, values);
+}
+
+void te::qt::plugins::tv5plugins::ReadWindow(const te::rst::Band* band, unsigned int col, unsigned int row, unsigned int width, unsigned int height,
+                                             std::vector<unsigned char>& raw, std::vector<boost::uint16_t>& blockValues, boost::uint16_t* values)
+{
+  ReadWindowValues(band, col, row, width, height, raw, blockValues, values);
+}
+
+void te::qt::plugins::tv5plugins::ReadWindow(const te::rst::Band* band, unsigned int col, unsigned int row, unsigned int width, unsigned int height,
+                                             std::vector<unsigned char>& raw, std::vector<float>& blockValues, float* values)
+{
+  ReadWindowValues(band, col, row, width, height, raw, blockValues, values);
+}
+
+void te::qt::plugins::tv5plugins::WriteWindow(te::rst::Band* band, unsigned int col, unsigned int row, unsigned int width, unsigned int height,
+                                              std::vector<unsigned char>& raw, std::vector<double>& blockValues, const double* values)
+{
+  WriteWindowValues(band, col, row, width, height, raw, blockValues, values);
+}
+
+void te::qt::plugins::tv5plugins::WriteWindow(te::rst::Band* band, unsigned int col, unsigned int row, unsigned int width, unsigned int height,
+                                              std::vector<unsigned char>& raw, std::vector<unsigned char>& blockValues, const unsigned char* values)
+{
+  WriteWindowValues(band, col, row, width, height, raw, blockValues, values);
+}
+
+void te::qt::plugins::tv5plugins::WriteWindow(te::rst::Band* band, unsigned int col, unsigned int row, unsigned int width, unsigned int height,
+                                              std::vector<unsigned char>& raw, std::vector<float>& blockValues, const float* values)
+{
+  WriteWindowValues(band, col, row, width, height, raw, blockValues, values);
+}
+
+std::size_t te::qt::plugins::tv5plugins::GetNumberOfThreads(std::size_t nThreads)
+{
+  if(nThreads == 0)
+    nThreads = boost::thread::hardware_concurrency();
+
+  if(nThreads == 0)
+    nThreads = 1;
+
+  return nThreads;
+}
+
+void te::qt::plugins::tv5plugins::ProcessRasterBlocks(const std::vector<RasterBlock>& blocks, const boost::function<void (std::size_t, const RasterBlock&)>& func,
+                                                      std::size_t nThreads, const std::string& message)
+{
+  te::common::TaskProgress task(message);
+  task.setTotalSteps((int)blocks.size());
+
+  if(nThreads <= 1)
+  {
+    for(std::size_t t = 0; t < blocks.size(); ++t)
+    {
+      if(task.isActive() == false)
+        throw te::common::Exception("Operation Canceled.");
+
+      func(0, blocks[t]);
+
+      task.pulse();
+    }
+
+    return;
+  }
+
+  BlockQueue queue;
+  queue.m_next = 0;
+  queue.m_done = 0;
+  queue.m_running = nThreads;
+  queue.m_canceled = false;
+
+  boost::thread_group threads;
+
+  for(std::size_t t = 0; t < nThreads; ++t)
+    threads.create_thread(boost::bind(&ProcessBlocks, boost::cref(blocks), boost::cref(func), t, boost::ref(queue)));
+
+  //the progress is only updated by this thread
+  std::size_t pulsed = 0;
+
+  {
+    boost::mutex::scoped_lock lock(queue.m_mutex);
+
+    while(queue.m_running > 0)
+    {
+      queue.m_condition.timed_wait(lock, boost::posix_time::milliseconds(PROGRESS_INTERVAL_MS));
+
+      std::size_t done = queue.m_done;
+
+      lock.unlock();
+
+      for(; pulsed < done; ++pulsed)
+        task.pulse();
+
+      bool active = task.isActive();
+
+      lock.lock();
+
+      if(!active)
+        queue.m_canceled = true;
+    }
+  }
+
+  threads.join_all();
+
+  if(queue.m_canceled)
+    throw te::common::Exception("Operation Canceled.");
+
+  if(!queue.m_errorMessage.empty())
+    throw te::common::Exception(queue.m_errorMessage);
+}
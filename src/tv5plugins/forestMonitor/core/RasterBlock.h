@@ -0,0 +1,164 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*! \file terralib/qt/plugins/thirdParty/forestMonitor/core/RasterBlock.h
+
+    \brief This file contains functions to read and write whole blocks of a raster band.
+*/
+
+#ifndef __TE_QT_PLUGINS_THIRDPARTY_INTERNAL_RASTERBLOCK_H
+#define __TE_QT_PLUGINS_THIRDPARTY_INTERNAL_RASTERBLOCK_H
+
+// TerraLib
+#include "../../Config.h"
+
+//STL Includes
+#include <string>
+#include <vector>
+
+// Boost
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+
+namespace te
+{
+  namespace rst { class Band; }
+
+  namespace qt
+  {
+    namespace plugins
+    {
+      namespace tv5plugins
+      {
+        /*!
+          \brief Block of a raster, in the block layout of a reference band.
+
+          The block buffers have m_width x m_height values in row order, only the first
+          m_validCols columns and m_validRows rows are inside the raster.
+        */
+        struct RasterBlock
+        {
+          int m_blockX;                 //!< Block column index.
+          int m_blockY;                 //!< Block row index.
+          unsigned int m_col;           //!< First raster column of the block.
+          unsigned int m_row;           //!< First raster row of the block.
+          unsigned int m_width;         //!< Block width (buffer stride).
+          unsigned int m_height;        //!< Block height.
+          unsigned int m_validCols;
+          unsigned int m_validRows;
+        };
+
+        /*! \brief Blocks of nCols x nRows pixels in the block layout of the band (rows if the band has no layout). */
+        std::vector<RasterBlock> GetRasterBlocks(const te::rst::Band* band, unsigned int nCols, unsigned int nRows);
+
+        /*!
+          \brief Windows of whole blocks of the band layout, each one with at most maxPixels pixels (at least one block).
+
+          Whole block rows are grouped when they fit, otherwise a block row is split in runs of blocks.
+          The windows have m_width = m_validCols and m_height = m_validRows, see ReadWindow and WriteWindow.
+          The window origins and sizes (but at the raster borders) are multiples of align, which may exceed maxPixels.
+        */
+        std::vector<RasterBlock> GetRasterWindows(const te::rst::Band* band, unsigned int nCols, unsigned int nRows, std::size_t maxPixels,
+                                                  unsigned int align = 1);
+
+        /*!
+          \brief Windows of the band for workers whose buffers take bytesPerPixel bytes for each window pixel.
+
+          The buffers of all workers take at most memoryBudget bytes (0 uses a default of 256 MB), unless
+          one block per worker does not fit. nThreads (0 means the hardware threads) is reduced to the
+          number of workers that fit in the budget and to the number of windows.
+        */
+        std::vector<RasterBlock> GetBudgetWindows(const te::rst::Band* band, unsigned int nCols, unsigned int nRows,
+                                                  std::size_t memoryBudget, std::size_t bytesPerPixel, std::size_t& nThreads,
+                                                  unsigned int align = 1);
+
+        /*! \brief Number of pixels of the largest window. */
+        std::size_t GetMaxWindowSize(const std::vector<RasterBlock>& windows);
+
+        /*! \brief True if the block can be read or written as a whole block of the band. */
+        bool HasBlockLayout(const te::rst::Band* band, const RasterBlock& block);
+
+        /*!
+          \brief Reads the block of the band as double values.
+
+          Whole blocks are read when the band has the block layout, otherwise the valid
+          pixels are read one by one. The raw buffer is reused between calls.
+        */
+        void ReadBlock(const te::rst::Band* band, const RasterBlock& block, std::vector<unsigned char>& raw, double* values);
+
+        /*! \brief Writes the double values of the block into the band, see ReadBlock. */
+        void WriteBlock(te::rst::Band* band, const RasterBlock& block, std::vector<unsigned char>& raw, const double* values);
+
+        /*!
+          \brief Reads a window of width x height pixels starting at (col, row) as double values.
+
+          The band blocks that intersect the window are read as whole blocks and only the
+          overlapping part is copied. The raw and blockValues buffers are reused between calls.
+        */
+        void ReadWindow(const te::rst::Band* band, unsigned int col, unsigned int row, unsigned int width, unsigned int height,
+                        std::vector<unsigned char>& raw, std::vector<double>& blockValues, double* values);
+
+        /*! \brief Reads a window as 8 bit values, the UCHAR bands are read without conversion. */
+        void ReadWindow(const te::rst::Band* band, unsigned int col, unsigned int row, unsigned int width, unsigned int height,
+                        std::vector<unsigned char>& raw, std::vector<unsigned char>& blockValues, unsigned char* values);
+
+        /*! \brief Reads a window as 16 bit values, the UINT16 bands are read without conversion. */
+        void ReadWindow(const te::rst::Band* band, unsigned int col, unsigned int row, unsigned int width, unsigned int height,
+                        std::vector<unsigned char>& raw, std::vector<boost::uint16_t>& blockValues, boost::uint16_t* values);
+
+        /*! \brief Reads a window as float values, the FLOAT bands are read without conversion. */
+        void ReadWindow(const te::rst::Band* band, unsigned int col, unsigned int row, unsigned int width, unsigned int height,
+                        std::vector<unsigned char>& raw, std::vector<float>& blockValues, float* values);
+
+        /*! \brief Writes a window of values into the band, the blocks inside the window are written as whole blocks, see ReadWindow. */
+        void WriteWindow(te::rst::Band* band, unsigned int col, unsigned int row, unsigned int width, unsigned int height,
+                         std::vector<unsigned char>& raw, std::vector<double>& blockValues, const double* values);
+
+        /*! \brief Writes a window of 8 bit values into the band, see WriteWindow. */
+        void WriteWindow(te::rst::Band* band, unsigned int col, unsigned int row, unsigned int width, unsigned int height,
+                         std::vector<unsigned char>& raw, std::vector<unsigned char>& blockValues, const unsigned char* values);
+
+        /*! \brief Writes a window of float values into the band, see WriteWindow. */
+        void WriteWindow(te::rst::Band* band, unsigned int col, unsigned int row, unsigned int width, unsigned int height,
+                         std::vector<unsigned char>& raw, std::vector<float>& blockValues, const float* values);
+
+        /*! \brief Number of threads to be used, 0 means the number of hardware threads. */
+        std::size_t GetNumberOfThreads(std::size_t nThreads);
+
+        /*!
+          \brief Calls func(worker, block) for each block using nThreads worker threads.
+
+          The progress is shown and the cancel is checked by the calling thread, a canceled
+          operation or an error in a worker throws te::common::Exception after all workers stop.
+          The raster bands are not thread safe, func must serialize its reads and writes.
+
+          \param blocks   The blocks to be processed.
+          \param func     Function called with the worker index (0 to nThreads - 1) and the block.
+          \param nThreads Number of worker threads, 1 processes the blocks in the calling thread.
+          \param message  Progress message.
+        */
+        void ProcessRasterBlocks(const std::vector<RasterBlock>& blocks, const boost::function<void (std::size_t, const RasterBlock&)>& func,
+                                 std::size_t nThreads, const std::string& message);
+
+      } // end namespace thirdParty
+    }   // end namespace plugins
+  }     // end namespace qt
+}       // end namespace te
+
+#endif //__TE_QT_PLUGINS_THIRDPARTY_INTERNAL_RASTERBLOCK_H
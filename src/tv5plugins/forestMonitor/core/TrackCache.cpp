@@ -0,0 +1,184 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*! \file terralib/qt/plugins/thirdParty/forestMonitor/core/TrackCache.cpp
+
+    \brief This file contains the cache used to create again only the tracks of the edited parcels.
+*/
+
+//TerraLib Includes
+#include <terralib/common/Enums.h>
+#include <terralib/dataaccess/dataset/DataSetType.h>
+#include <terralib/dataaccess/dataset/PrimaryKey.h>
+#include <terralib/dataaccess/datasource/DataSourceTransactor.h>
+#include <terralib/datatype/SimpleProperty.h>
+#include <terralib/datatype/StringProperty.h>
+#include <terralib/memory/DataSet.h>
+#include <terralib/memory/DataSetItem.h>
+#include "TrackCache.h"
+
+//STL Includes
+#include <cstdlib>
+#include <sstream>
+
+//FNV-1a 64 bits constants
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+te::qt::plugins::tv5plugins::TrackCache::TrackCache()
+{
+}
+
+te::qt::plugins::tv5plugins::TrackCache::~TrackCache()
+{
+}
+
+void te::qt::plugins::tv5plugins::TrackCache::load(te::da::DataSourcePtr ds, const std::string& dataSetName)
+{
+  m_previous.clear();
+
+  if(!ds->dataSetExists(dataSetName))
+    return;
+
+  std::auto_ptr<te::da::DataSet> dataSet = ds->getDataSet(dataSetName, te::common::FORWARDONLY);
+
+  dataSet->moveBeforeFirst();
+
+  while(dataSet->moveNext())
+  {
+    int parcelId = atoi(dataSet->getAsString("parcelId").c_str());
+
+    boost::uint64_t hash = 0;
+
+    std::istringstream iss(dataSet->getString("hash"));
+    iss >> std::hex >> hash;
+
+    m_previous[parcelId] = hash;
+  }
+}
+
+void te::qt::plugins::tv5plugins::TrackCache::save(te::da::DataSourcePtr ds, const std::string& dataSetName)
+{
+  //data set type
+  std::auto_ptr<te::da::DataSetType> dsType(new te::da::DataSetType(dataSetName));
+
+  te::dt::SimpleProperty* idProperty = new te::dt::SimpleProperty("parcelId", te::dt::INT32_TYPE);
+  dsType->add(idProperty);
+
+  te::dt::StringProperty* hashProperty = new te::dt::StringProperty("hash", te::dt::VAR_STRING, 16);
+  dsType->add(hashProperty);
+
+  te::da::PrimaryKey* pk = new te::da::PrimaryKey("pk_" + dataSetName, dsType.get());
+  pk->add(idProperty);
+
+  //hashes
+  te::mem::DataSet memDs(dsType.get());
+
+  for(std::map<int, boost::uint64_t>::const_iterator it = m_current.begin(); it != m_current.end(); ++it)
+  {
+    te::mem::DataSetItem* item = new te::mem::DataSetItem(&memDs);
+
+    std::ostringstream oss;
+    oss << std::hex << it->second;
+
+    item->setInt32("parcelId", it->first);
+    item->setString("hash", oss.str());
+
+    memDs.add(item);
+  }
+
+  memDs.moveBeforeFirst();
+
+  //replace the previous cache
+  std::map<std::string, std::string> options;
+
+  std::auto_ptr<te::da::DataSourceTransactor> transactor = ds->getTransactor();
+
+  transactor->begin();
+
+  try
+  {
+    if(transactor->dataSetExists(dataSetName))
+      transactor->dropDataSet(dataSetName);
+
+    transactor->createDataSet(dsType.get(), options);
+
+    transactor->add(dataSetName, &memDs, options);
+
+    transactor->commit();
+  }
+  catch(...)
+  {
+    transactor->rollBack();
+
+    throw;
+  }
+
+  m_previous = m_current;
+}
+
+bool te::qt::plugins::tv5plugins::TrackCache::update(int parcelId, boost::uint64_t hash)
+{
+  m_current[parcelId] = hash;
+
+  std::map<int, boost::uint64_t>::const_iterator it = m_previous.find(parcelId);
+
+  if(it != m_previous.end() && it->second == hash)
+    return false;
+
+  m_changed.insert(parcelId);
+
+  return true;
+}
+
+std::vector<int> te::qt::plugins::tv5plugins::TrackCache::getStaleParcels() const
+{
+  std::vector<int> stale;
+
+  for(std::map<int, boost::uint64_t>::const_iterator it = m_previous.begin(); it != m_previous.end(); ++it)
+  {
+    if(m_changed.count(it->first) || !m_current.count(it->first))
+      stale.push_back(it->first);
+  }
+
+  return stale;
+}
+
+std::size_t te::qt::plugins::tv5plugins::TrackCache::getNumberOfChangedParcels() const
+{
+  return m_changed.size();
+}
+
+boost::uint64_t te::qt::plugins::tv5plugins::TrackCache::InitialHash()
+{
+  return FNV_OFFSET_BASIS;
+}
+
+boost::uint64_t te::qt::plugins::tv5plugins::TrackCache::Hash(const void* data, std::size_t size, boost::uint64_t hash)
+{
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+  for(std::size_t t = 0; t < size; ++t)
+  {
+    hash ^= bytes[t];
+    hash *= FNV_PRIME;
+  }
+
+  return hash;
+}
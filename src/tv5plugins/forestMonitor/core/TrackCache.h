@@ -0,0 +1,99 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*! \file terralib/qt/plugins/thirdParty/forestMonitor/core/TrackCache.h
+
+    \brief This file contains the cache used to create again only the tracks of the edited parcels.
+*/
+
+#ifndef __TE_QT_PLUGINS_THIRDPARTY_INTERNAL_TRACKCACHE_H
+#define __TE_QT_PLUGINS_THIRDPARTY_INTERNAL_TRACKCACHE_H
+
+// TerraLib
+#include <terralib/dataaccess/datasource/DataSource.h>
+#include "../../Config.h"
+
+//STL Includes
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+// Boost
+#include <boost/cstdint.hpp>
+
+namespace te
+{
+  namespace qt
+  {
+    namespace plugins
+    {
+      namespace tv5plugins
+      {
+        /*!
+          \class TrackCache
+
+          \brief Hash of the inputs (centroids, direction and parameters) of each parcel.
+
+          The hashes of an execution are saved in a data set next to the tracks. The next
+          execution compares the new hash of each parcel with the saved one and only the
+          parcels that changed, or are new, have their tracks created again.
+        */
+        class TrackCache
+        {
+          public:
+
+            TrackCache();
+
+            ~TrackCache();
+
+            /*! \brief Reads the hashes saved by a previous execution. */
+            void load(te::da::DataSourcePtr ds, const std::string& dataSetName);
+
+            /*! \brief Replaces the cache data set by the hashes of the current execution. */
+            void save(te::da::DataSourcePtr ds, const std::string& dataSetName);
+
+            /*! \brief Stores the current hash of a parcel, returns true if the parcel is new or changed. */
+            bool update(int parcelId, boost::uint64_t hash);
+
+            /*! \brief Parcels with tracks of the previous execution that are no longer valid (changed or removed parcels). */
+            std::vector<int> getStaleParcels() const;
+
+            /*! \brief Number of parcels that must have their tracks created. */
+            std::size_t getNumberOfChangedParcels() const;
+
+            /*! \brief Initial value of a hash. */
+            static boost::uint64_t InitialHash();
+
+            /*! \brief Adds the bytes of data to a hash (FNV-1a). */
+            static boost::uint64_t Hash(const void* data, std::size_t size, boost::uint64_t hash);
+
+          protected:
+
+            std::map<int, boost::uint64_t> m_previous;     //!< Hashes read from the cache data set.
+            std::map<int, boost::uint64_t> m_current;      //!< Hashes of the current execution.
+            std::set<int> m_changed;                       //!< New or changed parcels.
+        };
+
+      } // end namespace thirdParty
+    }   // end namespace plugins
+  }     // end namespace qt
+}       // end namespace te
+
+#endif //__TE_QT_PLUGINS_THIRDPARTY_INTERNAL_TRACKCACHE_H
@@ -0,0 +1,247 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*! \file terralib/qt/plugins/thirdParty/forestMonitor/core/TrackWriter.cpp
+
+    \brief This file contains a writer that saves the track lines in chunks while they are created.
+*/
+
+//TerraLib Includes
+#include <terralib/common/Exception.h>
+#include <terralib/dataaccess/datasource/DataSourceTransactor.h>
+#include <terralib/geometry/LineString.h>
+#include <terralib/memory/DataSetItem.h>
+#include "TrackWriter.h"
+
+//STL Includes
+#include <map>
+
+// Boost
+#include <boost/bind.hpp>
+
+//number of full chunks waiting to be saved before the producer is blocked
+#define MAX_PENDING_CHUNKS 2
+
+te::qt::plugins::tv5plugins::TrackWriter::TrackWriter(te::da::DataSourcePtr ds, std::auto_ptr<te::da::DataSetType> dsType, std::size_t chunkSize, bool append) :
+  m_ds(ds),
+  m_dsType(dsType),
+  m_chunkSize(chunkSize > 0 ? chunkSize : 1),
+  m_chunkCount(0),
+  m_writing(false),
+  m_stop(false),
+  m_committed(0)
+{
+  //create the output data set, an existing one (e.g. left by an interrupted run) is replaced
+  if(!append)
+  {
+    if(m_ds->dataSetExists(m_dsType->getName()))
+      m_ds->dropDataSet(m_dsType->getName());
+
+    std::map<std::string, std::string> options;
+
+    m_ds->createDataSet(m_dsType.get(), options);
+  }
+
+  m_chunk.reset(new te::mem::DataSet(m_dsType.get()));
+
+  m_thread.reset(new boost::thread(boost::bind(&TrackWriter::run, this)));
+}
+
+te::qt::plugins::tv5plugins::TrackWriter::~TrackWriter()
+{
+  {
+    boost::mutex::scoped_lock lock(m_mutex);
+
+    //an interrupted run keeps only the chunks already saved
+    for(std::size_t t = 0; t < m_pending.size(); ++t)
+      delete m_pending[t];
+
+    m_pending.clear();
+
+    m_stop = true;
+
+    m_condition.notify_all();
+  }
+
+  m_thread->join();
+}
+
+void te::qt::plugins::tv5plugins::TrackWriter::add(int trackId, int parcelId, te::gm::LineString* line)
+{
+  //create dataset item
+  te::mem::DataSetItem* item = new te::mem::DataSetItem(m_chunk.get());
+
+  //set id
+  item->setInt32("trackId", trackId);
+
+  //set parcel id
+  item->setInt32("parcelId", parcelId);
+
+  //set geometry
+  item->setGeometry("geom", line);
+
+  m_chunk->add(item);
+
+  if(++m_chunkCount >= m_chunkSize)
+    flush();
+}
+
+void te::qt::plugins::tv5plugins::TrackWriter::finish()
+{
+  flush();
+
+  {
+    boost::mutex::scoped_lock lock(m_mutex);
+
+    while(!m_pending.empty() || m_writing)
+      m_condition.wait(lock);
+  }
+
+  checkError();
+}
+
+std::size_t te::qt::plugins::tv5plugins::TrackWriter::getCommitted()
+{
+  boost::mutex::scoped_lock lock(m_mutex);
+
+  return m_committed;
+}
+
+void te::qt::plugins::tv5plugins::TrackWriter::flush()
+{
+  checkError();
+
+  if(m_chunkCount == 0)
+    return;
+
+  {
+    boost::mutex::scoped_lock lock(m_mutex);
+
+    while(m_pending.size() >= MAX_PENDING_CHUNKS)
+      m_condition.wait(lock);
+
+    m_pending.push_back(m_chunk.release());
+
+    m_condition.notify_all();
+  }
+
+  m_chunk.reset(new te::mem::DataSet(m_dsType.get()));
+  m_chunkCount = 0;
+}
+
+void te::qt::plugins::tv5plugins::TrackWriter::run()
+{
+  while(true)
+  {
+    te::mem::DataSet* chunk = 0;
+    bool failed = false;
+
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+
+      while(m_pending.empty() && !m_stop)
+        m_condition.wait(lock);
+
+      if(m_pending.empty())
+        return;
+
+      chunk = m_pending.front();
+      m_pending.pop_front();
+
+      m_writing = true;
+      failed = !m_errorMessage.empty();
+
+      m_condition.notify_all();
+    }
+
+    std::string errorMessage;
+
+    //after an error the remaining chunks are discarded
+    if(!failed)
+    {
+      try
+      {
+        save(chunk);
+      }
+      catch(const std::exception& e)
+      {
+        errorMessage = e.what();
+      }
+      catch(...)
+      {
+        errorMessage = "Unknown error saving the tracks.";
+      }
+    }
+
+    std::size_t size = chunk->size();
+
+    delete chunk;
+
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+
+      if(!failed && errorMessage.empty())
+        m_committed += size;
+      else if(m_errorMessage.empty())
+        m_errorMessage = errorMessage;
+
+      m_writing = false;
+
+      m_condition.notify_all();
+    }
+  }
+}
+
+void te::qt::plugins::tv5plugins::TrackWriter::save(te::mem::DataSet* chunk)
+{
+  chunk->moveBeforeFirst();
+
+  std::map<std::string, std::string> options;
+
+  std::auto_ptr<te::da::DataSourceTransactor> transactor = m_ds->getTransactor();
+
+  transactor->begin();
+
+  try
+  {
+    transactor->add(m_dsType->getName(), chunk, options);
+
+    transactor->commit();
+  }
+  catch(...)
+  {
+    transactor->rollBack();
+
+    throw;
+  }
+}
+
+void te::qt::plugins::tv5plugins::TrackWriter::checkError()
+{
+  std::string errorMessage;
+
+  {
+    boost::mutex::scoped_lock lock(m_mutex);
+
+    errorMessage = m_errorMessage;
+  }
+
+  if(!errorMessage.empty())
+    throw te::common::Exception(errorMessage);
+}
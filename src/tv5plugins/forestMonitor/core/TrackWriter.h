@@ -0,0 +1,128 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*! \file terralib/qt/plugins/thirdParty/forestMonitor/core/TrackWriter.h
+
+    \brief This file contains a writer that saves the track lines in chunks while they are created.
+*/
+
+#ifndef __TE_QT_PLUGINS_THIRDPARTY_INTERNAL_TRACKWRITER_H
+#define __TE_QT_PLUGINS_THIRDPARTY_INTERNAL_TRACKWRITER_H
+
+// TerraLib
+#include <terralib/dataaccess/dataset/DataSetType.h>
+#include <terralib/dataaccess/datasource/DataSource.h>
+#include <terralib/memory/DataSet.h>
+#include "../../Config.h"
+
+//STL Includes
+#include <deque>
+#include <memory>
+#include <string>
+
+// Boost
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace te
+{
+  namespace gm { class LineString; }
+
+  namespace qt
+  {
+    namespace plugins
+    {
+      namespace tv5plugins
+      {
+        /*!
+          \class TrackWriter
+
+          \brief Saves the track lines into a data set in chunks of fixed size.
+
+          The output data set is created by the constructor, replacing an existing one, unless the tracks are appended.
+          Every full chunk is saved by a background thread inside its own transaction, so the
+          tracks already written are kept if the process is interrupted and only a few chunks
+          are held in memory.
+          The writer must be fed from a single thread.
+        */
+        class TrackWriter
+        {
+          public:
+
+            /*!
+              \brief Constructor.
+
+              \param ds        The output data source.
+              \param dsType    The output data set type (trackId, parcelId and geom properties).
+              \param chunkSize Number of tracks saved by each transaction.
+              \param append    If true the tracks are added to the existing data set instead of creating it again.
+            */
+            TrackWriter(te::da::DataSourcePtr ds, std::auto_ptr<te::da::DataSetType> dsType, std::size_t chunkSize, bool append = false);
+
+            /*! \brief Stops the background thread, the pending chunks are discarded if finish was not called (the chunk being saved is completed). */
+            ~TrackWriter();
+
+            /*! \brief Adds a track, the writer takes the ownership of the line. */
+            void add(int trackId, int parcelId, te::gm::LineString* line);
+
+            /*! \brief Saves the last chunk and waits until all chunks are written, throws if any chunk failed. */
+            void finish();
+
+            /*! \brief Number of tracks already committed to the data source. */
+            std::size_t getCommitted();
+
+          protected:
+
+            /*! \brief Hands the current chunk to the background thread, waits if too many chunks are pending. */
+            void flush();
+
+            /*! \brief Background thread loop. */
+            void run();
+
+            void save(te::mem::DataSet* chunk);
+
+            void checkError();
+
+          protected:
+
+            te::da::DataSourcePtr m_ds;
+            std::auto_ptr<te::da::DataSetType> m_dsType;
+            std::size_t m_chunkSize;
+
+            std::auto_ptr<te::mem::DataSet> m_chunk;   //!< Chunk being filled.
+            std::size_t m_chunkCount;                  //!< Number of tracks in the current chunk.
+
+            boost::mutex m_mutex;
+            boost::condition_variable m_condition;
+            std::deque<te::mem::DataSet*> m_pending;   //!< Full chunks waiting to be saved.
+            bool m_writing;                            //!< True while the background thread saves a chunk.
+            bool m_stop;
+            std::size_t m_committed;
+            std::string m_errorMessage;
+
+            std::auto_ptr<boost::thread> m_thread;
+        };
+
+      } // end namespace thirdParty
+    }   // end namespace plugins
+  }     // end namespace qt
+}       // end namespace te
+
+#endif //__TE_QT_PLUGINS_THIRDPARTY_INTERNAL_TRACKWRITER_H
@@ -0,0 +1,567 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*! \file terralib/qt/plugins/thirdParty/forestMonitor/core/ZonalStatistics.cpp
+
+    \brief This file contains the per parcel statistics of a raster band, computed in one pass.
+*/
+
+//TerraLib Includes
+#include <terralib/common/progress/TaskProgress.h>
+#include <terralib/common/Exception.h>
+#include <terralib/common/STLUtils.h>
+#include <terralib/common/StringUtils.h>
+#include <terralib/dataaccess/dataset/DataSetType.h>
+#include <terralib/dataaccess/dataset/PrimaryKey.h>
+#include <terralib/dataaccess/datasource/DataSource.h>
+#include <terralib/dataaccess/datasource/DataSourceFactory.h>
+#include <terralib/dataaccess/utils/Utils.h>
+#include <terralib/datatype/SimpleProperty.h>
+#include <terralib/geometry/Envelope.h>
+#include <terralib/geometry/Geometry.h>
+#include <terralib/geometry/GeometryProperty.h>
+#include <terralib/memory/DataSet.h>
+#include <terralib/memory/DataSetItem.h>
+#include <terralib/raster/Band.h>
+#include <terralib/raster/BandProperty.h>
+#include <terralib/raster/Grid.h>
+#include <terralib/raster/Raster.h>
+#include "PreparedPolygon.h"
+#include "RasterBlock.h"
+#include "ZonalStatistics.h"
+
+//STL Includes
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+// Boost
+#include <boost/bind.hpp>
+
+//bytes of the worker buffers for each window pixel (values, labels and block values)
+#define ZONAL_BYTES_PER_PIXEL 24
+
+//number of histogram bins of the bands that are not UCHAR
+#define ZONAL_DEFAULT_BINS 1024
+
+te::qt::plugins::tv5plugins::ZonalStatistics::ZonalStatistics(te::rst::Raster* raster, int band) :
+  m_raster(raster),
+  m_band(band),
+  m_histMin(-1.),
+  m_histMax(1.),
+  m_nBins(ZONAL_DEFAULT_BINS),
+  m_histogramSet(false),
+  m_nThreads(0),
+  m_memoryBudget(0)
+{
+  if(!m_raster)
+    throw te::common::Exception("Invalid input raster.");
+
+  //one bin for each 8 bit value
+  if(m_raster->getBand(m_band)->getProperty()->m_type == te::dt::UCHAR_TYPE)
+  {
+    m_histMin = -0.5;
+    m_histMax = 255.5;
+    m_nBins = 256;
+    m_histogramSet = true;
+  }
+}
+
+te::qt::plugins::tv5plugins::ZonalStatistics::~ZonalStatistics()
+{
+  te::common::FreeContents(m_parcels);
+}
+
+void te::qt::plugins::tv5plugins::ZonalStatistics::addParcel(int parcelId, const te::gm::Geometry* geom)
+{
+  assert(geom);
+
+  //pixels that contain the envelope corners (the pixel centers are integer grid coordinates)
+  const te::gm::Envelope* env = geom->getMBR();
+  const te::rst::Grid* grid = m_raster->getGrid();
+
+  double c0, r0, c1, r1;
+
+  grid->geoToGrid(env->m_llx, env->m_ury, c0, r0);
+  grid->geoToGrid(env->m_urx, env->m_lly, c1, r1);
+
+  double minCol = std::max(0., std::floor(std::min(c0, c1) + 0.5));
+  double maxCol = std::min((double)m_raster->getNumberOfColumns() - 1., std::floor(std::max(c0, c1) + 0.5));
+  double minRow = std::max(0., std::floor(std::min(r0, r1) + 0.5));
+  double maxRow = std::min((double)m_raster->getNumberOfRows() - 1., std::floor(std::max(r0, r1) + 0.5));
+
+  ParcelWindow w;
+  w.m_empty = minCol > maxCol || minRow > maxRow;
+  w.m_col0 = w.m_empty ? 0 : (unsigned int)minCol;
+  w.m_row0 = w.m_empty ? 0 : (unsigned int)minRow;
+  w.m_col1 = w.m_empty ? 0 : (unsigned int)maxCol;
+  w.m_row1 = w.m_empty ? 0 : (unsigned int)maxRow;
+
+  m_parcelIds.push_back(parcelId);
+  m_parcels.push_back(new PreparedPolygon(geom));
+  m_windows.push_back(w);
+}
+
+void te::qt::plugins::tv5plugins::ZonalStatistics::setPercentiles(const std::vector<double>& percentiles)
+{
+  m_percentiles = percentiles;
+}
+
+void te::qt::plugins::tv5plugins::ZonalStatistics::setHistogram(double minValue, double maxValue, unsigned int nBins)
+{
+  if(minValue >= maxValue || nBins == 0)
+    throw te::common::Exception("Invalid histogram.");
+
+  m_histMin = minValue;
+  m_histMax = maxValue;
+  m_nBins = nBins;
+  m_histogramSet = true;
+}
+
+void te::qt::plugins::tv5plugins::ZonalStatistics::setNumberOfThreads(std::size_t nThreads)
+{
+  m_nThreads = nThreads;
+}
+
+void te::qt::plugins::tv5plugins::ZonalStatistics::setMemoryBudget(std::size_t memoryBudget)
+{
+  m_memoryBudget = memoryBudget;
+}
+
+void te::qt::plugins::tv5plugins::ZonalStatistics::execute()
+{
+  m_statistics.clear();
+
+  te::rst::Band* band = m_raster->getBand(m_band);
+
+  std::size_t nThreads = m_nThreads;
+
+  std::vector<RasterBlock> windows = GetBudgetWindows(band, m_raster->getNumberOfColumns(), m_raster->getNumberOfRows(),
+                                                      m_memoryBudget, ZONAL_BYTES_PER_PIXEL, nThreads);
+
+  std::size_t windowSize = GetMaxWindowSize(windows);
+  std::size_t nParcels = m_parcels.size();
+
+  m_workers.clear();
+  m_workers.resize(nThreads);
+
+  for(std::size_t t = 0; t < m_workers.size(); ++t)
+  {
+    WorkerData& data = m_workers[t];
+
+    data.m_values.resize(windowSize);
+    data.m_labels.resize(windowSize);
+    data.m_count.assign(nParcels, 0);
+    data.m_sum.assign(nParcels, 0.);
+    data.m_sumSq.assign(nParcels, 0.);
+    data.m_min.assign(nParcels, std::numeric_limits<double>::max());
+    data.m_max.assign(nParcels, -std::numeric_limits<double>::max());
+    data.m_rangeMin = std::numeric_limits<double>::max();
+    data.m_rangeMax = -std::numeric_limits<double>::max();
+
+    if(!m_percentiles.empty())
+      data.m_histograms.resize(nParcels);
+  }
+
+  //only the windows crossed by a parcel are read
+  std::vector<RasterBlock> parcelWindows;
+
+  for(std::size_t w = 0; w < windows.size(); ++w)
+  {
+    const RasterBlock& window = windows[w];
+
+    for(std::size_t p = 0; p < nParcels; ++p)
+    {
+      const ParcelWindow& pw = m_windows[p];
+
+      if(!pw.m_empty && pw.m_col0 < window.m_col + window.m_width && pw.m_col1 >= window.m_col &&
+         pw.m_row0 < window.m_row + window.m_height && pw.m_row1 >= window.m_row)
+      {
+        parcelWindows.push_back(window);
+        break;
+      }
+    }
+  }
+
+  //the histogram range of the bands without a known range comes from the parcel values
+  if(!m_percentiles.empty() && !m_histogramSet)
+  {
+    ProcessRasterBlocks(parcelWindows, boost::bind(&ZonalStatistics::rangeWindow, this, _1, _2), nThreads, "Calculating parcel value range.");
+
+    double minValue = std::numeric_limits<double>::max();
+    double maxValue = -std::numeric_limits<double>::max();
+
+    for(std::size_t t = 0; t < m_workers.size(); ++t)
+    {
+      minValue = std::min(minValue, m_workers[t].m_rangeMin);
+      maxValue = std::max(maxValue, m_workers[t].m_rangeMax);
+    }
+
+    //no parcel pixels, any range gives empty histograms
+    if(minValue > maxValue)
+    {
+      minValue = 0.;
+      maxValue = 1.;
+    }
+    else if(minValue == maxValue)
+    {
+      maxValue = minValue + 1.;
+    }
+
+    m_histMin = minValue;
+    m_histMax = maxValue;
+  }
+
+  ProcessRasterBlocks(parcelWindows, boost::bind(&ZonalStatistics::processWindow, this, _1, _2), nThreads, "Calculating parcel statistics.");
+
+  merge(m_workers);
+
+  m_workers.clear();
+}
+
+const std::vector<te::qt::plugins::tv5plugins::ParcelStatistics>& te::qt::plugins::tv5plugins::ZonalStatistics::getStatistics() const
+{
+  return m_statistics;
+}
+
+void te::qt::plugins::tv5plugins::ZonalStatistics::processWindow(std::size_t worker, const RasterBlock& window)
+{
+  WorkerData& data = m_workers[worker];
+
+  te::rst::Band* band = m_raster->getBand(m_band);
+
+  {
+    boost::mutex::scoped_lock lock(m_ioMutex);
+
+    ReadWindow(band, window.m_col, window.m_row, window.m_width, window.m_height, data.m_raw, data.m_blockValues, &data.m_values[0]);
+  }
+
+  rasterize(data, window);
+
+  double noData = band->getProperty()->m_noDataValue;
+
+  double scale = (double)m_nBins / (m_histMax - m_histMin);
+
+  bool histogram = !m_percentiles.empty();
+
+  std::size_t windowSize = (std::size_t)window.m_width * window.m_height;
+
+  for(std::size_t i = 0; i < windowSize; ++i)
+  {
+    int l = data.m_labels[i];
+
+    double value = data.m_values[i];
+
+    if(l < 0 || value == noData)
+      continue;
+
+    ++data.m_count[l];
+    data.m_sum[l] += value;
+    data.m_sumSq[l] += value * value;
+
+    if(value < data.m_min[l])
+      data.m_min[l] = value;
+
+    if(value > data.m_max[l])
+      data.m_max[l] = value;
+
+    if(histogram)
+    {
+      std::vector<unsigned int>& parcelHistogram = data.m_histograms[l];
+
+      if(parcelHistogram.empty())
+        parcelHistogram.assign(m_nBins, 0);
+
+      double bin = std::floor((value - m_histMin) * scale);
+
+      bin = std::max(0., std::min((double)(m_nBins - 1), bin));
+
+      ++parcelHistogram[(std::size_t)bin];
+    }
+  }
+}
+
+void te::qt::plugins::tv5plugins::ZonalStatistics::rangeWindow(std::size_t worker, const RasterBlock& window)
+{
+  WorkerData& data = m_workers[worker];
+
+  te::rst::Band* band = m_raster->getBand(m_band);
+
+  {
+    boost::mutex::scoped_lock lock(m_ioMutex);
+
+    ReadWindow(band, window.m_col, window.m_row, window.m_width, window.m_height, data.m_raw, data.m_blockValues, &data.m_values[0]);
+  }
+
+  rasterize(data, window);
+
+  double noData = band->getProperty()->m_noDataValue;
+
+  std::size_t windowSize = (std::size_t)window.m_width * window.m_height;
+
+  for(std::size_t i = 0; i < windowSize; ++i)
+  {
+    double value = data.m_values[i];
+
+    if(data.m_labels[i] < 0 || value == noData)
+      continue;
+
+    if(value < data.m_rangeMin)
+      data.m_rangeMin = value;
+
+    if(value > data.m_rangeMax)
+      data.m_rangeMax = value;
+  }
+}
+
+void te::qt::plugins::tv5plugins::ZonalStatistics::rasterize(WorkerData& data, const RasterBlock& window)
+{
+  std::fill(data.m_labels.begin(), data.m_labels.begin() + (std::size_t)window.m_width * window.m_height, -1);
+
+  const te::rst::Grid* grid = m_raster->getGrid();
+
+  unsigned int lastCol = window.m_col + window.m_width - 1;
+  unsigned int lastRow = window.m_row + window.m_height - 1;
+
+  for(std::size_t p = 0; p < m_parcels.size(); ++p)
+  {
+    const ParcelWindow& pw = m_windows[p];
+
+    if(pw.m_empty || pw.m_col0 > lastCol || pw.m_col1 < window.m_col || pw.m_row0 > lastRow || pw.m_row1 < window.m_row)
+      continue;
+
+    unsigned int row0 = std::max(pw.m_row0, window.m_row);
+    unsigned int row1 = std::min(pw.m_row1, lastRow);
+
+    for(unsigned int row = row0; row <= row1; ++row)
+    {
+      //only the pixels with the center inside the parcel spans of this row
+      double x = 0.;
+      double y = 0.;
+
+      grid->gridToGeo(0., (double)row, x, y);
+
+      m_parcels[p]->getCrossings(y, data.m_crossings);
+
+      int* labels = &data.m_labels[(std::size_t)(row - window.m_row) * window.m_width];
+
+      for(std::size_t t = 0; t + 1 < data.m_crossings.size(); t += 2)
+      {
+        double colA, colB, rowAux;
+
+        grid->geoToGrid(data.m_crossings[t], y, colA, rowAux);
+        grid->geoToGrid(data.m_crossings[t + 1], y, colB, rowAux);
+
+        double first = std::max(std::ceil(std::min(colA, colB)) - (double)window.m_col, 0.);
+        double last = std::min(std::ceil(std::max(colA, colB)) - (double)window.m_col, (double)window.m_width);
+
+        for(unsigned int c = (unsigned int)first; (double)c < last; ++c)
+          labels[c] = (int)p;
+      }
+    }
+  }
+}
+
+void te::qt::plugins::tv5plugins::ZonalStatistics::merge(std::vector<WorkerData>& workers)
+{
+  std::size_t nParcels = m_parcels.size();
+
+  std::vector<unsigned int> histogram;
+
+  if(!m_percentiles.empty())
+    histogram.resize(m_nBins);
+
+  m_statistics.resize(nParcels);
+
+  for(std::size_t p = 0; p < nParcels; ++p)
+  {
+    ParcelStatistics& s = m_statistics[p];
+    s.m_parcelId = m_parcelIds[p];
+    s.m_count = 0;
+    s.m_mean = 0.;
+    s.m_stddev = 0.;
+    s.m_min = std::numeric_limits<double>::max();
+    s.m_max = -std::numeric_limits<double>::max();
+    s.m_percentiles.assign(m_percentiles.size(), 0.);
+
+    double sum = 0.;
+    double sumSq = 0.;
+
+    std::fill(histogram.begin(), histogram.end(), 0);
+
+    for(std::size_t t = 0; t < workers.size(); ++t)
+    {
+      const WorkerData& data = workers[t];
+
+      if(data.m_count[p] == 0)
+        continue;
+
+      s.m_count += data.m_count[p];
+      sum += data.m_sum[p];
+      sumSq += data.m_sumSq[p];
+      s.m_min = std::min(s.m_min, data.m_min[p]);
+      s.m_max = std::max(s.m_max, data.m_max[p]);
+
+      if(histogram.empty() || data.m_histograms[p].empty())
+        continue;
+
+      for(unsigned int b = 0; b < m_nBins; ++b)
+        histogram[b] += data.m_histograms[p][b];
+    }
+
+    if(s.m_count == 0)
+    {
+      s.m_min = 0.;
+      s.m_max = 0.;
+      continue;
+    }
+
+    s.m_mean = sum / (double)s.m_count;
+    s.m_stddev = std::sqrt(std::max(0., sumSq / (double)s.m_count - s.m_mean * s.m_mean));
+
+    for(std::size_t t = 0; t < m_percentiles.size(); ++t)
+      s.m_percentiles[t] = getPercentile(&histogram[0], s.m_count, m_percentiles[t]);
+  }
+}
+
+double te::qt::plugins::tv5plugins::ZonalStatistics::getPercentile(const unsigned int* histogram, std::size_t count, double percentile) const
+{
+  //nearest rank, counted from 0
+  double rank = std::floor(std::max(0., std::min(100., percentile)) / 100. * (double)(count - 1) + 0.5);
+
+  std::size_t cumulative = 0;
+
+  unsigned int bin = 0;
+
+  for(; bin + 1 < m_nBins; ++bin)
+  {
+    cumulative += histogram[bin];
+
+    if((double)cumulative > rank)
+      break;
+  }
+
+  return m_histMin + ((double)bin + 0.5) * (m_histMax - m_histMin) / (double)m_nBins;
+}
+
+void te::qt::plugins::tv5plugins::ExportParcelStatistics(te::map::AbstractLayerPtr parcelLayer, const std::vector<ParcelStatistics>& statistics,
+                                                         const std::vector<double>& percentiles, std::string dataSetName, std::string dsType,
+                                                         std::map<std::string, std::string> connInfo)
+{
+  std::auto_ptr<te::da::DataSet> parcelDataSet = parcelLayer->getData();
+  std::auto_ptr<te::da::DataSetType> parcelDsType = parcelLayer->getSchema();
+
+  std::size_t gpos = te::da::GetFirstPropertyPos(parcelDataSet.get(), te::dt::GEOMETRY_TYPE);
+  te::gm::GeometryProperty* parcelGeomProp = te::da::GetFirstGeomProperty(parcelDsType.get());
+
+  te::da::PrimaryKey* parcelPk = parcelDsType->getPrimaryKey();
+  std::string parcelIdName = parcelPk->getProperties()[0]->getName();
+
+  //statistics by parcel id
+  std::map<int, std::size_t> statIdx;
+
+  for(std::size_t t = 0; t < statistics.size(); ++t)
+    statIdx[statistics[t].m_parcelId] = t;
+
+  //create dataset type
+  std::auto_ptr<te::da::DataSetType> dataSetType(new te::da::DataSetType(dataSetName));
+
+  te::dt::SimpleProperty* idProperty = new te::dt::SimpleProperty("id", te::dt::INT32_TYPE);
+  dataSetType->add(idProperty);
+
+  dataSetType->add(new te::dt::SimpleProperty("count", te::dt::INT32_TYPE));
+  dataSetType->add(new te::dt::SimpleProperty("mean", te::dt::DOUBLE_TYPE));
+  dataSetType->add(new te::dt::SimpleProperty("stddev", te::dt::DOUBLE_TYPE));
+  dataSetType->add(new te::dt::SimpleProperty("min", te::dt::DOUBLE_TYPE));
+  dataSetType->add(new te::dt::SimpleProperty("max", te::dt::DOUBLE_TYPE));
+
+  std::vector<std::string> percentileNames;
+
+  for(std::size_t t = 0; t < percentiles.size(); ++t)
+  {
+    percentileNames.push_back("p" + te::common::Convert2String((int)percentiles[t]));
+
+    dataSetType->add(new te::dt::SimpleProperty(percentileNames.back(), te::dt::DOUBLE_TYPE));
+  }
+
+  te::gm::GeometryProperty* geomProperty = new te::gm::GeometryProperty("geom", parcelLayer->getSRID(), parcelGeomProp->getGeometryType());
+  dataSetType->add(geomProperty);
+
+  //create primary key
+  std::string pkName = "pk_id";
+  pkName += "_" + dataSetName;
+  te::da::PrimaryKey* pk = new te::da::PrimaryKey(pkName, dataSetType.get());
+  pk->add(idProperty);
+
+  //create data set
+  std::auto_ptr<te::mem::DataSet> dataSetMem(new te::mem::DataSet(dataSetType.get()));
+
+  te::common::TaskProgress task("Exporting Parcel Statistics");
+  task.setTotalSteps(parcelDataSet->size());
+
+  parcelDataSet->moveBeforeFirst();
+
+  while(parcelDataSet->moveNext())
+  {
+    if(!task.isActive())
+    {
+      break;
+    }
+
+    int parcelId = parcelDataSet->getInt32(parcelIdName);
+
+    std::map<int, std::size_t>::const_iterator it = statIdx.find(parcelId);
+
+    if(it == statIdx.end())
+      continue;
+
+    const ParcelStatistics& s = statistics[it->second];
+
+    //create dataset item
+    te::mem::DataSetItem* item = new te::mem::DataSetItem(dataSetMem.get());
+
+    item->setInt32("id", parcelId);
+    item->setInt32("count", (int)s.m_count);
+    item->setDouble("mean", s.m_mean);
+    item->setDouble("stddev", s.m_stddev);
+    item->setDouble("min", s.m_min);
+    item->setDouble("max", s.m_max);
+
+    for(std::size_t t = 0; t < percentileNames.size(); ++t)
+      item->setDouble(percentileNames[t], s.m_percentiles[t]);
+
+    item->setGeometry("geom", parcelDataSet->getGeometry(gpos).release());
+
+    dataSetMem->add(item);
+
+    task.pulse();
+  }
+
+  dataSetMem->moveBeforeFirst();
+
+  //save data set
+  std::auto_ptr<te::da::DataSource> dataSource = te::da::DataSourceFactory::make(dsType);
+  dataSource->setConnectionInfo(connInfo);
+  dataSource->open();
+
+  std::map<std::string, std::string> options;
+  dataSource->createDataSet(dataSetType.get(), options);
+  dataSource->add(dataSetName, dataSetMem.get(), options);
+}
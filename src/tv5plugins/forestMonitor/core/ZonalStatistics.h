@@ -0,0 +1,195 @@
+/*  Copyright (C) 2011-2012 National Institute For Space Research (INPE) - Brazil.
+
+    This file is part of the TerraLib - a Framework for building GIS enabled applications.
+
+    TerraLib is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    TerraLib is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with TerraLib. See COPYING. If not, write to
+    TerraLib Team at <terralib-team@terralib.org>.
+ */
+
+/*! \file terralib/qt/plugins/thirdParty/forestMonitor/core/ZonalStatistics.h
+
+    \brief This file contains the per parcel statistics of a raster band, computed in one pass.
+*/
+
+#ifndef __TE_QT_PLUGINS_THIRDPARTY_INTERNAL_ZONALSTATISTICS_H
+#define __TE_QT_PLUGINS_THIRDPARTY_INTERNAL_ZONALSTATISTICS_H
+
+// TerraLib
+#include <terralib/maptools/AbstractLayer.h>
+#include "../../Config.h"
+
+//STL Includes
+#include <map>
+#include <string>
+#include <vector>
+
+// Boost
+#include <boost/thread/mutex.hpp>
+
+namespace te
+{
+  namespace gm { class Geometry; }
+  namespace rst { class Raster; }
+
+  namespace qt
+  {
+    namespace plugins
+    {
+      namespace tv5plugins
+      {
+        class PreparedPolygon;
+        struct RasterBlock;
+
+        /*! \brief Statistics of the band values of a parcel. */
+        struct ParcelStatistics
+        {
+          int m_parcelId;
+          std::size_t m_count;                  //!< Number of pixels, the other values are 0 if it is 0.
+          double m_mean;
+          double m_stddev;                      //!< Population standard deviation.
+          double m_min;
+          double m_max;
+          std::vector<double> m_percentiles;    //!< In the order given to ZonalStatistics::setPercentiles.
+        };
+
+        /*!
+          \class ZonalStatistics
+
+          \brief Computes the statistics of all parcels in one pass over the raster band.
+
+          The band is read in windows of whole blocks by a pool of workers. The parcels
+          that cross a window are rasterized into a label grid of the window (a pixel
+          belongs to a parcel if its center is inside, a parcel added later takes the
+          pixels shared with the previous ones) and each worker accumulates the values
+          of each label. The percentiles come from a histogram of each parcel, they are
+          the center of the bin of the percentile rank.
+        */
+        class ZonalStatistics
+        {
+          public:
+
+            ZonalStatistics(te::rst::Raster* raster, int band);
+
+            ~ZonalStatistics();
+
+            /*! \brief Adds a parcel, the geometry must be in the raster SRID. */
+            void addParcel(int parcelId, const te::gm::Geometry* geom);
+
+            /*! \brief Percentiles (0 to 100) of each parcel, none by default. */
+            void setPercentiles(const std::vector<double>& percentiles);
+
+            /*!
+              \brief Range and number of bins of the histogram used by the percentiles.
+
+              The values out of the range are counted in the first or last bin. By default
+              UCHAR bands have one bin for each value and the others 1024 bins between the
+              minimum and maximum parcel values, found by an extra pass over the band.
+            */
+            void setHistogram(double minValue, double maxValue, unsigned int nBins);
+
+            /*! \brief Number of worker threads, 0 (default) means the hardware threads. */
+            void setNumberOfThreads(std::size_t nThreads);
+
+            /*! \brief Bytes used by the worker buffers, 0 (default) uses 256 MB. */
+            void setMemoryBudget(std::size_t memoryBudget);
+
+            /*! \brief Reads the band once and computes the statistics of all parcels. */
+            void execute();
+
+            /*! \brief Statistics of the parcels, in the order they were added. */
+            const std::vector<ParcelStatistics>& getStatistics() const;
+
+          protected:
+
+            /*! \brief Partial results of a worker. */
+            struct WorkerData
+            {
+              std::vector<double> m_values;
+              std::vector<int> m_labels;              //!< Label grid of the window, index of the parcel or -1.
+              std::vector<double> m_blockValues;
+              std::vector<unsigned char> m_raw;
+              std::vector<double> m_crossings;
+              std::vector<std::size_t> m_count;
+              std::vector<double> m_sum;
+              std::vector<double> m_sumSq;
+              std::vector<double> m_min;
+              std::vector<double> m_max;
+              std::vector<std::vector<unsigned int> > m_histograms;   //!< Histogram of each parcel, created when the worker finds the parcel.
+              double m_rangeMin;                      //!< Minimum parcel value of the range pass.
+              double m_rangeMax;                      //!< Maximum parcel value of the range pass.
+            };
+
+            /*! \brief Pixel rows and columns of a parcel. */
+            struct ParcelWindow
+            {
+              unsigned int m_col0;
+              unsigned int m_row0;
+              unsigned int m_col1;
+              unsigned int m_row1;
+              bool m_empty;
+            };
+
+            void processWindow(std::size_t worker, const RasterBlock& window);
+
+            /*! \brief Worker function of the range pass, keeps the minimum and maximum values of the parcel pixels. */
+            void rangeWindow(std::size_t worker, const RasterBlock& window);
+
+            /*! \brief Fills the label grid of the window with the parcels that cross it. */
+            void rasterize(WorkerData& data, const RasterBlock& window);
+
+            /*! \brief Adds the partial results of the workers and computes the statistics. */
+            void merge(std::vector<WorkerData>& workers);
+
+            double getPercentile(const unsigned int* histogram, std::size_t count, double percentile) const;
+
+          protected:
+
+            te::rst::Raster* m_raster;
+            int m_band;
+
+            std::vector<int> m_parcelIds;
+            std::vector<PreparedPolygon*> m_parcels;
+            std::vector<ParcelWindow> m_windows;
+
+            std::vector<double> m_percentiles;
+            double m_histMin;
+            double m_histMax;
+            unsigned int m_nBins;
+            bool m_histogramSet;                      //!< The histogram range was given, no range pass is needed.
+
+            std::size_t m_nThreads;
+            std::size_t m_memoryBudget;
+
+            std::vector<WorkerData> m_workers;
+            std::vector<ParcelStatistics> m_statistics;
+
+            boost::mutex m_ioMutex;                   //!< Serializes the band reads.
+        };
+
+        /*!
+          \brief Saves the parcels with their statistics as a new data set.
+
+          The data set has the parcel id and geometry of the parcel layer, and the
+          count, mean, stddev, min, max and p<percentile> attributes of each parcel.
+        */
+        void ExportParcelStatistics(te::map::AbstractLayerPtr parcelLayer, const std::vector<ParcelStatistics>& statistics,
+                                    const std::vector<double>& percentiles, std::string dataSetName, std::string dsType,
+                                    std::map<std::string, std::string> connInfo);
+
+      } // end namespace thirdParty
+    }   // end namespace plugins
+  }     // end namespace qt
+}       // end namespace te
+
+#endif //__TE_QT_PLUGINS_THIRDPARTY_INTERNAL_ZONALSTATISTICS_H
@@ -41,7 +41,6 @@
 #include <terralib/raster/RasterSummary.h>
 #include <terralib/raster/RasterSummaryManager.h>
 #include <terralib/raster/Utils.h>
-#include <terralib/rp/Filter.h>
 #include <terralib/se/Categorize.h>
 #include <terralib/se/ColorMap.h>
 #include <terralib/se/CoverageStyle.h>
@@ -49,7 +48,10 @@
 #include <terralib/se/RasterSymbolizer.h>
 #include <terralib/se/Rule.h>
 #include <terralib/se/Utils.h>
+#include "../core/BinaryMorphology.h"
 #include "../core/ForestMonitorClassification.h"
+#include "../core/ParcelClassification.h"
+#include "../core/ZonalStatistics.h"
 #include "ForestMonitorClassDialog.h"
 #include "ui_ForestMonitorClassDialogForm.h"
 
@@ -298,48 +300,10 @@ void te::qt::plugins::tv5plugins::ForestMonitorClassDialog::onGenerateErosionSam
   std::map<std::string, std::string> rInfo;
   rInfo["FORCE_MEM_DRIVER"] = "TRUE";
 
-  te::rst::Grid* grid = new te::rst::Grid(m_thresholdRaster->getNumberOfColumns(), m_thresholdRaster->getNumberOfRows(), new te::gm::Envelope(*m_thresholdRaster->getExtent()), m_thresholdRaster->getSRID());
-
-  std::vector<te::rst::BandProperty*> bands;
-
-  for (std::size_t b = 0; b < m_thresholdRaster->getNumberOfBands(); b++)
-  {
-    bands.push_back(new te::rst::BandProperty(0, te::dt::UCHAR_TYPE));
-    bands[ b ]->m_nblocksx = 1;
-    bands[ b ]->m_nblocksy = m_thresholdRaster->getNumberOfRows();
-    bands[ b ]->m_blkw = m_thresholdRaster->getNumberOfColumns();
-    bands[ b ]->m_blkh = 1;
-  }
-
-  te::rst::Raster* raster = te::rst::RasterFactory::make(grid, bands, rInfo);
-
-  te::common::TaskProgress task("Generating Filter Raster");
-  task.setTotalSteps(m_thresholdRaster->getNumberOfRows());
-
-  //fill erosion raster
-  for(unsigned int i = 0; i < m_thresholdRaster->getNumberOfRows(); ++i)
-  {
-    for(unsigned int j = 0; j < m_thresholdRaster->getNumberOfColumns(); ++j)
-    {
-      double curValue;
-
-      m_thresholdRaster->getValue(j, i, curValue);
-
-      if(curValue <= value)
-      {
-        raster->setValue(j, i, 255.);
-      }
-      else
-      {
-        raster->setValue(j, i, 0.);
-      }
-    }
-    
-    task.pulse();
-  }
+  m_filterMask = te::qt::plugins::tv5plugins::GenerateThresholdMask(m_thresholdRaster.get(), 0, value);
 
   //draw erosion raster
-  m_filterRaster.reset(raster);
+  m_filterRaster = te::qt::plugins::tv5plugins::GenerateMaskRaster(*m_filterMask, m_thresholdRaster.get(), 0, "MEM", rInfo);
 
   m_erosionDisplay->setExtent(*m_thresholdRaster->getExtent(), false);
 
@@ -358,34 +322,21 @@ void te::qt::plugins::tv5plugins::ForestMonitorClassDialog::onDilationPushButton
   if (m_ui->m_dilationLineEdit->text().isEmpty())
     return;
 
-  te::rp::Filter algorithmInstance;
+  if(!m_filterMask.get())
+    return;
 
-  te::rp::Filter::InputParameters algoInputParams;
-  algoInputParams.m_iterationsNumber = m_ui->m_dilationLineEdit->text().toInt();
-  algoInputParams.m_filterType = te::rp::Filter::InputParameters::DilationFilterT;
-  algoInputParams.m_inRasterBands.push_back(0);
-  algoInputParams.m_inRasterPtr = m_filterRaster.get();
-  algoInputParams.m_enableProgress = true;
+  m_filterDilMask.reset(new te::qt::plugins::tv5plugins::BinaryMask(*m_filterMask));
 
-  std::map<std::string, std::string> rinfo;
-  rinfo["MEM_RASTER_NROWS"] = boost::lexical_cast<std::string>(m_filterRaster->getNumberOfRows());
-  rinfo["MEM_RASTER_NCOLS"] = boost::lexical_cast<std::string>(m_filterRaster->getNumberOfColumns());
-  rinfo["MEM_RASTER_DATATYPE"] = boost::lexical_cast<std::string>(m_filterRaster->getBandDataType(0));
-  rinfo["MEM_RASTER_NBANDS"] = boost::lexical_cast<std::string>(m_filterRaster->getNumberOfBands());
-  
-  te::rp::Filter::OutputParameters algoOutputParams;
-  algoOutputParams.m_rType = "MEM";
-  algoOutputParams.m_rInfo = rinfo;
+  te::qt::plugins::tv5plugins::BinaryMorphology morphology;
 
-  if(algorithmInstance.initialize(algoInputParams))
-  {
-    if(algorithmInstance.execute(algoOutputParams))
-    {
-      m_filterDilRaster = algoOutputParams.m_outputRasterPtr;
+  morphology.dilate(*m_filterDilMask, m_ui->m_dilationLineEdit->text().toInt());
 
-      drawRaster(m_filterDilRaster.get(), m_erosionDisplay.get());
-    }
-  }
+  std::map<std::string, std::string> rInfo;
+  rInfo["FORCE_MEM_DRIVER"] = "TRUE";
+
+  m_filterDilRaster = te::qt::plugins::tv5plugins::GenerateMaskRaster(*m_filterDilMask, m_filterRaster.get(), 0, "MEM", rInfo);
+
+  drawRaster(m_filterDilRaster.get(), m_erosionDisplay.get());
 
   m_ui->m_dilationResLineEdit->setText(m_ui->m_dilationLineEdit->text());
 
@@ -398,7 +349,7 @@ void te::qt::plugins::tv5plugins::ForestMonitorClassDialog::onErosionPushButtonC
   if (m_ui->m_erosionLineEdit->text().isEmpty() || m_ui->m_dilationLineEdit->text().isEmpty())
     return;
 
-  if(!m_filterDilRaster.get())
+  if(!m_filterDilMask.get())
   {
     QMessageBox::warning(this, tr("Warning"), tr("Erosion Filter not defined."));
 
@@ -417,34 +368,18 @@ void te::qt::plugins::tv5plugins::ForestMonitorClassDialog::onErosionPushButtonC
     return;
   }
 
-  te::rp::Filter algorithmInstance;
+  te::qt::plugins::tv5plugins::BinaryMask mask(*m_filterDilMask);
 
-  te::rp::Filter::InputParameters algoInputParams;
-  algoInputParams.m_iterationsNumber = m_ui->m_erosionLineEdit->text().toInt();
-  algoInputParams.m_filterType = te::rp::Filter::InputParameters::ErosionFilterT;
-  algoInputParams.m_inRasterBands.push_back(0);
-  algoInputParams.m_inRasterPtr = m_filterDilRaster.get();
-  algoInputParams.m_enableProgress = true;
+  te::qt::plugins::tv5plugins::BinaryMorphology morphology;
 
-  std::map<std::string, std::string> rinfo;
-  rinfo["MEM_RASTER_NROWS"] = boost::lexical_cast<std::string>(m_filterDilRaster->getNumberOfRows());
-  rinfo["MEM_RASTER_NCOLS"] = boost::lexical_cast<std::string>(m_filterDilRaster->getNumberOfColumns());
-  rinfo["MEM_RASTER_DATATYPE"] = boost::lexical_cast<std::string>(m_filterDilRaster->getBandDataType(0));
-  rinfo["MEM_RASTER_NBANDS"] = boost::lexical_cast<std::string>(m_filterDilRaster->getNumberOfBands());
-  
-  te::rp::Filter::OutputParameters algoOutputParams;
-  algoOutputParams.m_rType = "MEM";
-  algoOutputParams.m_rInfo = rinfo;
+  morphology.erode(mask, erosionValue);
 
-  if(algorithmInstance.initialize(algoInputParams))
-  {
-    if(algorithmInstance.execute(algoOutputParams))
-    {
-      std::auto_ptr<te::rst::Raster> rst = algoOutputParams.m_outputRasterPtr;
+  std::map<std::string, std::string> rInfo;
+  rInfo["FORCE_MEM_DRIVER"] = "TRUE";
 
-      drawRaster(rst.get(), m_erosionDisplay.get());
-    }
-  }
+  std::auto_ptr<te::rst::Raster> rst = te::qt::plugins::tv5plugins::GenerateMaskRaster(mask, m_filterDilRaster.get(), 0, "MEM", rInfo);
+
+  drawRaster(rst.get(), m_erosionDisplay.get());
 
   m_ui->m_erosionResLineEdit->setText(m_ui->m_erosionLineEdit->text());
 }
@@ -557,18 +492,34 @@ void te::qt::plugins::tv5plugins::ForestMonitorClassDialog::onOkPushButtonClicke
 
   te::da::DataSourcePtr polyOutputDataSource = createDataSource(polyDataSourcePath, polyDsInfo);
 
+  //create datasource to save the parcel statistics
+  bool parcelStatistics = m_ui->m_parcelStatisticsCheckBox->isChecked();
+
+  std::map<std::string, std::string> statDsInfo;
+
+  if (parcelStatistics)
+    createDataSource(repName + "_statistics" + ".shp", statDsInfo);
+
   QApplication::setOverrideCursor(Qt::WaitCursor);
 
   try
   {
-    std::map<std::string, std::string> rInfo;
-    //rInfo["FORCE_MEM_DRIVER"] = "TRUE";
+    //the trees are detected by the tile pipeline, without intermediate rasters, the parcels are processed in parallel
+    te::qt::plugins::tv5plugins::ParcelClassification classification(ndviRst.get(), ndviBand, threshold, dilation, erosion);
+
+    if (m_ui->m_saveResultImageCheckBox->isChecked())
+      classification.setMaskOutput(repName);
+
+    classification.setExportPolygons(m_ui->m_exportPolygonsCheckBox->isChecked());
 
-    //std::string type = "MEM";
-    std::string type = "GDAL";
+    if (m_ui->m_saveIntermediateCheckBox->isChecked())
+      classification.setDebugOutput(repName);
 
     std::vector<te::qt::plugins::tv5plugins::CentroidInfo*> centroidsVec;
 
+    //the parcel statistics are computed after the loop, in one pass over the ndvi raster
+    te::qt::plugins::tv5plugins::ZonalStatistics zonal(ndviRst.get(), ndviBand);
+
     std::auto_ptr<te::da::DataSet> dataSet = vecLayer->getData();
     std::auto_ptr<te::da::DataSetType> dataSetType = vecLayer->getSchema();
 
@@ -583,23 +534,13 @@ void te::qt::plugins::tv5plugins::ForestMonitorClassDialog::onOkPushButtonClicke
     te::da::PrimaryKey* pk = dataSetType->getPrimaryKey();
     std::string name = pk->getProperties()[0]->getName();
 
-    std::size_t size = dataSet->size();
-
     dataSet->moveBeforeFirst();
 
-    te::common::TaskProgress task("Associating Centroids");
-    task.setTotalSteps(size);
-
     std::vector<te::gm::Geometry*> fullGeomVec;
 
     //get geometries
     while (dataSet->moveNext())
     {
-      if (!task.isActive())
-      {
-        break;
-      }
-
       std::auto_ptr<te::gm::Geometry> g(dataSet->getGeometry(gpos));
 
       if (!g->isValid())
@@ -630,57 +571,26 @@ void te::qt::plugins::tv5plugins::ForestMonitorClassDialog::onOkPushButtonClicke
       if (!poly || !poly->isValid())
         continue;
 
-      //create raster crop from parcel
-      rInfo["URI"] = repName + "_parcel_" + te::common::Convert2String(parcelId) + ".tif";
-      te::rst::RasterPtr parcelRaster(te::rst::CropRaster(*ndviRst.get(), *poly, rInfo, type));
+      if (parcelStatistics)
+        zonal.addParcel(parcelId, g.get());
 
-      //create threshold raster
-      rInfo["URI"] = repName + "_threshold_" + te::common::Convert2String(parcelId) + ".tif";
-      std::auto_ptr<te::rst::Raster> thresholdRaster = GenerateThresholdRaster(parcelRaster.get(), ndviBand, threshold, type, rInfo);
-
-      //create erosion raster
-      rInfo["URI"] = repName + "_erosion_" + te::common::Convert2String(parcelId) + ".tif";
-      std::auto_ptr<te::rst::Raster> erosionRaster = GenerateFilterRaster(thresholdRaster.get(), 0, dilation, te::rp::Filter::InputParameters::DilationFilterT, type, rInfo);
-
-      thresholdRaster.reset(0);
-
-      //create dilation raster
-      rInfo["URI"] = repName + "_dilation_" + te::common::Convert2String(parcelId) + ".tif";
-      std::auto_ptr<te::rst::Raster> dilationRaster = GenerateFilterRaster(erosionRaster.get(), 0, erosion, te::rp::Filter::InputParameters::ErosionFilterT, type, rInfo);
-
-      erosionRaster.reset(0);
-
-      //export image
-      if (m_ui->m_saveResultImageCheckBox->isChecked())
-      {
-        std::string repName = m_ui->m_repositoryLineEdit->text().toStdString();
-
-        std::size_t idx = repName.find(".");
-        if (idx != std::string::npos)
-          repName = repName.substr(0, idx);
-
-        std::string rasterFileName = repName + "_" + te::common::Convert2String(parcelId) + ".tif";
-
-        te::qt::plugins::tv5plugins::ExportRaster(dilationRaster.get(), rasterFileName);
-      }
-
-      //create geometries
-      std::vector<te::gm::Geometry*> geomVec = te::qt::plugins::tv5plugins::Raster2Vector(dilationRaster.get(), 0);
+      classification.addParcel(parcelId, new te::gm::Polygon(*poly));
+    }
 
-      dilationRaster.reset(0);
+    //get centroids and crown polygons, in parcel order
+    classification.execute(centroidsVec, fullGeomVec);
 
-      //get centroids
-      te::qt::plugins::tv5plugins::ExtractCentroids(geomVec, centroidsVec, parcelId);
+    if (parcelStatistics)
+    {
+      std::vector<double> percentiles;
+      percentiles.push_back(10.);
+      percentiles.push_back(50.);
+      percentiles.push_back(90.);
 
-      if (geomVec.size() > 2)
-      {
-        for (std::size_t t = 1; t < geomVec.size(); ++t)
-        {
-          fullGeomVec.push_back(geomVec[t]);
-        }
-      }
+      zonal.setPercentiles(percentiles);
+      zonal.execute();
 
-      geomVec.clear();
+      te::qt::plugins::tv5plugins::ExportParcelStatistics(vecLayer, zonal.getStatistics(), percentiles, dataSetName + "_statistics", "OGR", statDsInfo);
     }
 
     //export data
@@ -692,7 +602,8 @@ void te::qt::plugins::tv5plugins::ForestMonitorClassDialog::onOkPushButtonClicke
 
     std::string polyDataSetName = dataSetName + "_polygons";
 
-    te::qt::plugins::tv5plugins::ExportPolyVector(fullGeomVec, polyDataSetName, "OGR", polyDsInfo, ndviRst->getSRID());
+    if (!fullGeomVec.empty())
+      te::qt::plugins::tv5plugins::ExportPolyVector(fullGeomVec, polyDataSetName, "OGR", polyDsInfo, ndviRst->getSRID());
 
     te::common::FreeContents(fullGeomVec);
 
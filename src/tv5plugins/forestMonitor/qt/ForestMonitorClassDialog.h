@@ -36,6 +36,7 @@
 #include <terralib/raster/Raster.h>
 #include <terralib/se/Style.h>
 #include "../../Config.h"
+#include "../core/BinaryMask.h"
 
 // STL
 #include <memory>
@@ -111,6 +112,10 @@ namespace te
             std::auto_ptr<te::rst::Raster> m_filterRaster;
 
             std::auto_ptr<te::rst::Raster> m_filterDilRaster;
+
+            std::auto_ptr<te::qt::plugins::tv5plugins::BinaryMask> m_filterMask;              //!< Threshold mask of the filter preview.
+
+            std::auto_ptr<te::qt::plugins::tv5plugins::BinaryMask> m_filterDilMask;           //!< Dilated mask of the filter preview.
             
             std::auto_ptr<te::se::Style> m_styleThresholdRaster;
 
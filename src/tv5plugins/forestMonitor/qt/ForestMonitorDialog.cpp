@@ -217,6 +217,8 @@ void te::qt::plugins::tv5plugins::ForestMonitorDialog::onOkPushButtonClicked()
 
     fms.setOutputParameters(outputDataSource, dataSetName);
 
+    fms.setIncremental(m_ui->m_incrementalCheckBox->isChecked());
+
     fms.runService();
 
     //create layer
@@ -29,6 +29,7 @@
 #include <terralib/qt/widgets/layer/utils/DataSet2Layer.h>
 #include <terralib/qt/widgets/progress/ProgressViewerDialog.h>
 #include <terralib/qt/widgets/rp/Utils.h>
+#include "../core/BandMath.h"
 #include "../core/NDVI.h"
 #include "NDVIDialog.h"
 #include "ui_NDVIDialogForm.h"
@@ -52,10 +53,17 @@ te::qt::plugins::tv5plugins::NDVIDialog::NDVIDialog(QWidget* parent, Qt::WindowF
   connect(m_ui->m_targetFileToolButton, SIGNAL(pressed()), this,  SLOT(onTargetFileToolButtonPressed()));
   connect(m_ui->m_nirLayerComboBox, SIGNAL(activated(int)), this, SLOT(onNIRLayerCmbActivated(int)));
   connect(m_ui->m_visLayerComboBox, SIGNAL(activated(int)), this, SLOT(onVISLayerCmbActivated(int)));
+  connect(m_ui->m_gndviCheckBox, SIGNAL(toggled(bool)), this, SLOT(onIndexToggled()));
+  connect(m_ui->m_saviCheckBox, SIGNAL(toggled(bool)), this, SLOT(onIndexToggled()));
+  connect(m_ui->m_eviCheckBox, SIGNAL(toggled(bool)), this, SLOT(onIndexToggled()));
 
   //validators
   m_ui->m_gainLineEdit->setValidator(new QDoubleValidator(this));
   m_ui->m_offsetLineEdit->setValidator(new QDoubleValidator(this));
+  m_ui->m_memoryLineEdit->setValidator(new QIntValidator(1, 1048576, this));
+  m_ui->m_reflectanceLineEdit->setValidator(new QDoubleValidator(this));
+
+  onIndexToggled();
 }
 
 te::qt::plugins::tv5plugins::NDVIDialog::~NDVIDialog()
@@ -131,6 +139,8 @@ void te::qt::plugins::tv5plugins::NDVIDialog::onNIRLayerCmbActivated(int idx)
 void te::qt::plugins::tv5plugins::NDVIDialog::onVISLayerCmbActivated(int idx)
 {
   m_ui->m_visBandComboBox->clear();
+  m_ui->m_greenBandComboBox->clear();
+  m_ui->m_blueBandComboBox->clear();
 
   QVariant varLayer = m_ui->m_visLayerComboBox->itemData(idx, Qt::UserRole);
   te::map::AbstractLayerPtr layer = varLayer.value<te::map::AbstractLayerPtr>();
@@ -149,6 +159,8 @@ void te::qt::plugins::tv5plugins::NDVIDialog::onVISLayerCmbActivated(int idx)
       for(unsigned int i = 0; i < inputRst->getNumberOfBands(); ++i)
       {
         m_ui->m_visBandComboBox->addItem(QString::number(i));
+        m_ui->m_greenBandComboBox->addItem(QString::number(i));
+        m_ui->m_blueBandComboBox->addItem(QString::number(i));
       }
     }
   }
@@ -199,12 +211,75 @@ void te::qt::plugins::tv5plugins::NDVIDialog::onOkPushButtonClicked()
 
   int visBand = m_ui->m_visBandComboBox->currentText().toInt();
 
+  //indices other than NDVI are computed by the band math engine
+  std::vector<te::qt::plugins::tv5plugins::IndexDefinition> indices;
+
+  if(isBandMath())
+  {
+    double reflectanceScale = 1.;
+
+    if(!m_ui->m_reflectanceLineEdit->text().isEmpty())
+      reflectanceScale = m_ui->m_reflectanceLineEdit->text().toDouble();
+
+    if(m_ui->m_gndviCheckBox->isChecked())
+      indices.push_back(te::qt::plugins::tv5plugins::IndexDefinition(te::qt::plugins::tv5plugins::INDEX_GNDVI));
+
+    if(m_ui->m_saviCheckBox->isChecked())
+      indices.push_back(te::qt::plugins::tv5plugins::IndexDefinition(te::qt::plugins::tv5plugins::INDEX_SAVI));
+
+    if(m_ui->m_eviCheckBox->isChecked())
+      indices.push_back(te::qt::plugins::tv5plugins::IndexDefinition(te::qt::plugins::tv5plugins::INDEX_EVI));
+
+    //positions in the band list: nir, red, green and blue
+    for(std::size_t t = 0; t < indices.size(); ++t)
+    {
+      indices[t].m_nir = 0;
+      indices[t].m_red = 1;
+      indices[t].m_green = 2;
+      indices[t].m_blue = 3;
+      indices[t].m_gain = gain;
+      indices[t].m_offset = offset;
+      indices[t].m_invert = m_ui->m_invertCheckBox->isChecked();
+      indices[t].m_reflectanceScale = reflectanceScale;
+    }
+
+    //the NDVI takes the mean of the visible bands (positions 4, ...) as GenerateNDVIRaster does, written as a ratio of the band sums
+    if(m_ui->m_ndviCheckBox->isChecked())
+      indices.insert(indices.begin(), getNDVIRatio(visRaster.get(), visBand));
+  }
+  else if(!m_ui->m_ndviCheckBox->isChecked())
+  {
+    QMessageBox::information(this, tr("Warning"), tr("Select at least one index."));
+    return;
+  }
+
   bool normalize = m_ui->m_normalizeCheckBox->isChecked();
 
+  //the combo items follow the NDVIRangeMode order
+  te::qt::plugins::tv5plugins::NDVIRangeMode rangeMode = (te::qt::plugins::tv5plugins::NDVIRangeMode)m_ui->m_rangeComboBox->currentIndex();
+
+  te::qt::plugins::tv5plugins::NDVIResampling resampling = (te::qt::plugins::tv5plugins::NDVIResampling)m_ui->m_resamplingComboBox->currentIndex();
+
+  //memory used by the NDVI buffers, in MB
+  std::size_t memoryBudget = 0;
+
+  if(!m_ui->m_memoryLineEdit->text().isEmpty())
+    memoryBudget = (std::size_t)m_ui->m_memoryLineEdit->text().toInt() * 1024 * 1024;
+
+  //overviews down to 256 pixels
+  unsigned int overviewLevels = 0;
+
+  if(m_ui->m_overviewsCheckBox->isChecked() && indices.empty())
+    overviewLevels = te::qt::plugins::tv5plugins::GetOverviewLevels(nirRaster->getNumberOfColumns(), nirRaster->getNumberOfRows());
+
   //rinfo information
   std::string type = "GDAL";
   std::map<std::string, std::string> rInfo;
-  rInfo["URI"] = m_ui->m_repositoryLineEdit->text().toStdString();
+
+  if(m_ui->m_tiledCheckBox->isChecked())
+    rInfo = te::qt::plugins::tv5plugins::GetTiledGeoTiffInfo(m_ui->m_repositoryLineEdit->text().toStdString());
+  else
+    rInfo["URI"] = m_ui->m_repositoryLineEdit->text().toStdString();
 
   //progress
   te::qt::widgets::ProgressViewerDialog v(this);
@@ -214,7 +289,28 @@ void te::qt::plugins::tv5plugins::NDVIDialog::onOkPushButtonClicked()
 
   try
   {
-    std::auto_ptr<te::rst::Raster> rOut = te::qt::plugins::tv5plugins::GenerateNDVIRaster(nirRaster.get(), nirBand, visRaster.get(), visBand, gain, offset, normalize, rInfo, type, m_ui->m_invertCheckBox->isChecked());
+    std::auto_ptr<te::rst::Raster> rOut;
+
+    if(indices.empty())
+    {
+      rOut = te::qt::plugins::tv5plugins::GenerateNDVIRaster(nirRaster.get(), nirBand, visRaster.get(), visBand, gain, offset, normalize, rInfo, type, m_ui->m_invertCheckBox->isChecked(), 0, rangeMode, memoryBudget, overviewLevels, resampling);
+    }
+    else
+    {
+      //one output band for each index, the input bands must share the NIR grid
+      std::vector<te::rst::Band*> bands;
+      bands.push_back(nirRaster->getBand(nirBand));
+      bands.push_back(visRaster->getBand(visBand));
+      bands.push_back(visRaster->getBand(m_ui->m_greenBandComboBox->currentText().toInt()));
+      bands.push_back(visRaster->getBand(m_ui->m_blueBandComboBox->currentText().toInt()));
+
+      std::vector<std::size_t> visBands = te::qt::plugins::tv5plugins::GetVisibleBands(visRaster.get(), visBand);
+
+      for(std::size_t t = 0; t < visBands.size(); ++t)
+        bands.push_back(visRaster->getBand(visBands[t]));
+
+      rOut = te::qt::plugins::tv5plugins::GenerateIndexRaster(bands, indices, te::dt::DOUBLE_TYPE, rInfo, type, 0, memoryBudget);
+    }
   }
   catch(const std::exception& e)
   {
@@ -237,8 +333,11 @@ void te::qt::plugins::tv5plugins::NDVIDialog::onOkPushButtonClicked()
     return;
   }
 
-  //set output layer
-  m_outputLayer = te::qt::widgets::createLayer(type, rInfo);
+  //set output layer, the creation options are not used to open the raster
+  std::map<std::string, std::string> layerInfo;
+  layerInfo["URI"] = rInfo["URI"];
+
+  m_outputLayer = te::qt::widgets::createLayer(type, layerInfo);
 
   te::common::ProgressManager::getInstance().removeViewer(id);
 
@@ -247,6 +346,52 @@ void te::qt::plugins::tv5plugins::NDVIDialog::onOkPushButtonClicked()
   accept();
 }
 
+void te::qt::plugins::tv5plugins::NDVIDialog::onIndexToggled()
+{
+  //the normalization, the resampling and the overviews are only done by the NDVI operation
+  bool ndviOnly = !isBandMath();
+
+  m_ui->m_normalizeCheckBox->setEnabled(ndviOnly);
+  m_ui->m_rangeComboBox->setEnabled(ndviOnly);
+  m_ui->m_resamplingComboBox->setEnabled(ndviOnly);
+  m_ui->m_overviewsCheckBox->setEnabled(ndviOnly);
+}
+
+bool te::qt::plugins::tv5plugins::NDVIDialog::isBandMath()
+{
+  return m_ui->m_gndviCheckBox->isChecked() || m_ui->m_saviCheckBox->isChecked() || m_ui->m_eviCheckBox->isChecked();
+}
+
+te::qt::plugins::tv5plugins::IndexDefinition te::qt::plugins::tv5plugins::NDVIDialog::getNDVIRatio(const te::rst::Raster* visRaster, int visBand)
+{
+  //(nir - sum / k) / (nir + sum / k) = (k * nir - sum) / (k * nir + sum), the inverted nir is 255 - nir
+  std::size_t nVis = te::qt::plugins::tv5plugins::GetVisibleBands(visRaster, visBand).size();
+
+  double k = (double)nVis;
+  bool invert = m_ui->m_invertCheckBox->isChecked();
+
+  te::qt::plugins::tv5plugins::IndexDefinition ndvi(te::qt::plugins::tv5plugins::INDEX_RATIO);
+  ndvi.m_gain = m_ui->m_gainLineEdit->text().toDouble();
+  ndvi.m_offset = m_ui->m_offsetLineEdit->text().toDouble();
+
+  //constant, nir, red, green, blue and the visible bands
+  ndvi.m_numerator.assign(5 + nVis, 0.);
+  ndvi.m_denominator.assign(5 + nVis, 0.);
+
+  ndvi.m_numerator[0] = invert ? 255. * k : 0.;
+  ndvi.m_numerator[1] = invert ? -k : k;
+  ndvi.m_denominator[0] = ndvi.m_numerator[0];
+  ndvi.m_denominator[1] = ndvi.m_numerator[1];
+
+  for(std::size_t t = 0; t < nVis; ++t)
+  {
+    ndvi.m_numerator[5 + t] = -1.;
+    ndvi.m_denominator[5 + t] = 1.;
+  }
+
+  return ndvi;
+}
+
 void te::qt::plugins::tv5plugins::NDVIDialog::onTargetFileToolButtonPressed()
 {
   m_ui->m_repositoryLineEdit->clear();
@@ -41,12 +41,16 @@ namespace Ui { class NDVIDialogForm; }
 
 namespace te
 {
+  namespace rst { class Raster; }
+
   namespace qt
   {
     namespace plugins
     {
       namespace tv5plugins
       {
+        struct IndexDefinition;
+
         /*!
           \class NDVIDialog
 
@@ -78,6 +82,17 @@ namespace te
 
             void onTargetFileToolButtonPressed();
 
+            /*! \brief Enables the NDVI only options when no other index is selected. */
+            void onIndexToggled();
+
+          private:
+
+            /*! \brief True if an index other than NDVI is selected, the indices are then generated by GenerateIndexRaster. */
+            bool isBandMath();
+
+            /*! \brief NDVI of the band math as a ratio index, with the visible value of GenerateNDVIRaster (the mean of the visible bands, from position 4). */
+            IndexDefinition getNDVIRatio(const te::rst::Raster* visRaster, int visBand);
+
           private:
 
             std::auto_ptr<Ui::NDVIDialogForm> m_ui;
@@ -99,6 +99,8 @@ te::qt::plugins::tv5plugins::TrackAutoClassifier::TrackAutoClassifier(te::qt::wi
   
   display->setFocus();
   
+  m_centroidIndex = CreatePointIndex(GRID_POINT_INDEX, m_distance);
+
   createRTree();
 
   getStartIdValue();
@@ -114,13 +116,9 @@ te::qt::plugins::tv5plugins::TrackAutoClassifier::~TrackAutoClassifier()
   QPixmap* draft = m_display->getDraftPixmap();
   draft->fill(Qt::transparent);
 
-  m_centroidRtree.clear();
   te::common::FreeContents(m_centroidGeomMap);
   te::common::FreeContents(m_centroidObjIdMap);
 
-  m_angleRtree.clear();
-  te::common::FreeContents(m_angleGeomMap);
-
   delete m_point0;
   delete m_point1;
 
@@ -504,51 +502,12 @@ te::gm::Geometry* te::qt::plugins::tv5plugins::TrackAutoClassifier::createBuffer
   }
   else
   {
-    if (parcelGeom->getSRID() != m_dirLayer->getSRID())
-      parcelGeom->transform(m_dirLayer->getSRID());
-
-    te::gm::Envelope ext(*parcelGeom->getMBR());
-
-    std::vector<int> results;
-
-    m_angleRtree.search(ext, results);
-
-    for (size_t t = 0; t < results.size(); ++t)
-    {
-      std::map<int, te::gm::Geometry*>::iterator it = m_angleGeomMap.find(results[t]);
-
-      if (it != m_angleGeomMap.end())
-      {
-        if (parcelGeom->contains(it->second))
-        {
-          te::gm::MultiLineString* mLine = dynamic_cast<te::gm::MultiLineString*>(it->second);
-
-          if (mLine && mLine->getNumGeometries() != 0)
-          {
-            te::gm::LineString* line = dynamic_cast<te::gm::LineString*>(mLine->getGeometryN(0));
-
-            if (line && line->size() >= 2)
-            {
-              std::auto_ptr<te::gm::Point> first(line->getPointN(0));
-              std::auto_ptr<te::gm::Point> last(line->getPointN(1));
+    const ParcelAngle* pa = m_angleTable.find(parcelId);
 
-              if (first->getSRID() != m_coordLayer->getSRID())
-                first->transform(m_coordLayer->getSRID());
-
-              if (last->getSRID() != m_coordLayer->getSRID())
-                last->transform(m_coordLayer->getSRID());
-
-              getTrackInfo(first.get(), last.get());
-
-              break;
-            }
-          }
-        }
-      }
-    }
+    if (pa)
+      getTrackInfo(pa->m_dx, pa->m_dy);
   }
   
-
   double dx = m_dx;
   double dy = m_dy;
 
@@ -588,7 +547,7 @@ te::gm::Geometry* te::qt::plugins::tv5plugins::TrackAutoClassifier::createBuffer
     //check on tree
     std::vector<int> resultsTreeObjs;
 
-    m_centroidRtree.search(ext, resultsTreeObjs);
+    m_centroidIndex->search(ext, resultsTreeObjs);
 
     //filter using a line buffer
     std::auto_ptr<te::gm::LineString> lineSearchBuffer(new te::gm::LineString(2, te::gm::LineStringType, srid));
@@ -765,18 +724,23 @@ te::gm::Geometry* te::qt::plugins::tv5plugins::TrackAutoClassifier::createBuffer
 
 void te::qt::plugins::tv5plugins::TrackAutoClassifier::getTrackInfo(te::gm::Point* point0, te::gm::Point* point1)
 {
-  if (m_distLineEdit->text().isEmpty())
-    m_distance = DISTANCE;
-  else
-    m_distance = m_distLineEdit->text().toDouble();
-  
   double bigDistance = point0->distance(point1);
 
   double big_dx = point1->getX() - point0->getX();
   double big_dy = point1->getY() - point0->getY();
 
-  m_dx = m_distance * big_dx / bigDistance;
-  m_dy = m_distance * big_dy / bigDistance;
+  getTrackInfo(big_dx / bigDistance, big_dy / bigDistance);
+}
+
+void te::qt::plugins::tv5plugins::TrackAutoClassifier::getTrackInfo(double dx, double dy)
+{
+  if (m_distLineEdit->text().isEmpty())
+    m_distance = DISTANCE;
+  else
+    m_distance = m_distLineEdit->text().toDouble();
+
+  m_dx = m_distance * dx;
+  m_dy = m_distance * dy;
 
   m_classify = true;
 }
@@ -964,13 +928,11 @@ void te::qt::plugins::tv5plugins::TrackAutoClassifier::createRTree()
 
   te::common::FreeContents(m_centroidGeomMap);
   te::common::FreeContents(m_centroidObjIdMap);
-  te::common::FreeContents(m_angleGeomMap);
 
-  m_centroidRtree.clear();
+  m_centroidIndex->clear();
   m_centroidGeomMap.clear();
   m_centroidObjIdMap.clear();
-  m_angleRtree.clear();
-  m_angleGeomMap.clear();
+  m_angleTable.clear();
 
   //create rtree
   std::auto_ptr<const te::map::LayerSchema> schema(m_coordLayer->getSchema());
@@ -1000,13 +962,15 @@ void te::qt::plugins::tv5plugins::TrackAutoClassifier::createRTree()
     te::gm::Geometry* g = ds->getGeometry(geomIdx).release();
     const te::gm::Envelope* box = g->getMBR();
 
-    m_centroidRtree.insert(*box, id);
+    m_centroidIndex->insert(box->m_llx, box->m_lly, id);
 
     m_centroidGeomMap.insert(std::map<int, te::gm::Geometry*>::value_type(id, g));
 
     m_centroidObjIdMap.insert(std::map<int, te::da::ObjectId*>::value_type(id, te::da::GenerateOID(ds.get(), pnames)));
   }
 
+  m_centroidIndex->build(0);
+
   //get direction geometries
   std::auto_ptr<const te::map::LayerSchema> schemaDir(m_dirLayer->getSchema());
   std::auto_ptr<te::da::DataSet> dsDir(m_dirLayer->getData());
@@ -1017,6 +981,8 @@ void te::qt::plugins::tv5plugins::TrackAutoClassifier::createRTree()
   te::da::PrimaryKey* pkDir = schemaDir->getPrimaryKey();
   int idDirIdx = te::da::GetPropertyPos(schemaDir.get(), pkDir->getProperties()[0]->getName());
 
+  std::map<int, te::gm::Geometry*> angleGeomMap;
+
   dsDir->moveBeforeFirst();
 
   while (dsDir->moveNext())
@@ -1026,13 +992,48 @@ void te::qt::plugins::tv5plugins::TrackAutoClassifier::createRTree()
     int id = atoi(strId.c_str());
 
     te::gm::Geometry* g = dsDir->getGeometry(geomDirIdx).release();
-    const te::gm::Envelope* box = g->getMBR();
 
-    m_angleRtree.insert(*box, id);
+    if (!angleGeomMap.insert(std::map<int, te::gm::Geometry*>::value_type(id, g)).second)
+      delete g;
+  }
+
+  //get parcel geometries, in the direction layer srid
+  std::auto_ptr<const te::map::LayerSchema> schemaParcel(m_parcelLayer->getSchema());
+  std::auto_ptr<te::da::DataSet> dsParcel(m_parcelLayer->getData());
+
+  te::gm::GeometryProperty* gmPropParcel = te::da::GetFirstGeomProperty(schemaParcel.get());
+  int geomParcelIdx = te::da::GetPropertyPos(schemaParcel.get(), gmPropParcel->getName());
 
-    m_angleGeomMap.insert(std::map<int, te::gm::Geometry*>::value_type(id, g));
+  te::da::PrimaryKey* pkParcel = schemaParcel->getPrimaryKey();
+  int idParcelIdx = te::da::GetPropertyPos(schemaParcel.get(), pkParcel->getProperties()[0]->getName());
+
+  std::vector<std::pair<int, te::gm::Geometry*> > parcelGeoms;
+
+  dsParcel->moveBeforeFirst();
+
+  while (dsParcel->moveNext())
+  {
+    std::string strId = dsParcel->getAsString(idParcelIdx);
+
+    te::gm::Geometry* g = dsParcel->getGeometry(geomParcelIdx).release();
+
+    if (g->getSRID() == TE_UNKNOWN_SRS)
+      g->setSRID(m_parcelLayer->getSRID());
+
+    if (g->getSRID() != m_dirLayer->getSRID())
+      g->transform(m_dirLayer->getSRID());
+
+    parcelGeoms.push_back(std::make_pair(atoi(strId.c_str()), g));
   }
 
+  //join parcels and directions once, the direction vectors are given in the centroid layer srid
+  m_angleTable.build(parcelGeoms, angleGeomMap, m_coordLayer->getSRID(), 0);
+
+  for (std::size_t t = 0; t < parcelGeoms.size(); ++t)
+    delete parcelGeoms[t].second;
+
+  te::common::FreeContents(angleGeomMap);
+
   QApplication::restoreOverrideCursor();
 }
 
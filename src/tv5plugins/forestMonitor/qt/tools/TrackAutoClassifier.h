@@ -27,6 +27,8 @@
 #include <terralib/memory/DataSet.h>
 #include <terralib/qt/widgets/tools/AbstractTool.h>
 #include "../../../Config.h"
+#include "../../core/ParcelAngleTable.h"
+#include "../../core/PointIndex.h"
 
 // STL
 #include <list>
@@ -117,6 +119,9 @@ namespace te
 
           void getTrackInfo(te::gm::Point* point0, te::gm::Point* point1);
 
+          /*! \brief Sets the track step (m_dx, m_dy) from an unit direction vector. */
+          void getTrackInfo(double dx, double dy);
+
           std::auto_ptr<te::gm::Geometry> getParcelGeeom(te::gm::Geometry* root, int& parcelId);
 
           te::gm::Point* createGuessPoint(te::gm::Point* p, double dx, double dy, int srid);
@@ -153,7 +158,7 @@ namespace te
           te::map::AbstractLayerPtr m_parcelLayer;        //!<The layer with geometry restriction.
           te::map::AbstractLayerPtr m_dirLayer;           //!<The layer with direction information.
 
-          te::sam::rtree::Index<int> m_centroidRtree;
+          std::auto_ptr<PointIndex> m_centroidIndex;     //!< Centroid index, a grid with the planting distance as cell size.
           std::map<int, te::gm::Geometry*> m_centroidGeomMap;
           std::map<int, te::da::ObjectId*> m_centroidObjIdMap;
 
@@ -192,8 +197,7 @@ namespace te
 
           te::rst::Raster* m_ndviRaster;
 
-          te::sam::rtree::Index<int> m_angleRtree;
-          std::map<int, te::gm::Geometry*> m_angleGeomMap;
+          ParcelAngleTable m_angleTable;                  //!< Row direction of each parcel, built once by createRTree.
 
           //pan attributes
           bool m_panStarted;      //!< Flag that indicates if pan operation was started.
@@ -49,6 +49,7 @@ or (at your option) any later version.
 
 // STL
 #include <cassert>
+#include <cmath>
 #include <memory>
 
 #define DISTANCE_BUFFER 1.5
@@ -87,7 +88,6 @@ te::qt::plugins::tv5plugins::TrackClassifier::~TrackClassifier()
   m_polyRtree.clear();
   te::common::FreeContents(m_polyGeomMap);
   
-  m_centroidRtree.clear();
   te::common::FreeContents(m_centroidGeomMap);
   te::common::FreeContents(m_centroidObjIdMap);
 
@@ -530,7 +530,7 @@ te::gm::Geometry* te::qt::plugins::tv5plugins::TrackClassifier::createBuffer(int
     //check on tree
     std::vector<int> resultsTree;
 
-    m_centroidRtree.search(ext, resultsTree);
+    m_centroidIndex->search(ext, resultsTree);
 
     if (resultsTree.empty())
     {
@@ -1010,7 +1010,6 @@ void te::qt::plugins::tv5plugins::TrackClassifier::createRTree()
   te::common::FreeContents(m_centroidGeomMap);
   te::common::FreeContents(m_centroidObjIdMap);
 
-  m_centroidRtree.clear();
   m_centroidGeomMap.clear();
   m_centroidObjIdMap.clear();
 
@@ -1031,6 +1030,8 @@ void te::qt::plugins::tv5plugins::TrackClassifier::createRTree()
 
   int idIdx = te::da::GetPropertyPos(schema.get(), pk->getProperties()[0]->getName());
 
+  te::gm::Envelope extent;
+
   ds->moveBeforeFirst();
 
   while (ds->moveNext())
@@ -1040,15 +1041,35 @@ void te::qt::plugins::tv5plugins::TrackClassifier::createRTree()
     int id = atoi(strId.c_str());
 
     te::gm::Geometry* g = ds->getGeometry(geomIdx).release();
-    const te::gm::Envelope* box = g->getMBR();
 
-    m_centroidRtree.insert(*box, id);
+    extent.Union(*g->getMBR());
 
     m_centroidGeomMap.insert(std::map<int, te::gm::Geometry*>::value_type(id, g));
 
     m_centroidObjIdMap.insert(std::map<int, te::da::ObjectId*>::value_type(id, te::da::GenerateOID(ds.get(), pnames)));
   }
 
+  //the track distance is only known after the clicks, the grid cell is the mean centroid spacing
+  double cellSize = 1.;
+
+  if (!m_centroidGeomMap.empty() && extent.getArea() > 0.)
+    cellSize = std::sqrt(extent.getArea() / (double)m_centroidGeomMap.size());
+
+  m_centroidIndex = CreatePointIndex(GRID_POINT_INDEX, cellSize);
+
+  std::map<int, te::gm::Geometry*>::iterator it = m_centroidGeomMap.begin();
+
+  while (it != m_centroidGeomMap.end())
+  {
+    const te::gm::Envelope* box = it->second->getMBR();
+
+    m_centroidIndex->insert(box->m_llx, box->m_lly, it->first);
+
+    ++it;
+  }
+
+  m_centroidIndex->build(0);
+
   //create polygons rtree
   if (m_polyGeomMap.empty())
   {
@@ -1080,6 +1101,8 @@ void te::qt::plugins::tv5plugins::TrackClassifier::createRTree()
 
       m_polyGeomMap.insert(std::map<int, te::gm::Geometry*>::value_type(id, g));
     }
+
+    m_polyRtree.build();
   }
 
   QApplication::restoreOverrideCursor();
@@ -27,6 +27,7 @@
 #include <terralib/memory/DataSet.h>
 #include <terralib/qt/widgets/tools/AbstractTool.h>
 #include "../../../Config.h"
+#include "../../core/PointIndex.h"
 
 // STL
 #include <list>
@@ -130,10 +131,10 @@ namespace te
 
           te::da::ObjectIdSet* m_objIdTrackSet;
 
-          te::sam::rtree::Index<int> m_polyRtree;
+          PackedRTree m_polyRtree;
           std::map<int, te::gm::Geometry*> m_polyGeomMap;
 
-          te::sam::rtree::Index<int> m_centroidRtree;
+          std::auto_ptr<PointIndex> m_centroidIndex;     //!< Centroid index, a grid with the mean centroid spacing as cell size.
           std::map<int, te::gm::Geometry*> m_centroidGeomMap;
           std::map<int, te::da::ObjectId*> m_centroidObjIdMap;
 
@@ -77,6 +77,8 @@ te::qt::plugins::tv5plugins::TrackDeadClassifier::TrackDeadClassifier(te::qt::wi
   
   display->setFocus();
   
+  m_centroidIndex = CreatePointIndex(GRID_POINT_INDEX, m_distance);
+
   createRTree();
 
   getStartIdValue();
@@ -94,7 +96,6 @@ te::qt::plugins::tv5plugins::TrackDeadClassifier::~TrackDeadClassifier()
   QPixmap* draft = m_display->getDraftPixmap();
   draft->fill(Qt::transparent);
 
-  m_centroidRtree.clear();
   te::common::FreeContents(m_centroidGeomMap);
   te::common::FreeContents(m_centroidObjIdMap);
 
@@ -513,7 +514,7 @@ void te::qt::plugins::tv5plugins::TrackDeadClassifier::createDeadTrack(int srid,
     //check on tree
     std::vector<int> resultsTree;
 
-    m_centroidRtree.search(ext, resultsTree);
+    m_centroidIndex->search(ext, resultsTree);
 
     if (resultsTree.empty())
     {
@@ -619,7 +620,7 @@ void te::qt::plugins::tv5plugins::TrackDeadClassifier::createRTree()
   te::common::FreeContents(m_centroidGeomMap);
   te::common::FreeContents(m_centroidObjIdMap);
 
-  m_centroidRtree.clear();
+  m_centroidIndex->clear();
   m_centroidGeomMap.clear();
   m_centroidObjIdMap.clear();
 
@@ -651,13 +652,15 @@ void te::qt::plugins::tv5plugins::TrackDeadClassifier::createRTree()
     te::gm::Geometry* g = ds->getGeometry(geomIdx).release();
     const te::gm::Envelope* box = g->getMBR();
 
-    m_centroidRtree.insert(*box, id);
+    m_centroidIndex->insert(box->m_llx, box->m_lly, id);
 
     m_centroidGeomMap.insert(std::map<int, te::gm::Geometry*>::value_type(id, g));
 
     m_centroidObjIdMap.insert(std::map<int, te::da::ObjectId*>::value_type(id, te::da::GenerateOID(ds.get(), pnames)));
   }
 
+  m_centroidIndex->build(0);
+
   QApplication::restoreOverrideCursor();
 }
 
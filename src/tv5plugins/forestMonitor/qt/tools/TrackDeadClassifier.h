@@ -27,6 +27,7 @@
 #include <terralib/memory/DataSet.h>
 #include <terralib/qt/widgets/tools/AbstractTool.h>
 #include "../../../Config.h"
+#include "../../core/PointIndex.h"
 
 // STL
 #include <list>
@@ -136,7 +137,7 @@ namespace te
           
           te::rst::Raster* m_ndviRaster;
 
-          te::sam::rtree::Index<int> m_centroidRtree;
+          std::auto_ptr<PointIndex> m_centroidIndex;     //!< Centroid index, a grid with the planting distance as cell size.
           std::map<int, te::gm::Geometry*> m_centroidGeomMap;
           std::map<int, te::da::ObjectId*> m_centroidObjIdMap;
 
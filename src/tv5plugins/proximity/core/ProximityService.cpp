@@ -30,6 +30,7 @@
 #include <terralib/dataaccess/datasource/DataSourceFactory.h>
 #include <terralib/dataaccess/utils/Utils.h>
 #include <terralib/geometry/GeometryProperty.h>
+#include "../../PackedRTree.h"
 #include "ProximityService.h"
 #include "Proximity.h"
 
@@ -69,7 +70,7 @@ void te::qt::plugins::tv5plugins::ProximityService::runService()
   m_result.clear();
 
   //build tree with output elements
-  te::sam::rtree::Index<int> rtree;
+  te::qt::plugins::tv5plugins::PackedRTree rtree;
 
   std::map<int, te::gm::Geometry*> mapGeom;
   std::map<int, std::string> mapAttr;
@@ -102,6 +103,9 @@ void te::qt::plugins::tv5plugins::ProximityService::runService()
     mapAttr.insert(std::map<int, std::string>::value_type(id, strAttr));
   }
 
+  //pack the tree with all envelopes
+  rtree.build();
+
   //start search
   te::gm::GeometryProperty* gmPropInput = te::da::GetFirstGeomProperty(m_inputDataType.get());
 